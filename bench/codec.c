@@ -0,0 +1,226 @@
+// (c) A. C. Gäßler 2025
+//
+// Measures decode_pelx, to_png, encode_pelx and encode_png on synthetic inputs of every tag mix,
+// with warm caches (the same input over and over) and cold caches (CPU caches flushed before each call),
+// and prints the results as JSON on stdout:
+//
+//     { "benchmark": "codec", "results": [ { "operation": ..., "size": ..., "mix": ..., "cache": ...,
+//       "iterations": ..., "seconds": ..., "mb_per_s": ..., "pixels_per_s": ... }, ... ] }
+//
+// MB/s is relative to the PELX pixel data of the input, so operations are comparable with each other.
+// decode_pelx reads through the page cache in both modes, the cold mode only evicts the CPU caches.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h> // for mkdir
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "synthetic.h"
+
+#define BENCH_batches 5
+#define BENCH_flush_size (64u << 20) // larger than any last-level cache
+
+typedef enum
+{
+	bench_decode_pelx = 0,
+	bench_to_png,
+	bench_encode_pelx,
+	bench_encode_png,
+	bench_operation_count
+} bench_operation_t;
+
+static const char *bench_operation_names[bench_operation_count] =
+{
+	"decode_pelx", "to_png", "encode_pelx", "encode_png"
+};
+
+typedef struct
+{
+	PELX_type(file) image;
+	const char *pelx_path; // image as written by encode_pelx
+	const char *output_path;
+	PELX_type(palette_entry) *palette;
+} bench_input_t;
+
+static uint8_t *flush_buffer;
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Evicts the CPU caches by writing a buffer larger than them
+static void flush_caches(void)
+{
+	for (size_t i = 0; i < BENCH_flush_size; i += 64)
+	{
+		flush_buffer[i]++;
+	}
+}
+
+static PELX_type(result) run_operation(bench_operation_t operation, const bench_input_t *input)
+{
+	PELX_type(result) result = PELX_enum(success);
+
+	switch (operation)
+	{
+		case bench_decode_pelx:
+		{
+			PELX_type(file) decoded = NULL;
+			result = PELX_func(decode_pelx)(input->pelx_path, &decoded);
+			PELX_func(free_file)(&decoded);
+			break;
+		}
+
+		case bench_to_png:
+		{
+			PELX_type(file) image = input->image;
+			uint8_t *png_buffer = NULL;
+			result = PELX_func(to_png)(&image, SYNTHETIC_palette_count, input->palette, 4, &png_buffer);
+			free(png_buffer);
+			break;
+		}
+
+		case bench_encode_pelx:
+			result = PELX_func(encode_pelx)(input->output_path, input->image);
+			break;
+
+		case bench_encode_png:
+			result = PELX_func(encode_png)(input->output_path, input->image, SYNTHETIC_palette_count, input->palette, 4);
+			break;
+
+		default:
+			break;
+	}
+
+	return result;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Returns the median time of one call over BENCH_batches batches, or a negative value on failure
+static double measure(bench_operation_t operation, const bench_input_t *input, int iterations, int cold)
+{
+	double batch_seconds[BENCH_batches];
+
+	// One untimed call so that warm runs start warm
+	if (run_operation(operation, input) != PELX_enum(success))
+	{
+		return -1.0;
+	}
+
+	for (int b = 0; b < BENCH_batches; b++)
+	{
+		double elapsed = 0.0;
+
+		for (int i = 0; i < iterations; i++)
+		{
+			if (cold)
+			{
+				flush_caches();
+			}
+
+			const double start = now_seconds();
+			PELX_type(result) result = run_operation(operation, input);
+			elapsed += now_seconds() - start;
+
+			if (result != PELX_enum(success))
+			{
+				fprintf(stderr, "%s failed with error code %d\n", bench_operation_names[operation], result);
+				return -1.0;
+			}
+		}
+
+		batch_seconds[b] = elapsed / iterations;
+	}
+
+	qsort(batch_seconds, BENCH_batches, sizeof(double), compare_doubles);
+	return batch_seconds[BENCH_batches / 2];
+}
+
+int main(void)
+{
+	// if on Windows, you will have to replace this with _mkdir("bench_output") from direct.h
+	(void)mkdir("bench_output", 0777);
+
+	flush_buffer = (uint8_t *)calloc(BENCH_flush_size, 1);
+	if (flush_buffer == NULL)
+	{
+		fprintf(stderr, "failed to allocate the cache flush buffer\n");
+		return 1;
+	}
+
+	static const uint16_t sizes[] = { 64, 256, 1024 };
+
+	PELX_type(palette_entry) palette[SYNTHETIC_palette_count];
+	synthetic_palette(palette);
+
+	printf("{\n\t\"benchmark\": \"codec\",\n\t\"results\":\n\t[");
+	int first = 1;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		for (int m = 0; m < synthetic_mix_count; m++)
+		{
+			bench_input_t input;
+			input.image = synthetic_image(sizes[s], sizes[s], (synthetic_mix_t)m);
+			input.pelx_path = "bench_output/codec_input.pelx";
+			input.output_path = "bench_output/codec_output";
+			input.palette = palette;
+
+			if (input.image == NULL || PELX_func(encode_pelx)(input.pelx_path, input.image) != PELX_enum(success))
+			{
+				fprintf(stderr, "failed to generate input\n");
+				return 1;
+			}
+
+			const double pixels = (double)sizes[s] * sizes[s];
+			const double bytes = (double)input.image->body.size;
+			const int iterations = sizes[s] >= 1024 ? 3 : sizes[s] >= 256 ? 20 : 200;
+
+			for (int o = 0; o < bench_operation_count; o++)
+			{
+				for (int cold = 0; cold <= 1; cold++)
+				{
+					// Flushing costs far more than a small call, so cold runs take fewer samples
+					const int cold_iterations = iterations > 20 ? 20 : iterations;
+					const int count = cold ? cold_iterations : iterations;
+
+					const double seconds = measure((bench_operation_t)o, &input, count, cold);
+					if (seconds < 0.0)
+					{
+						return 1;
+					}
+
+					printf("%s\n\t\t{ \"operation\": \"%s\", \"size\": %u, \"mix\": \"%s\", \"cache\": \"%s\", "
+					       "\"iterations\": %d, \"seconds\": %.9f, \"mb_per_s\": %.2f, \"pixels_per_s\": %.0f }",
+					       first ? "" : ",", bench_operation_names[o], (unsigned)sizes[s], synthetic_mix_names[m],
+					       cold ? "cold" : "warm", count * BENCH_batches, seconds, bytes / seconds / 1e6, pixels / seconds);
+					fflush(stdout);
+					first = 0;
+				}
+			}
+
+			PELX_func(free_file)(&input.image);
+		}
+	}
+
+	printf("\n\t]\n}\n");
+
+	remove("bench_output/codec_input.pelx");
+	remove("bench_output/codec_output");
+	free(flush_buffer);
+	return 0;
+}
@@ -0,0 +1,108 @@
+// (c) A. C. Gäßler 2025
+//
+// Compares the fast export targets (QOI, BMP, TGA) against PNG on the same PELX inputs,
+// reporting throughput in expanded bytes per second and the size of the written file
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h> // for mkdir and stat
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "synthetic.h"
+
+typedef PELX_type(result) (*encode_function_t)(const char *file, PELX_type(file_data) *input_data,
+                                               uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                               uint8_t channels);
+
+typedef struct
+{
+	const char *name;
+	const char *extension;
+	encode_function_t encode;
+} format_t;
+
+static const format_t formats[] =
+{
+	{ "png", "png", PELX_func(encode_png) },
+	{ "qoi", "qoi", PELX_func(encode_qoi) },
+	{ "bmp", "bmp", PELX_func(encode_bmp) },
+	{ "tga", "tga", PELX_func(encode_tga) },
+};
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+	// if on Windows, you will have to replace this with _mkdir("bench_output") from direct.h
+	(void)mkdir("bench_output", 0777);
+
+	static const uint16_t sizes[] = { 64, 256, 1024 };
+	static const synthetic_mix_t mixes[] = { synthetic_mix_runs, synthetic_mix_mixed, synthetic_mix_true };
+
+	PELX_type(palette_entry) palette[SYNTHETIC_palette_count];
+	synthetic_palette(palette);
+
+	printf("%-6s %-6s %-4s %12s %12s %8s\n", "size", "mix", "fmt", "MB/s", "bytes", "vs png");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++)
+		{
+			PELX_type(file) pelx_file = synthetic_image(sizes[s], sizes[s], mixes[m]);
+			if (pelx_file == NULL)
+			{
+				fprintf(stderr, "failed to generate input\n");
+				return 1;
+			}
+
+			const double expanded_bytes = (double)sizes[s] * sizes[s] * 4;
+			const int iterations = sizes[s] >= 1024 ? 3 : sizes[s] >= 256 ? 20 : 200;
+			long long png_size = 0;
+
+			for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+			{
+				char file_path[256];
+				snprintf(file_path, sizeof(file_path), "bench_output/%u_%s.%s",
+				         (unsigned)sizes[s], synthetic_mix_names[mixes[m]], formats[f].extension);
+
+				double start = now_seconds();
+				for (int i = 0; i < iterations; i++)
+				{
+					PELX_type(result) result = formats[f].encode(file_path, pelx_file, SYNTHETIC_palette_count, palette, 4);
+					if (result != PELX_enum(success))
+					{
+						fprintf(stderr, "%s encoding failed with error code %d\n", formats[f].name, result);
+						return 1;
+					}
+				}
+				double elapsed = now_seconds() - start;
+
+				struct stat st;
+				long long file_size = stat(file_path, &st) == 0 ? (long long)st.st_size : -1;
+				if (f == 0)
+				{
+					png_size = file_size;
+				}
+
+				printf("%-6u %-6s %-4s %12.2f %12lld %7.2fx\n",
+				       (unsigned)sizes[s], synthetic_mix_names[mixes[m]], formats[f].name,
+				       expanded_bytes * iterations / elapsed / 1e6,
+				       file_size, png_size > 0 ? (double)file_size / png_size : 0.0);
+			}
+
+			PELX_func(free_file)(&pelx_file);
+		}
+	}
+
+	return 0;
+}
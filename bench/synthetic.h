@@ -0,0 +1,137 @@
+// (c) A. C. Gäßler 2025
+//
+// Synthetic PELX images shared by the benchmarks, generated in memory with a fixed seed
+// so that every run measures the same inputs
+
+#if !defined (__PELX_BENCH_SYNTHETIC_H__)
+#define __PELX_BENCH_SYNTHETIC_H__ 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pelx.h"
+
+typedef enum
+{
+	synthetic_mix_void = 0, // every pixel is void
+	synthetic_mix_pale,     // every pixel is a random palette index
+	synthetic_mix_true,     // every pixel is random true colour
+	synthetic_mix_mixed,    // a random mix of all three tags
+	synthetic_mix_runs,     // long horizontal runs of palette colours, like pixel art
+	synthetic_mix_count
+} synthetic_mix_t;
+
+static const char *synthetic_mix_names[synthetic_mix_count] =
+{
+	"void", "pale", "true", "mixed", "runs"
+};
+
+#define SYNTHETIC_palette_count 16
+
+static uint32_t synthetic_random(uint32_t *state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void synthetic_palette(PELX_type(palette_entry) entries[SYNTHETIC_palette_count])
+{
+	uint32_t state = 0x9E3779B9u;
+	for (int i = 0; i < SYNTHETIC_palette_count; i++)
+	{
+		uint32_t value = synthetic_random(&state);
+		entries[i].r = (uint8_t)value;
+		entries[i].g = (uint8_t)(value >> 8);
+		entries[i].b = (uint8_t)(value >> 16);
+		entries[i].a = 0xFF;
+	}
+}
+
+// Creates a width x height PELX image in memory, free with PELX_func(free_file)
+static PELX_type(file) synthetic_image(uint16_t width, uint16_t height, synthetic_mix_t mix)
+{
+	const size_t pixel_count = (size_t)width * height;
+	const uint8_t true_channels = 4;
+
+	PELX_type(file) pelx_file = (PELX_type(file))calloc(1, sizeof(*pelx_file));
+	if (pelx_file == NULL)
+	{
+		return NULL;
+	}
+
+	memcpy(pelx_file->header.magic, "PELX\0", 5);
+	pelx_file->header.header_size = 26;
+	pelx_file->header.palette_offset = 26;
+	pelx_file->header.width = width;
+	pelx_file->header.height = height;
+	pelx_file->header.palette_channel_count = 4;
+	pelx_file->header.true_channel_count = true_channels;
+	pelx_file->header.palette_count = SYNTHETIC_palette_count;
+
+	uint8_t *body = (uint8_t *)malloc(pixel_count * (1 + true_channels));
+	if (body == NULL)
+	{
+		free(pelx_file);
+		return NULL;
+	}
+
+	uint32_t state = 0xC0FFEEu ^ ((uint32_t)width << 16) ^ height ^ ((uint32_t)mix << 8);
+	size_t pos = 0;
+	uint8_t run_index = 0;
+	uint32_t run_left = 0;
+
+	for (size_t i = 0; i < pixel_count; i++)
+	{
+		uint32_t value = synthetic_random(&state);
+		uint8_t tag;
+
+		switch (mix)
+		{
+			case synthetic_mix_void: tag = PELX_tag_void; break;
+			case synthetic_mix_pale: tag = PELX_tag_pale; break;
+			case synthetic_mix_true: tag = PELX_tag_true; break;
+			case synthetic_mix_mixed: tag = (uint8_t)(value % 3); break;
+			default: tag = PELX_tag_pale; break;
+		}
+
+		body[pos++] = tag;
+
+		if (tag == PELX_tag_true)
+		{
+			body[pos++] = (uint8_t)(value >> 8);
+			body[pos++] = (uint8_t)(value >> 16);
+			body[pos++] = (uint8_t)(value >> 24);
+			body[pos++] = 0xFF;
+		}
+		else if (tag == PELX_tag_pale)
+		{
+			if (mix == synthetic_mix_runs)
+			{
+				if (run_left == 0)
+				{
+					run_index = (uint8_t)((value >> 8) % SYNTHETIC_palette_count);
+					run_left = 8 + (value >> 16) % 56;
+				}
+				run_left--;
+				body[pos++] = run_index;
+			}
+			else
+			{
+				body[pos++] = (uint8_t)((value >> 8) % SYNTHETIC_palette_count);
+			}
+		}
+	}
+
+	pelx_file->body.data = body;
+	pelx_file->body.size = (uint32_t)pos;
+
+	return pelx_file;
+}
+
+#endif // __PELX_BENCH_SYNTHETIC_H__
@@ -31,6 +31,10 @@ BUILDING:
    unsigned char * my_compress(unsigned char *data, int data_len, int *out_len, int quality);
    The returned data will be freed with STBIW_FREE() (free() by default),
    so it must be heap allocated with STBIW_MALLOC() (malloc() by default),
+   You can #define STBIW_CRC32(buffer, len) and STBIW_ADLER32(buffer, len) to
+   replace the builtin checksums of the PNG writer (local addition for pelx.h).
+   You can #define STBIW_PNG_FILTERED() to be called once the PNG writer has
+   filtered all rows, right before it compresses them (local addition for pelx.h).
 
 UNICODE:
 
@@ -999,6 +1003,10 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    }
 
    {
+#ifdef STBIW_ADLER32
+      unsigned int adler = STBIW_ADLER32(data, data_len);
+      unsigned int s1 = adler & 0xffff, s2 = adler >> 16;
+#else
       // compute adler32 on input
       unsigned int s1=1, s2=0;
       int blocklen = (int) (data_len % 5552);
@@ -1009,6 +1017,7 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
          j += blocklen;
          blocklen = 5552;
       }
+#endif
       stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
       stbiw__sbpush(out, STBIW_UCHAR(s2));
       stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
@@ -1173,6 +1182,9 @@ STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int s
       STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer, x*n);
    }
    STBIW_FREE(line_buffer);
+#ifdef STBIW_PNG_FILTERED
+   STBIW_PNG_FILTERED();
+#endif
    zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
    STBIW_FREE(filt);
    if (!zlib) return 0;
@@ -2,7 +2,7 @@
 #include "pelx.h"
 
 // Super Mario Bros. (c) Nintendo 1985
-static const uint8_t mushroom_texture_data[] =
+static PELX_constexpr uint8_t mushroom_texture_data[] =
 {
 	PELX_tag_void,
 	PELX_tag_void,
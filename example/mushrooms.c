@@ -18,27 +18,26 @@
 #include "mushroom_texture.h"
 #include "mushroom_palettes.h"
 
-static PELX_type(file) create_makeshift_data(void)
+// Views the embedded texture in place, without copying it to the heap
+static PELX_type(file_data) create_makeshift_data(void)
 {
-	PELX_type(file) pelx_file = (PELX_type(file))malloc(sizeof(*pelx_file));
-	memset(pelx_file, 0, sizeof(*pelx_file));
+	PELX_type(header) header;
+	memset(&header, 0, sizeof(header));
 
-	memcpy(pelx_file->header.magic, "PELX\0", 5);
-	pelx_file->header.width = 16;
-	pelx_file->header.height = 16;
-	pelx_file->header.palette_channel_count = 4;
-	pelx_file->header.true_channel_count = 4;
-	pelx_file->header.palette_count = 2;
+	memcpy(header.magic, "PELX\0", 5);
+	header.width = 16;
+	header.height = 16;
+	header.palette_channel_count = 4;
+	header.true_channel_count = 4;
+	header.palette_count = 2;
 
-	pelx_file->header.header_size = 26;
-	pelx_file->header.palette_offset = 26;
+	header.header_size = 26;
+	header.palette_offset = 26;
 
-	size_t raw_data_size = sizeof(mushroom_texture_data);
-	pelx_file->body.data = malloc(raw_data_size);
-	pelx_file->body.size = (uint16_t)raw_data_size;
-	memcpy(pelx_file->body.data, mushroom_texture_data, raw_data_size);
+	PELX_type(file_data) pelx_view;
+	PELX_func(init_view)(&pelx_view, &header, mushroom_texture_data, (uint32_t)sizeof(mushroom_texture_data));
 
-	return pelx_file;
+	return pelx_view;
 }
 
 int main(void)
@@ -48,8 +47,8 @@ int main(void)
 
 	PELX_type(result) result;
 
-	PELX_type(file) mock_file = create_makeshift_data();
-	result = PELX_func(encode_pelx)("mushrooms/data.pelx", mock_file);
+	PELX_type(file_data) mock_file = create_makeshift_data();
+	result = PELX_func(encode_pelx)("mushrooms/data.pelx", &mock_file);
 
 	PELX_type(file) pelx_file;
 	result = PELX_func(decode_pelx)("mushrooms/data.pelx", &pelx_file);
@@ -12,6 +12,8 @@
 //     - The stb_image_write.h header by Sean Barrett
 //
 //     Both must be available and included during compilation.
+//     The implementation also uses pthreads (or SRW locks on Windows) for its process-wide state,
+//     so link with -pthread where the C library does not provide them.
 // 
 // To use the library:
 //     As any other header-based C library, a macro must be defined to tell the header to include the implementation.
@@ -34,8 +36,38 @@
 // 
 //     result = PELX_func(encode_png)("texture_mod.png", pelx_file, 2, entries, 4); // encode as PNG
 // 
-// TODO:
-//     1. Wake use of the palette definitions block to assign unique names per palette
+// Embedded palettes:
+//     Palettes can be stored in the file itself, each with a unique name, and rendered without passing entries:
+// 
+//     PELX_func(add_palette)(pelx_file, "overworld", entries); // stored on the next encode_pelx
+// 
+//     result = PELX_func(encode_png_named)("texture_overworld.png", pelx_file, "overworld", 4);
+// 
+// Allocators:
+//     The decode, render and encode functions have *_context versions allocating through caller callbacks, e.g. from a frame arena:
+// 
+//     PELX_type(context) context;
+//     PELX_func(init_context)(&context, arena_alloc, NULL, arena_free, &frame_arena);
+// 
+//     result = PELX_func(decode_pelx_context)(&context, "texture.pelx", &pelx_file);
+//
+// Instrumentation:
+//     Defining PELX_with_stats (next to PELX_with_implementation) counts time per phase, bytes, decoded tags and
+//     allocations of every decode_pelx, to_png and encode_* call; on POSIX this needs _POSIX_C_SOURCE 199309L or later:
+//
+//     PELX_type(stats) stats;
+//     PELX_func(global_stats)(&stats); // summed over all threads, last_call_stats reads the calling thread's last call
+//
+// Tracing:
+//     Defining PELX_with_tracing reports the decode, render and encode spans of every call to a callback, which can be
+//     the built-in Chrome trace-event writer (open the file in chrome://tracing or Perfetto):
+//
+//     PELX_func(start_chrome_trace)("pelx_trace.json");
+//     ...
+//     PELX_func(stop_chrome_trace)();
+//
+//     Also defining PELX_with_usdt emits the USDT probes pelx:span_begin and pelx:span_end (needs <sys/sdt.h>),
+//     e.g. for perf probe, bpftrace or SystemTap.
 
 #if !defined (__PELX_H_LIBRARY__)
 #define __PELX_H_LIBRARY__ 1
@@ -48,6 +80,13 @@
 #endif
 #endif // PELX_def
 
+// Qualifier of embedded pixel data, constexpr under C++ so that pelx.hpp can decode it at compile time
+#ifdef __cplusplus
+#define PELX_constexpr constexpr
+#else
+#define PELX_constexpr const
+#endif
+
 #define PELX_type(n) pelx_##n##_t
 #define PELX_func(n) pelx_##n##_f
 #define PELX_enum(n) pelx_##n##_e
@@ -64,6 +103,29 @@
 // | Pixel Data             | <- begins at offset header_size
 // +------------------------+
 
+// Format of the Palette Definitions (empty when palette_offset equals header_size):
+// [N16 palette set count]
+// for each palette set:
+//     [N8 name length][name bytes]           -> unique name, without a terminator
+//     [palette_count x palette_channel_count] -> entries (RGB or RGBA)
+
+// Format of a PELX Pack (many PELX files in one, all integers big-endian):
+// [8 magic 'PELXPAK\0'][N32 version = 1][N32 entry count][N64 names offset]
+// for each entry, sorted by name hash then name (24 bytes each, from offset 24):
+//     [N64 name hash (FNV-1a)][N64 image offset][N32 image size][N32 name offset within the names block]
+// [names block: NUL-terminated names]
+// [PELX files, concatenated]
+
+// Format of the Pixel Data of an animation (header.reserved[0] has PELX_flag_animated):
+// [N16 frame count]
+// for each frame: [N16 delay in milliseconds][N32 frame size]
+// [frame data, concatenated]    -> frame 0 is regular pixel data, later frames are deltas on the previous frame
+//
+// Format of a delta frame:
+// [03][N16 n]                   -> skip n >= 1 unchanged pixels
+// [00] / [01][R][G][B]... / [02][i] -> the next pixel changed, tagged as in the pixel data
+//                                   -> pixels after the end of the frame are unchanged
+
 // Format of the Pixel Data:
 // [00][00]          -> Palette index 0
 // [01][11][22][33]  -> RGB pixel (0x11, 0x22, 0x33)
@@ -73,6 +135,17 @@
 #define PELX_tag_void 0x00
 #define PELX_tag_true 0x01
 #define PELX_tag_pale 0x02
+#define PELX_tag_skip 0x03 // only in animation delta frames
+
+// Flags of header.reserved[0]
+#define PELX_flag_animated 0x01
+
+// Flags of file_data.flags
+#define PELX_file_view 0x01 // body and the file_data itself are borrowed, e.g. constant or mapped memory
+
+#define PELX_header_disk_size 26
+#define PELX_scale_max 16 // of to_png_scaled and encode_png_scaled
+#define PELX_palette_name_max 255
 
 typedef struct
 {
@@ -95,18 +168,213 @@ typedef struct
 	uint8_t a; // opt
 } PELX_type(palette_entry);
 
+typedef struct
+{
+	char name[PELX_palette_name_max + 1];
+	PELX_type(palette_entry) *entries; // header.palette_count entries
+} PELX_type(palette);
+
+// Zero-initialise when filling by hand, free_file releases the body and every embedded palette;
+// views (see init_view) point at memory they do not own, free_file only releases the palettes added to them
 typedef struct
 {
 	PELX_type(header) header;
 	struct
 	{
-		uint16_t size;
+		uint32_t size;
 		uint8_t *data;
 	} body;
+	struct
+	{
+		uint16_t count;
+		PELX_type(palette) *data;
+		uint16_t *lookup; // open addressing table of palette index + 1 by name hash (0 is empty)
+		uint32_t lookup_size; // power of two
+	} palettes;
+	uint8_t flags; // PELX_file_view
 } PELX_type(file_data);
 
 typedef PELX_type(file_data) *PELX_type(file);
 
+// Allocator and scratch memory for the *_context functions, set up with init_context
+typedef struct
+{
+	void *(*alloc)(void *user, size_t size);
+	void *(*realloc)(void *user, void *pointer, size_t old_size, size_t new_size); // optional, alloc + copy + free otherwise
+	void (*free)(void *user, void *pointer); // may do nothing, as for an arena reset by its owner
+	void *user;
+	uint8_t *scratch; // rendered images of encodes, reused across calls
+	size_t scratch_size;
+	uint8_t *output; // result of encode_png_memory_context, replaced by the next call
+	size_t output_size;
+} PELX_type(context);
+
+// Handle to a palette in the process-wide registry (0 is never a valid handle), the upper 16 bits hold the
+// registry generation so that handles from before a reset_palette_registry stay invalid
+typedef uint32_t PELX_type(palette_handle);
+
+// Thread-safe LRU cache of rendered images under a byte budget
+typedef struct PELX_type(render_cache_data) *PELX_type(render_cache);
+
+// Counters of a render cache, summed over its shards
+typedef struct
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t entries;
+	uint64_t bytes; // pixels, and the copies of their keys, currently held within the budget
+} PELX_type(render_cache_stats);
+
+// Phases timed by the instrumentation
+typedef enum
+{
+	PELX_enum(phase_read) = 0, // opening and reading PELX files
+	PELX_enum(phase_parse),    // header and palette block
+	PELX_enum(phase_decode),   // tagged pixels into an image
+	PELX_enum(phase_filter),   // PNG scanline filters
+	PELX_enum(phase_deflate),  // PNG compression and chunks
+	PELX_enum(phase_write),    // writing the output file (all of the encode for QOI, BMP and TGA)
+	PELX_enum(phase_count)
+} PELX_type(phase);
+
+// Receives the spans of the tracing, nanoseconds are from a monotonic clock
+typedef void (*PELX_type(trace_callback))(void *user, const char *span, int begin, uint64_t nanoseconds);
+
+// Counters of decode_pelx, to_png and encode_* calls, all zero unless compiled with PELX_with_stats
+typedef struct
+{
+	uint64_t calls;
+	uint64_t nanoseconds[PELX_enum(phase_count)];
+	uint64_t bytes_in;  // PELX file or pixel data read
+	uint64_t bytes_out; // image bytes produced
+	uint64_t tags[3];   // decoded pixels, indexed by PELX_tag_void, PELX_tag_true and PELX_tag_pale
+	uint64_t allocations;
+} PELX_type(stats);
+
+// Placement of one image in an atlas
+typedef struct
+{
+	uint32_t x;
+	uint32_t y;
+	uint16_t width;
+	uint16_t height;
+	float u0, v0; // top-left texture coordinate
+	float u1, v1; // bottom-right texture coordinate
+} PELX_type(atlas_rect);
+
+// Many PELX images packed into one RGBA buffer
+typedef struct
+{
+	uint32_t width;
+	uint32_t height;
+	uint8_t *pixels; // width * height * 4 bytes
+	uint32_t count;
+	PELX_type(atlas_rect) *rects; // in the order the images were given
+} PELX_type(atlas_data);
+
+typedef PELX_type(atlas_data) *PELX_type(atlas);
+
+#define PELX_mip_levels_max 17 // 65535 wide halves 16 times down to 1
+
+// How build_mipmaps reduces each 2x2 block of a level
+typedef enum
+{
+	PELX_enum(mip_box),     // rounded average of the four pixels
+	PELX_enum(mip_palette), // most frequent of the four pixels, so levels keep the exact palette colours
+} PELX_type(mip_filter);
+
+// One level of a mip chain, rows without padding
+typedef struct
+{
+	uint16_t width;
+	uint16_t height;
+	size_t offset; // into the pixels of the chain
+} PELX_type(mip_level);
+
+// Every mip level of an image in one allocation, level 0 is the image itself
+typedef struct
+{
+	uint8_t channels;
+	uint8_t level_count; // down to 1x1
+	PELX_type(mip_level) levels[PELX_mip_levels_max];
+	size_t size; // of pixels, every level packed one after the other
+	uint8_t *pixels;
+} PELX_type(mipmap_data);
+
+typedef PELX_type(mipmap_data) *PELX_type(mipmap);
+
+// Playback state of an animated PELX file, pixels holds the current frame
+typedef struct
+{
+	const PELX_type(file_data) *file; // borrowed, must outlive the animation
+	uint16_t frame_count;
+	uint16_t frame; // index of the frame in pixels
+	uint16_t *delays; // milliseconds, per frame
+	const uint8_t **frames; // per frame, into the file body
+	uint32_t *frame_sizes;
+	uint8_t channels;
+	uint16_t lut_count;
+	uint8_t lut[256][4];
+	uint8_t *pixels; // width * height * channels bytes
+} PELX_type(animation_data);
+
+typedef PELX_type(animation_data) *PELX_type(animation);
+
+// Pixels of a still image kept up to date through palette changes, e.g. for palette cycling (water, fire)
+typedef struct
+{
+	uint16_t width;
+	uint16_t height;
+	uint8_t channels;
+	uint8_t palette_channels; // of the image, for resolving new entries
+	uint16_t lut_count;
+	uint8_t lut[256][4];
+	uint32_t starts[257]; // the pixels of palette index i are positions[starts[i]] to positions[starts[i + 1] - 1]
+	uint32_t *positions; // y * width + x, grouped by palette index
+	uint16_t bounds[256][4]; // x, y, width and height around the pixels of each palette index
+	uint8_t *pixels; // width * height * channels bytes
+	uint32_t changed; // pixels written by the last update
+	uint16_t dirty[4]; // x, y, width and height around them, width 0 when none
+} PELX_type(palette_target_data);
+
+typedef PELX_type(palette_target_data) *PELX_type(palette_target);
+
+// Mask values of an index texture, as a normalised R8 texture: 0 for palette, about 0.5 for void, 1 for true colour
+#define PELX_index_mask_palette 0x00
+#define PELX_index_mask_void 0x80
+#define PELX_index_mask_true 0xFF
+
+// An image split for palette lookup on the GPU: a shader reads palettes[indices] where mask is PELX_index_mask_palette,
+// transparent black where it is PELX_index_mask_void and true_colour where it is PELX_index_mask_true
+typedef struct
+{
+	uint16_t width;
+	uint16_t height;
+	uint8_t *indices; // width * height bytes (R8), 0 where the pixel is not a palette pixel
+	uint8_t *mask; // width * height bytes of PELX_index_mask_*, can be left out when every pixel is a palette pixel
+	uint8_t *true_colour; // width * height * 4 bytes (RGBA), 0 except at true colour pixels, NULL when there are none
+	uint32_t true_colour_count; // true colour pixels
+	uint16_t palette_count; // rows of palettes
+	uint8_t *palettes; // 256 x palette_count RGBA strip, one palette per row of 1 KB, unused entries transparent black
+} PELX_type(index_texture_data);
+
+typedef PELX_type(index_texture_data) *PELX_type(index_texture);
+
+// A read-only PELX pack mapped into memory, see "Format of a PELX Pack"
+typedef struct
+{
+	const uint8_t *data;
+	size_t size;
+	uint32_t count;
+	const uint8_t *index;
+	const uint8_t *names;
+	size_t names_size;
+	void *mapping; // platform mapping state
+} PELX_type(pack_data);
+
+typedef PELX_type(pack_data) *PELX_type(pack);
+
 typedef enum
 {
 	PELX_enum(success) = 0,
@@ -140,12 +408,59 @@ typedef enum
 
 	// Results when the palette channels are invalid (i.e., not 3 or 4)
 	PELX_enum(header_invalid_palette_channels),
+
+	// Results when no embedded palette matches the requested name or index
+	PELX_enum(palette_not_found),
+
+	// Results when a palette name is empty, too long, or already in use
+	PELX_enum(invalid_palette_name),
+
+	// Results when a palette handle was not returned by register_palette (or the registry was reset)
+	PELX_enum(invalid_palette_handle),
+
+	// Results when a pack has no entry with the requested name or index
+	PELX_enum(entry_not_found),
+
+	// Results when a pack entry name is empty or used twice
+	PELX_enum(invalid_entry_name),
+
+	// Results when a scale factor is 0 or above PELX_scale_max
+	PELX_enum(invalid_scale),
 } PELX_type(result);
 
+// One conversion of a batch, from a PELX file to a PNG file
+typedef struct
+{
+	const char *input;
+	const char *output;
+	uint16_t palette_count;
+	PELX_type(palette_entry) *palette_entries;
+	uint8_t png_channels;
+	PELX_type(result) result; // set by encode_batch
+} PELX_type(batch_job);
+
+// What validate_pixels found in the pixel data of an image
+typedef struct
+{
+	PELX_type(result) result; // success when the pixel data is exactly width * height valid pixels
+	uint32_t pixel_count; // pixels before the first error
+	uint32_t palette_pixel_count;
+	uint8_t max_palette_index; // highest Pale index, valid when palette_pixel_count > 0
+	uint32_t error_offset; // offset of the first error in the pixel data, UINT32_MAX without errors
+	const uint8_t *body; // the validated pixel data, to_png_unchecked only accepts the validation with the same data
+	size_t body_size;
+	uint8_t true_channel_count;
+} PELX_type(validation);
+
 
 // Frees a PELX files
 PELX_def void PELX_func(free_file)(PELX_type(file) *file);
 
+// Fills a view of an image whose pixel data is in memory the caller keeps alive (e.g. an embedded array),
+// without allocating or copying; views are accepted wherever a file is
+PELX_def PELX_type(result) PELX_func(init_view)(PELX_type(file_data) *view, const PELX_type(header) *header,
+                                                const uint8_t *body, uint32_t body_size);
+
 // Ensures a PELX header is valid
 PELX_def PELX_type(result) PELX_func(sanitize_header)(PELX_type(header) *header);
 
@@ -154,6 +469,11 @@ PELX_def PELX_type(result) PELX_func(to_png)(PELX_type(file) *pelx_file,
                                              uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
                                              uint8_t png_channels, uint8_t **png_buffer);
 
+// Converts a PELX file to pixels scaled up by an integer factor (nearest neighbour), width * scale by height * scale
+PELX_def PELX_type(result) PELX_func(to_png_scaled)(PELX_type(file) *pelx_file,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t png_channels, uint8_t scale, uint8_t **png_buffer);
+
 // Decodes a PELX file to a PELX file_data_t output
 PELX_def PELX_type(result) PELX_func(decode_pelx)(const char *file, PELX_type(file) *output);
 
@@ -170,6 +490,263 @@ PELX_def PELX_type(result) PELX_func(encode_png)(const char *file, PELX_type(fil
                                                  uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
                                                  uint8_t png_channels);
 
+// Encodes a PELX file to PNG format scaled up by an integer factor (nearest neighbour)
+PELX_def PELX_type(result) PELX_func(encode_png_scaled)(const char *file, PELX_type(file_data) *input_data,
+                                                        uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t png_channels, uint8_t scale);
+
+// Encodes a PELX file to PNG format using one of its embedded palettes
+PELX_def PELX_type(result) PELX_func(encode_png_named)(const char *file, PELX_type(file_data) *input_data,
+                                                       const char *palette_name, uint8_t png_channels);
+
+// Adds an embedded palette of header.palette_count entries (copied) under a unique name
+PELX_def PELX_type(result) PELX_func(add_palette)(PELX_type(file_data) *pelx_data, const char *name,
+                                                  const PELX_type(palette_entry) *palette_entries);
+
+// Returns the embedded palette at an index, or NULL
+PELX_def PELX_type(palette) *PELX_func(get_palette)(PELX_type(file_data) *pelx_data, uint16_t index);
+
+// Returns the embedded palette with a name, or NULL
+PELX_def PELX_type(palette) *PELX_func(find_palette)(PELX_type(file_data) *pelx_data, const char *name);
+
+// Registers palette entries in the process-wide registry, identical palettes share one handle
+PELX_def PELX_type(result) PELX_func(register_palette)(uint16_t palette_count, const PELX_type(palette_entry) *palette_entries,
+                                                       PELX_type(palette_handle) *handle);
+
+// Returns the number of entries of a registered palette, or 0 for an invalid handle
+PELX_def uint16_t PELX_func(palette_handle_count)(PELX_type(palette_handle) handle);
+
+// Releases every registered palette, invalidating all handles (renders still running finish with their palette)
+PELX_def void PELX_func(reset_palette_registry)(void);
+
+// Converts a PELX file to a PNG file using a registered palette
+PELX_def PELX_type(result) PELX_func(to_png_handle)(PELX_type(file) *pelx_file, PELX_type(palette_handle) handle,
+                                                    uint8_t png_channels, uint8_t **png_buffer);
+
+// Encodes a PELX file to PNG format using a registered palette
+PELX_def PELX_type(result) PELX_func(encode_png_handle)(const char *file, PELX_type(file_data) *input_data,
+                                                        PELX_type(palette_handle) handle, uint8_t png_channels);
+
+// Creates a render cache holding at most byte_budget bytes of rendered pixels
+PELX_def PELX_type(result) PELX_func(create_render_cache)(size_t byte_budget, PELX_type(render_cache) *output);
+
+// Frees a render cache, buffers still held by callers must be released first
+PELX_def void PELX_func(free_render_cache)(PELX_type(render_cache) *cache);
+
+// As to_png, but returns the cached pixels of an identical render when there is one,
+// the buffer stays valid until it is passed to release_png_cached
+PELX_def PELX_type(result) PELX_func(to_png_cached)(PELX_type(render_cache) cache, PELX_type(file) *pelx_file,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t png_channels, const uint8_t **png_buffer);
+
+// As decode_png, but through a render cache keyed by the path, size, and modification and status change
+// times of file, so a hit does not read the file
+PELX_def PELX_type(result) PELX_func(decode_png_cached)(PELX_type(render_cache) cache, const char *file,
+                                                        uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t png_channels, const uint8_t **png_buffer);
+
+// Releases a buffer returned by to_png_cached or decode_png_cached
+PELX_def void PELX_func(release_png_cached)(PELX_type(render_cache) cache, const uint8_t *png_buffer);
+
+// Reads the hit, miss and eviction counters of a render cache
+PELX_def void PELX_func(render_cache_stats)(PELX_type(render_cache) cache, PELX_type(render_cache_stats) *stats);
+
+// Keeps the files of encode_png, encode_qoi, encode_bmp and encode_tga in directory by content,
+// so repeated encodes are a link or copy; at most max_bytes are kept, least recently used first out (NULL disables)
+PELX_def PELX_type(result) PELX_func(set_disk_cache)(const char *directory, uint64_t max_bytes);
+
+// Writes count PELX files into a pack under unique names
+PELX_def PELX_type(result) PELX_func(encode_pack)(const char *file, uint32_t count,
+                                                  const char *const *names, PELX_type(file_data) *const *images);
+
+// Maps a pack for reading
+PELX_def PELX_type(result) PELX_func(open_pack)(const char *file, PELX_type(pack) *output);
+
+// Unmaps a pack, invalidating every view taken from it
+PELX_def void PELX_func(close_pack)(PELX_type(pack) *pack);
+
+// Returns the name of a pack entry, or NULL
+PELX_def const char *PELX_func(pack_name)(PELX_type(pack) pack, uint32_t index);
+
+// Fills a zero-copy view of a pack entry by index, the body points into the mapping
+PELX_def PELX_type(result) PELX_func(pack_get)(PELX_type(pack) pack, uint32_t index, PELX_type(file_data) *view);
+
+// Fills a zero-copy view of a pack entry by name, in O(log n)
+PELX_def PELX_type(result) PELX_func(pack_find)(PELX_type(pack) pack, const char *name, PELX_type(file_data) *view);
+
+// Packs count images into one RGBA atlas (skyline bottom-left), decoding each straight into its rectangle,
+// max_width of 0 picks a width, padding separates rectangles, thread_count of 0 uses every CPU
+PELX_def PELX_type(result) PELX_func(build_atlas)(uint32_t count, PELX_type(file_data) *const *images,
+                                                  const uint16_t *palette_counts, PELX_type(palette_entry) *const *palette_entries,
+                                                  uint32_t max_width, uint8_t padding, uint32_t thread_count,
+                                                  PELX_type(atlas) *output);
+
+// Frees an atlas
+PELX_def void PELX_func(free_atlas)(PELX_type(atlas) *atlas);
+
+// Decodes an image with its full mip chain (each level half the size of the previous one, down to 1x1),
+// all levels in one allocation
+PELX_def PELX_type(result) PELX_func(build_mipmaps)(PELX_type(file_data) *input_data,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t channels, PELX_type(mip_filter) filter, PELX_type(mipmap) *output);
+
+// Frees a mip chain
+PELX_def void PELX_func(free_mipmaps)(PELX_type(mipmap) *mipmap);
+
+// Encodes frames sharing one header (and the embedded palettes of the first) into an animated PELX file,
+// every frame after the first only stores the pixels that changed
+PELX_def PELX_type(result) PELX_func(encode_animation)(const char *file, uint16_t frame_count,
+                                                       PELX_type(file_data) *const *frames, const uint16_t *delays);
+
+// Starts playback of an animated PELX file, the first frame is decoded into animation->pixels
+PELX_def PELX_type(result) PELX_func(open_animation)(PELX_type(file_data) *pelx_data,
+                                                     uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                     uint8_t png_channels, PELX_type(animation) *output);
+
+// Applies the next frame in place (wrapping around to the first), only the changed pixels are written
+PELX_def PELX_type(result) PELX_func(next_frame)(PELX_type(animation) animation);
+
+// Frees an animation (not the file it plays)
+PELX_def void PELX_func(free_animation)(PELX_type(animation) *animation);
+
+// Decodes a still image into a render target whose pixels follow later palette changes
+PELX_def PELX_type(result) PELX_func(bind_palette_target)(PELX_type(file_data) *pelx_data,
+                                                          uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                          uint8_t png_channels, PELX_type(palette_target) *output);
+
+// Replaces count palette entries from first on, rewriting only the pixels of the entries whose colour changed
+PELX_def PELX_type(result) PELX_func(set_palette_entries)(PELX_type(palette_target) target, uint16_t first, uint16_t count,
+                                                          const PELX_type(palette_entry) *palette_entries);
+
+// Rotates the palette entries first to first + count - 1 by steps (towards higher indices), as in colour cycling
+PELX_def PELX_type(result) PELX_func(cycle_palette)(PELX_type(palette_target) target, uint16_t first, uint16_t count, int32_t steps);
+
+// Frees a render target (not the file it was bound to)
+PELX_def void PELX_func(free_palette_target)(PELX_type(palette_target) *target);
+
+// Splits a still image into an index texture for shader-side palette lookup, without expanding it to RGBA;
+// the strip holds palette_count palettes of header.palette_count entries, or every embedded palette when 0
+PELX_def PELX_type(result) PELX_func(build_index_texture)(PELX_type(file_data) *pelx_data, uint16_t palette_count,
+                                                          PELX_type(palette_entry) *const *palettes, PELX_type(index_texture) *output);
+
+// Writes the layers of an index texture as PNG files, true_colour_file and mask_file may be NULL to leave them out,
+// true_colour_file is not written when the image has no true colour pixels
+PELX_def PELX_type(result) PELX_func(encode_index_texture)(const PELX_type(index_texture_data) *texture,
+                                                           const char *index_file, const char *palette_file,
+                                                           const char *true_colour_file, const char *mask_file);
+
+// Frees an index texture
+PELX_def void PELX_func(free_index_texture)(PELX_type(index_texture) *texture);
+
+// Checks that the pixel data holds exactly width * height pixels with palette indices below header.palette_count,
+// without writing any pixels, e.g. to vet uploads before rendering them
+PELX_def PELX_type(result) PELX_func(validate_pixels)(const PELX_type(file_data) *pelx_data, PELX_type(validation) *validation);
+
+// As to_png, but skips all checks of the pixel data, for files validate_pixels accepted (and unchanged since),
+// a validation of other pixel data (another buffer or size) is rejected
+PELX_def PELX_type(result) PELX_func(to_png_unchecked)(PELX_type(file) *pelx_file, const PELX_type(validation) *validation,
+                                                       uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                       uint8_t png_channels, uint8_t **png_buffer);
+
+// Converts count PELX files to PNG on thread_count workers (0 for one per CPU), the result of each job
+// is stored in it, and the first failed job's result is returned
+PELX_def PELX_type(result) PELX_func(encode_batch)(uint32_t count, PELX_type(batch_job) *jobs, uint32_t thread_count);
+
+// Encodes a PELX file to QOI format
+PELX_def PELX_type(result) PELX_func(encode_qoi)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t qoi_channels);
+
+// Encodes a PELX file to uncompressed BMP format
+PELX_def PELX_type(result) PELX_func(encode_bmp)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t bmp_channels);
+
+// Encodes a PELX file to uncompressed TGA format
+PELX_def PELX_type(result) PELX_func(encode_tga)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t tga_channels);
+
+// Sets up a context allocating through the given callbacks (alloc and free NULL for the C library)
+PELX_def void PELX_func(init_context)(PELX_type(context) *context,
+                                      void *(*alloc)(void *user, size_t size),
+                                      void *(*realloc)(void *user, void *pointer, size_t old_size, size_t new_size),
+                                      void (*free)(void *user, void *pointer), void *user);
+
+// Sets up a context that recycles every block it frees, so that after the first few calls repeated
+// encodes (including the filter and deflate buffers of stb_image_write) make no heap allocations
+PELX_def PELX_type(result) PELX_func(init_pooled_context)(PELX_type(context) *context);
+
+// Releases the scratch memory (and pool) of a context, also needed before resetting an arena the context allocates from
+PELX_def void PELX_func(free_context)(PELX_type(context) *context);
+
+// Versions of the functions above allocating through a context (NULL for the C library), including the buffers of
+// stb_image_write; files and buffers they return belong to the context allocator, files are freed with free_file_context.
+// A context must not be used by two threads at once.
+PELX_def void PELX_func(free_file_context)(PELX_type(context) *context, PELX_type(file) *file);
+
+PELX_def PELX_type(result) PELX_func(to_png_context)(PELX_type(context) *context, PELX_type(file) *pelx_file,
+                                                     uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                     uint8_t png_channels, uint8_t **png_buffer);
+
+PELX_def PELX_type(result) PELX_func(decode_pelx_context)(PELX_type(context) *context, const char *file, PELX_type(file) *output);
+
+PELX_def PELX_type(result) PELX_func(decode_png_context)(PELX_type(context) *context, const char *file,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t png_channels, uint8_t **png_buffer);
+
+PELX_def PELX_type(result) PELX_func(encode_png_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t png_channels);
+
+PELX_def PELX_type(result) PELX_func(encode_png_named_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                               const char *palette_name, uint8_t png_channels);
+
+// Encodes to PNG in memory, *png points into the context and stays valid until its next encode_png_memory_context
+PELX_def PELX_type(result) PELX_func(encode_png_memory_context)(PELX_type(context) *context, PELX_type(file_data) *input_data,
+                                                                uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                                uint8_t png_channels, const uint8_t **png, size_t *png_size);
+
+PELX_def PELX_type(result) PELX_func(add_palette_context)(PELX_type(context) *context, PELX_type(file_data) *pelx_data, const char *name,
+                                                          const PELX_type(palette_entry) *palette_entries);
+
+PELX_def PELX_type(result) PELX_func(encode_qoi_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t qoi_channels);
+
+PELX_def PELX_type(result) PELX_func(encode_bmp_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t bmp_channels);
+
+PELX_def PELX_type(result) PELX_func(encode_tga_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t tga_channels);
+
+// Reads the counters of the last instrumented call that returned on the calling thread
+PELX_def void PELX_func(last_call_stats)(PELX_type(stats) *stats);
+
+// Reads the counters summed over every instrumented call of the process, e.g. for a metrics exporter to poll
+PELX_def void PELX_func(global_stats)(PELX_type(stats) *stats);
+
+// Zeroes the process-wide counters
+PELX_def void PELX_func(reset_global_stats)(void);
+
+// Reports the begin and end of every decode_pelx, to_png, encode, render and PNG write span to callback (NULL to stop),
+// on the thread running the span; nothing is reported unless compiled with PELX_with_tracing
+PELX_def void PELX_func(set_trace_callback)(PELX_type(trace_callback) callback, void *user);
+
+// Writes every span to file as Chrome trace-event JSON until stop_chrome_trace, replacing the trace callback
+PELX_def PELX_type(result) PELX_func(start_chrome_trace)(const char *file);
+
+// Finishes and closes the file of start_chrome_trace
+PELX_def PELX_type(result) PELX_func(stop_chrome_trace)(void);
+
+// Computes the CRC-32 (as used by PNG chunks) of a buffer, continuing from crc (pass 0 to begin)
+PELX_def uint32_t PELX_func(crc32)(uint32_t crc, const uint8_t *data, size_t size);
+
+// Computes the Adler-32 (as used by zlib streams) of a buffer, continuing from adler (pass 1 to begin)
+PELX_def uint32_t PELX_func(adler32)(uint32_t adler, const uint8_t *data, size_t size);
+
 // Implementation
 #if defined (PELX_with_implementation)
 
@@ -231,436 +808,6678 @@ static int PELX_func(read_uint32)(FILE *fp, uint32_t *value)
 	return 0;
 }
 
-// If the following definitions create problems, you can remove them and handle STBIW yourself
-#define STB_IMAGE_WRITE_IMPLEMENTATION 1
-#include "stb_image_write.h"
-#undef STB_IMAGE_WRITE_IMPLEMENTATION
+// Mutexes, statically initialisable so that process-wide state needs no setup call; mutexes in heap or stack
+// objects are set up with PELX_mutex_init (0 on success) and torn down with PELX_mutex_destroy instead
+// One-time initialisation runs a PELX_once_function(name) exactly once, later callers wait for it to finish
+#if defined (_WIN32)
+#if !defined (WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+typedef SRWLOCK PELX_type(mutex);
+#define PELX_mutex_initializer SRWLOCK_INIT
+#define PELX_mutex_lock(m) AcquireSRWLockExclusive(m)
+#define PELX_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#define PELX_mutex_init(m) (InitializeSRWLock(m), 0)
+#define PELX_mutex_destroy(m) ((void)(m)) // SRW locks hold no resources
+typedef INIT_ONCE PELX_type(once);
+#define PELX_once_initializer INIT_ONCE_STATIC_INIT
+#define PELX_once_function(name) BOOL CALLBACK name(PINIT_ONCE once, PVOID parameter, PVOID *context)
+#define PELX_once_result TRUE
+#define PELX_once(o, function) InitOnceExecuteOnce(o, function, NULL, NULL)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t PELX_type(mutex);
+#define PELX_mutex_initializer PTHREAD_MUTEX_INITIALIZER
+#define PELX_mutex_lock(m) pthread_mutex_lock(m)
+#define PELX_mutex_unlock(m) pthread_mutex_unlock(m)
+#define PELX_mutex_init(m) pthread_mutex_init(m, NULL)
+#define PELX_mutex_destroy(m) pthread_mutex_destroy(m)
+typedef pthread_once_t PELX_type(once);
+#define PELX_once_initializer PTHREAD_ONCE_INIT
+#define PELX_once_function(name) void name(void)
+#define PELX_once_result
+#define PELX_once(o, function) pthread_once(o, function)
+#endif
 
-#include <stdio.h>
-#include <stdlib.h>
+// Checksums:
+//     The PNG writer checksums every chunk with CRC-32 and the zlib stream with Adler-32.
+//     Both are computed here and handed to stb_image_write through STBIW_CRC32 and STBIW_ADLER32.
+//     On x86 the SIMD kernels (PCLMULQDQ folding for CRC-32, SSSE3 for Adler-32) are picked at runtime,
+//     on AArch64 the CRC-32 instructions are used when the compiler targets them.
+//     Define PELX_no_simd to always use the scalar code.
 
-PELX_def void PELX_func(free_file)(PELX_type(file) *file)
-{
-	if (file == NULL || *file == NULL)
-	{
-		return;
-	}
+#if !defined (PELX_no_simd) && (defined (__x86_64__) || defined (__i386__)) && (defined (__GNUC__) || defined (__clang__))
+#define PELX_simd_x86 1
+#define PELX_simd_target(t) __attribute__((target(t)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif !defined (PELX_no_simd) && (defined (_M_X64) || defined (_M_IX86)) && defined (_MSC_VER)
+#define PELX_simd_x86 1
+#define PELX_simd_target(t)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 
-	free((*file)->body.data);
-	(*file)->body.data = NULL;
+#if !defined (PELX_no_simd) && defined (__aarch64__) && defined (__ARM_FEATURE_CRC32)
+#define PELX_simd_arm_crc32 1
+#include <arm_acle.h>
+#endif
 
-	free(*file);
-	*file = NULL;
-}
+#define PELX_adler32_base 65521u
+#define PELX_adler32_nmax 5552u
 
-PELX_def PELX_type(result) PELX_func(sanitize_header)(PELX_type(header) *header)
+typedef uint32_t (*PELX_type(checksum_kernel))(uint32_t state, const uint8_t *data, size_t size);
+
+// Slicing-by-8 lookup tables for the reflected polynomial 0xEDB88320, built once by checksum_dispatch
+static uint32_t PELX_func(crc32_table)[8][256];
+
+static void PELX_func(crc32_init_table)(void)
 {
-	if (header == NULL)
+	for (uint32_t n = 0; n < 256; n++)
 	{
-		return PELX_enum(io_error);
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+		{
+			c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+		}
+
+		PELX_func(crc32_table)[0][n] = c;
 	}
 
-	if (memcmp(header->magic, "PELX\0", 5) != 0)
+	for (uint32_t n = 0; n < 256; n++)
 	{
-		return PELX_enum(header_mismatched_magic_number);
+		uint32_t c = PELX_func(crc32_table)[0][n];
+		for (int k = 1; k < 8; k++)
+		{
+			c = PELX_func(crc32_table)[0][c & 0xFF] ^ (c >> 8);
+			PELX_func(crc32_table)[k][n] = c;
+		}
 	}
+}
 
-	const uint16_t width = header->width;
-	const uint16_t height = header->height;
-	const uint8_t true_channels = header->true_channel_count;
-	const uint8_t palette_channels = header->palette_channel_count;
-	const uint16_t palette_count = header->palette_count;
+// Scalar CRC-32 over an already inverted state
+static uint32_t PELX_func(crc32_scalar)(uint32_t crc, const uint8_t *data, size_t size)
+{
+	const uint32_t (*table)[256] = (const uint32_t (*)[256])PELX_func(crc32_table);
 
-	if (width == 0 || height == 0)
+	while (size >= 8)
 	{
-		return PELX_enum(header_invalid_size);
+		uint32_t lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+		uint32_t hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+		      table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+
+		data += 8;
+		size -= 8;
 	}
 
-	if (true_channels != 3 && true_channels != 4)
+	while (size--)
 	{
-		return PELX_enum(header_invalid_true_channels);
+		crc = table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
 	}
 
-	if (palette_channels != 3 && palette_channels != 4)
+	return crc;
+}
+
+#if defined (PELX_simd_arm_crc32)
+// AArch64 CRC-32 over an already inverted state
+static uint32_t PELX_func(crc32_arm)(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size >= 8)
 	{
-		return PELX_enum(header_invalid_palette_channels);
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc = __crc32d(crc, word);
+		data += 8;
+		size -= 8;
 	}
 
-	if (palette_count == 0)
+	while (size--)
 	{
-		return PELX_enum(header_invalid_palette_count);
+		crc = __crc32b(crc, *data++);
 	}
 
-	return PELX_enum(success);
+	return crc;
 }
+#endif // PELX_simd_arm_crc32
 
-PELX_def PELX_type(result) PELX_func(to_png)(PELX_type(file) *pelx_data,
-                                             uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
-                                             uint8_t png_channels, uint8_t **png_buffer)
+#if defined (PELX_simd_x86)
+// CRC-32 by carry-less multiplication folding over an already inverted state,
+// see "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009)
+PELX_simd_target("pclmul,sse4.1")
+static uint32_t PELX_func(crc32_clmul)(uint32_t crc, const uint8_t *data, size_t size)
 {
-	if (pelx_data == NULL || *pelx_data == NULL || palette_entries == NULL || png_buffer == NULL)
-	{
-		return PELX_enum(io_error);
-	}
-	
-	if (png_channels != 3 && png_channels != 4)
+	if (size < 64)
 	{
-		return PELX_enum(invalid_png_channels);
+		return PELX_func(crc32_scalar)(crc, data, size);
 	}
-	
-	PELX_type(result) result = PELX_func(sanitize_header)(&(*pelx_data)->header);
-	if (result != PELX_enum(success))
+
+	// Folding constants x^(4*128+32) mod P, x^(4*128-32) mod P, x^(128+32) mod P, x^(128-32) mod P, x^64 mod P,
+	// followed by the Barrett reduction constants P' and mu, all bit-reflected
+	const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+	const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	__m128i x5;
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+	data += 64;
+	size -= 64;
+
+	// Fold four lanes of 128 bits in parallel
+	while (size >= 64)
 	{
-		return result;
+		__m128i l1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		__m128i l2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i l3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		__m128i l4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, l1), _mm_loadu_si128((const __m128i *)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, l2), _mm_loadu_si128((const __m128i *)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, l3), _mm_loadu_si128((const __m128i *)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, l4), _mm_loadu_si128((const __m128i *)(data + 0x30)));
+
+		data += 64;
+		size -= 64;
 	}
-	
-	const uint16_t width = (*pelx_data)->header.width;
-	const uint16_t height = (*pelx_data)->header.height;
-	const uint8_t true_channels = (*pelx_data)->header.true_channel_count;
-	const uint8_t palette_channels = (*pelx_data)->header.palette_channel_count;
 
-	size_t output_buffer_size = (size_t)width * height * png_channels;
-	
-	*png_buffer = (uint8_t *)malloc(output_buffer_size);
-	if (*png_buffer == NULL)
+	// Fold the four lanes into one
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// Fold the remaining whole 128-bit blocks
+	while (size >= 16)
 	{
-		return PELX_enum(memory_allocation_failed);
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)data)), x5);
+
+		data += 16;
+		size -= 16;
+	}
+
+	// Reduce 128 bits to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+	return PELX_func(crc32_scalar)(crc, data, size);
+}
+#endif // PELX_simd_x86
+
+// Scalar Adler-32, deferring the modulo for as long as the sums cannot overflow
+static uint32_t PELX_func(adler32_scalar)(uint32_t adler, const uint8_t *data, size_t size)
+{
+	uint32_t s1 = adler & 0xFFFF;
+	uint32_t s2 = adler >> 16;
+
+	while (size > 0)
+	{
+		size_t block = size < PELX_adler32_nmax ? size : PELX_adler32_nmax;
+		size -= block;
+
+		while (block >= 8)
+		{
+			s1 += data[0]; s2 += s1;
+			s1 += data[1]; s2 += s1;
+			s1 += data[2]; s2 += s1;
+			s1 += data[3]; s2 += s1;
+			s1 += data[4]; s2 += s1;
+			s1 += data[5]; s2 += s1;
+			s1 += data[6]; s2 += s1;
+			s1 += data[7]; s2 += s1;
+			data += 8;
+			block -= 8;
+		}
+
+		while (block--)
+		{
+			s1 += *data++;
+			s2 += s1;
+		}
+
+		s1 %= PELX_adler32_base;
+		s2 %= PELX_adler32_base;
+	}
+
+	return (s2 << 16) | s1;
+}
+
+#if defined (PELX_simd_x86)
+// Adler-32 over 32-byte blocks with SSSE3 weighted sums
+PELX_simd_target("ssse3")
+static uint32_t PELX_func(adler32_ssse3)(uint32_t adler, const uint8_t *data, size_t size)
+{
+	uint32_t s1 = adler & 0xFFFF;
+	uint32_t s2 = adler >> 16;
+
+	size_t blocks = size / 32;
+	size -= blocks * 32;
+
+	const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+
+	while (blocks > 0)
+	{
+		size_t n = PELX_adler32_nmax / 32;
+		if (n > blocks)
+		{
+			n = blocks;
+		}
+		blocks -= n;
+
+		// v_ps accumulates s1 once per block, it is later scaled by the block size
+		__m128i v_ps = _mm_set_epi32(0, 0, 0, (int)(s1 * n));
+		__m128i v_s2 = _mm_set_epi32(0, 0, 0, (int)s2);
+		__m128i v_s1 = _mm_setzero_si128();
+
+		do
+		{
+			const __m128i bytes1 = _mm_loadu_si128((const __m128i *)(data));
+			const __m128i bytes2 = _mm_loadu_si128((const __m128i *)(data + 16));
+
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+
+			data += 32;
+		} while (--n);
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		// Horizontal sums
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += (uint32_t)_mm_cvtsi128_si32(v_s1);
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s2 = (uint32_t)_mm_cvtsi128_si32(v_s2);
+
+		s1 %= PELX_adler32_base;
+		s2 %= PELX_adler32_base;
+	}
+
+	return PELX_func(adler32_scalar)((s2 << 16) | s1, data, size);
+}
+
+// Queries CPUID leaf 1 and returns ECX
+static uint32_t PELX_func(cpuid_ecx)(void)
+{
+#if defined (_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (uint32_t)info[2];
+#else
+	unsigned int a, b, c, d;
+	if (__get_cpuid(1, &a, &b, &c, &d) == 0)
+	{
+		return 0;
+	}
+	return c;
+#endif
+}
+#endif // PELX_simd_x86
+
+static PELX_type(checksum_kernel) PELX_func(crc32_kernel) = NULL;
+static PELX_type(checksum_kernel) PELX_func(adler32_kernel) = NULL;
+static PELX_type(once) PELX_func(checksum_once) = PELX_once_initializer;
+
+// Builds the CRC-32 tables and picks the fastest checksum kernels supported by the running CPU,
+// run through PELX_once so that the batch and atlas threads never see a half-built table
+static PELX_once_function(PELX_func(checksum_dispatch))
+{
+	PELX_func(crc32_init_table)();
+
+	PELX_type(checksum_kernel) crc32_kernel = PELX_func(crc32_scalar);
+	PELX_type(checksum_kernel) adler32_kernel = PELX_func(adler32_scalar);
+
+#if defined (PELX_simd_arm_crc32)
+	crc32_kernel = PELX_func(crc32_arm);
+#endif // PELX_simd_arm_crc32
+
+#if defined (PELX_simd_x86)
+	const uint32_t ecx = PELX_func(cpuid_ecx)();
+	const int has_pclmul = (ecx >> 1) & 1;
+	const int has_ssse3 = (ecx >> 9) & 1;
+	const int has_sse41 = (ecx >> 19) & 1;
+
+	if (has_pclmul && has_sse41)
+	{
+		crc32_kernel = PELX_func(crc32_clmul);
+	}
+
+	if (has_ssse3)
+	{
+		adler32_kernel = PELX_func(adler32_ssse3);
+	}
+#endif // PELX_simd_x86
+
+	PELX_func(adler32_kernel) = adler32_kernel;
+	PELX_func(crc32_kernel) = crc32_kernel;
+
+	return PELX_once_result;
+}
+
+PELX_def uint32_t PELX_func(crc32)(uint32_t crc, const uint8_t *data, size_t size)
+{
+	PELX_once(&PELX_func(checksum_once), PELX_func(checksum_dispatch));
+
+	if (data == NULL)
+	{
+		return crc;
+	}
+
+	return ~PELX_func(crc32_kernel)(~crc, data, size);
+}
+
+PELX_def uint32_t PELX_func(adler32)(uint32_t adler, const uint8_t *data, size_t size)
+{
+	PELX_once(&PELX_func(checksum_once), PELX_func(checksum_dispatch));
+
+	if (data == NULL)
+	{
+		return adler;
+	}
+
+	return PELX_func(adler32_kernel)(adler, data, size);
+}
+
+#define STBIW_CRC32(buffer, len) PELX_func(crc32)(0, (const uint8_t *)(buffer), (size_t)(len))
+#define STBIW_ADLER32(buffer, len) PELX_func(adler32)(1, (const uint8_t *)(buffer), (size_t)(len))
+
+#if defined (PELX_with_stats)
+static void PELX_func(png_filtered)(void);
+#define STBIW_PNG_FILTERED() PELX_func(png_filtered)()
+#endif
+
+// If the following definitions create problems, you can remove them and handle STBIW yourself
+#define STB_IMAGE_WRITE_IMPLEMENTATION 1
+#if !defined (STBIW_MALLOC)
+static void *PELX_func(writer_alloc)(size_t size);
+static void *PELX_func(writer_realloc)(void *pointer, size_t old_size, size_t new_size);
+static void PELX_func(writer_free)(void *pointer);
+#define STBIW_MALLOC(size) PELX_func(writer_alloc)(size)
+#define STBIW_REALLOC_SIZED(pointer, old_size, new_size) PELX_func(writer_realloc)(pointer, old_size, new_size)
+#define STBIW_FREE(pointer) PELX_func(writer_free)(pointer)
+#endif
+#include "stb_image_write.h"
+#undef STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined (_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+// Threads, workers are declared with PELX_thread_function(name) and return PELX_thread_result
+#if defined (_WIN32)
+typedef HANDLE PELX_type(thread);
+#define PELX_thread_function(name) DWORD WINAPI name(LPVOID argument)
+#define PELX_thread_result 0
+
+static int PELX_func(thread_start)(PELX_type(thread) *thread, LPTHREAD_START_ROUTINE function, void *argument)
+{
+	*thread = CreateThread(NULL, 0, function, argument, 0, NULL);
+	return *thread != NULL ? 0 : -1;
+}
+
+static void PELX_func(thread_join)(PELX_type(thread) thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+static uint32_t PELX_func(cpu_count)(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint32_t)info.dwNumberOfProcessors : 1;
+}
+#else
+typedef pthread_t PELX_type(thread);
+#define PELX_thread_function(name) void *name(void *argument)
+#define PELX_thread_result NULL
+
+static int PELX_func(thread_start)(PELX_type(thread) *thread, void *(*function)(void *), void *argument)
+{
+	return pthread_create(thread, NULL, function, argument) == 0 ? 0 : -1;
+}
+
+static void PELX_func(thread_join)(PELX_type(thread) thread)
+{
+	pthread_join(thread, NULL);
+}
+
+static uint32_t PELX_func(cpu_count)(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+#endif
+
+// Thread-local storage
+#if defined (_MSC_VER)
+#define PELX_thread_local __declspec(thread)
+#else
+#define PELX_thread_local __thread
+#endif
+
+// Instrumentation:
+//     With PELX_with_stats every thread counts into its own PELX_type(stats) from the start of an instrumented call,
+//     and the counters are added to the process-wide sum under a lock when the call returns. Calls nested in
+//     another one (e.g. encode_png_named into encode_png) count as part of the outer call.
+//     Without it the PELX_stats_* macros expand to nothing.
+#if defined (PELX_with_stats) || defined (PELX_with_tracing)
+#if !defined (_WIN32)
+#include <time.h>
+#if !defined (CLOCK_MONOTONIC)
+#error "PELX_with_stats and PELX_with_tracing need clock_gettime, define _POSIX_C_SOURCE as 199309L or later"
+#endif
+#endif
+
+// Monotonic time in nanoseconds
+static uint64_t PELX_func(monotonic_time)(void)
+{
+#if defined (_WIN32)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+#endif
+
+#if defined (PELX_with_stats)
+static PELX_thread_local PELX_type(stats) PELX_func(call_stats);
+static PELX_thread_local uint32_t PELX_func(stats_depth);
+static PELX_thread_local uint64_t PELX_func(stats_split); // see png_to_memory
+
+static struct
+{
+	PELX_type(mutex) mutex;
+	PELX_type(stats) stats;
+} PELX_func(stats_sum) = { PELX_mutex_initializer, { 0 } };
+
+static void PELX_func(stats_begin)(void)
+{
+	if (PELX_func(stats_depth)++ == 0)
+	{
+		memset(&PELX_func(call_stats), 0, sizeof(PELX_type(stats)));
+		PELX_func(call_stats).calls = 1;
+	}
+}
+
+static void PELX_func(stats_end)(void)
+{
+	if (--PELX_func(stats_depth) != 0)
+	{
+		return;
+	}
+
+	const PELX_type(stats) *call = &PELX_func(call_stats);
+	PELX_type(stats) *sum = &PELX_func(stats_sum).stats;
+
+	PELX_mutex_lock(&PELX_func(stats_sum).mutex);
+	sum->calls += call->calls;
+	for (int i = 0; i < PELX_enum(phase_count); i++)
+	{
+		sum->nanoseconds[i] += call->nanoseconds[i];
+	}
+	sum->bytes_in += call->bytes_in;
+	sum->bytes_out += call->bytes_out;
+	for (int i = 0; i < 3; i++)
+	{
+		sum->tags[i] += call->tags[i];
+	}
+	sum->allocations += call->allocations;
+	PELX_mutex_unlock(&PELX_func(stats_sum).mutex);
+}
+
+#define PELX_stats_begin() PELX_func(stats_begin)()
+#define PELX_stats_end() PELX_func(stats_end)()
+#define PELX_stats_add(field, n) (PELX_func(stats_depth) != 0 ? (void)(PELX_func(call_stats).field += (uint64_t)(n)) : (void)0)
+#define PELX_stats_start(name) const uint64_t name = PELX_func(monotonic_time)()
+#define PELX_stats_phase(phase, start) PELX_stats_add(nanoseconds[PELX_enum(phase)], PELX_func(monotonic_time)() - (start))
+#else
+#define PELX_stats_begin() ((void)0)
+#define PELX_stats_end() ((void)0)
+#define PELX_stats_add(field, n) ((void)0)
+#define PELX_stats_start(name) ((void)0)
+#define PELX_stats_phase(phase, start) ((void)0)
+#endif
+
+PELX_def void PELX_func(last_call_stats)(PELX_type(stats) *stats)
+{
+	if (stats == NULL)
+	{
+		return;
+	}
+
+#if defined (PELX_with_stats)
+	*stats = PELX_func(call_stats);
+#else
+	memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+PELX_def void PELX_func(global_stats)(PELX_type(stats) *stats)
+{
+	if (stats == NULL)
+	{
+		return;
+	}
+
+#if defined (PELX_with_stats)
+	PELX_mutex_lock(&PELX_func(stats_sum).mutex);
+	*stats = PELX_func(stats_sum).stats;
+	PELX_mutex_unlock(&PELX_func(stats_sum).mutex);
+#else
+	memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+PELX_def void PELX_func(reset_global_stats)(void)
+{
+#if defined (PELX_with_stats)
+	PELX_mutex_lock(&PELX_func(stats_sum).mutex);
+	memset(&PELX_func(stats_sum).stats, 0, sizeof(PELX_type(stats)));
+	PELX_mutex_unlock(&PELX_func(stats_sum).mutex);
+#endif
+}
+
+// Tracing:
+//     Spans are named by string literals and reported through PELX_trace_begin and PELX_trace_end, which read the
+//     callback under a lock and call it outside of it. The Chrome trace writer is one such callback, appending
+//     "B" and "E" events with microsecond timestamps and small per-thread ids to a JSON array under its own lock.
+//     Without PELX_with_tracing the macros expand to nothing.
+#if defined (PELX_with_tracing)
+#if defined (PELX_with_usdt)
+#include <sys/sdt.h>
+#endif
+
+static struct
+{
+	PELX_type(mutex) mutex;
+	PELX_type(trace_callback) callback;
+	void *user;
+} PELX_func(tracer) = { PELX_mutex_initializer, NULL, NULL };
+
+static struct
+{
+	PELX_type(mutex) mutex;
+	FILE *fp;
+	uint64_t origin; // time of start_chrome_trace
+	uint32_t thread_count;
+	int empty;
+} PELX_func(chrome_trace) = { PELX_mutex_initializer, NULL, 0, 0, 1 };
+
+static PELX_thread_local uint32_t PELX_func(chrome_trace_thread); // 0 until the thread's first event
+
+static void PELX_func(trace)(const char *span, int begin)
+{
+#if defined (PELX_with_usdt)
+	if (begin)
+	{
+		DTRACE_PROBE1(pelx, span_begin, span);
+	}
+	else
+	{
+		DTRACE_PROBE1(pelx, span_end, span);
+	}
+#endif // PELX_with_usdt
+
+	PELX_mutex_lock(&PELX_func(tracer).mutex);
+	PELX_type(trace_callback) callback = PELX_func(tracer).callback;
+	void *user = PELX_func(tracer).user;
+	PELX_mutex_unlock(&PELX_func(tracer).mutex);
+
+	if (callback != NULL)
+	{
+		callback(user, span, begin, PELX_func(monotonic_time)());
+	}
+}
+
+static void PELX_func(chrome_trace_event)(void *user, const char *span, int begin, uint64_t nanoseconds)
+{
+	(void)user;
+
+#if defined (_WIN32)
+	unsigned long process = (unsigned long)GetCurrentProcessId();
+#else
+	unsigned long process = (unsigned long)getpid();
+#endif
+
+	PELX_mutex_lock(&PELX_func(chrome_trace).mutex);
+
+	if (PELX_func(chrome_trace).fp != NULL)
+	{
+		if (PELX_func(chrome_trace_thread) == 0)
+		{
+			PELX_func(chrome_trace_thread) = ++PELX_func(chrome_trace).thread_count;
+		}
+
+		const uint64_t elapsed = nanoseconds > PELX_func(chrome_trace).origin ? nanoseconds - PELX_func(chrome_trace).origin : 0;
+
+		fprintf(PELX_func(chrome_trace).fp, "%s\n{ \"name\": \"%s\", \"cat\": \"pelx\", \"ph\": \"%c\", \"ts\": %llu.%03u, \"pid\": %lu, \"tid\": %lu }",
+		        PELX_func(chrome_trace).empty ? "" : ",", span, begin ? 'B' : 'E',
+		        (unsigned long long)(elapsed / 1000), (unsigned)(elapsed % 1000), process, (unsigned long)PELX_func(chrome_trace_thread));
+		PELX_func(chrome_trace).empty = 0;
+	}
+
+	PELX_mutex_unlock(&PELX_func(chrome_trace).mutex);
+}
+
+#define PELX_trace_begin(span) PELX_func(trace)(span, 1)
+#define PELX_trace_end(span) PELX_func(trace)(span, 0)
+#else
+#define PELX_trace_begin(span) ((void)0)
+#define PELX_trace_end(span) ((void)0)
+#endif
+
+PELX_def void PELX_func(set_trace_callback)(PELX_type(trace_callback) callback, void *user)
+{
+#if defined (PELX_with_tracing)
+	PELX_mutex_lock(&PELX_func(tracer).mutex);
+	PELX_func(tracer).callback = callback;
+	PELX_func(tracer).user = user;
+	PELX_mutex_unlock(&PELX_func(tracer).mutex);
+#else
+	(void)callback;
+	(void)user;
+#endif
+}
+
+PELX_def PELX_type(result) PELX_func(start_chrome_trace)(const char *file)
+{
+#if defined (PELX_with_tracing)
+	if (file == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_func(stop_chrome_trace)();
+
+	FILE *fp = fopen(file, "w");
+	if (fp == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	fputs("[", fp);
+
+	PELX_mutex_lock(&PELX_func(chrome_trace).mutex);
+	PELX_func(chrome_trace).fp = fp;
+	PELX_func(chrome_trace).origin = PELX_func(monotonic_time)();
+	PELX_func(chrome_trace).empty = 1;
+	PELX_mutex_unlock(&PELX_func(chrome_trace).mutex);
+
+	PELX_func(set_trace_callback)(PELX_func(chrome_trace_event), NULL);
+	return PELX_enum(success);
+#else
+	(void)file;
+	return PELX_enum(io_error);
+#endif
+}
+
+PELX_def PELX_type(result) PELX_func(stop_chrome_trace)(void)
+{
+#if defined (PELX_with_tracing)
+	PELX_mutex_lock(&PELX_func(tracer).mutex);
+	if (PELX_func(tracer).callback == PELX_func(chrome_trace_event))
+	{
+		PELX_func(tracer).callback = NULL;
+		PELX_func(tracer).user = NULL;
+	}
+	PELX_mutex_unlock(&PELX_func(tracer).mutex);
+
+	PELX_mutex_lock(&PELX_func(chrome_trace).mutex);
+	FILE *fp = PELX_func(chrome_trace).fp;
+	PELX_func(chrome_trace).fp = NULL;
+	PELX_mutex_unlock(&PELX_func(chrome_trace).mutex);
+
+	if (fp == NULL)
+	{
+		return PELX_enum(success);
+	}
+
+	fputs("\n]\n", fp);
+	return fclose(fp) == 0 ? PELX_enum(success) : PELX_enum(io_error);
+#else
+	return PELX_enum(success);
+#endif
+}
+
+// Allocations, a NULL context uses the C library
+static void *PELX_func(allocate)(PELX_type(context) *context, size_t size)
+{
+	PELX_stats_add(allocations, 1);
+
+	if (context == NULL || context->alloc == NULL)
+	{
+		return malloc(size);
+	}
+
+	return context->alloc(context->user, size);
+}
+
+static void PELX_func(deallocate)(PELX_type(context) *context, void *pointer)
+{
+	if (context == NULL || context->alloc == NULL)
+	{
+		free(pointer);
+	}
+	else if (pointer != NULL && context->free != NULL)
+	{
+		context->free(context->user, pointer);
+	}
+}
+
+static void *PELX_func(reallocate)(PELX_type(context) *context, void *pointer, size_t old_size, size_t new_size)
+{
+	PELX_stats_add(allocations, 1);
+
+	if (context == NULL || context->alloc == NULL)
+	{
+		return realloc(pointer, new_size);
+	}
+
+	if (context->realloc != NULL)
+	{
+		return context->realloc(context->user, pointer, old_size, new_size);
+	}
+
+	void *grown = context->alloc(context->user, new_size);
+	if (grown != NULL && pointer != NULL)
+	{
+		memcpy(grown, pointer, old_size < new_size ? old_size : new_size);
+		PELX_func(deallocate)(context, pointer);
+	}
+
+	return grown;
+}
+
+static void *PELX_func(callocate)(PELX_type(context) *context, size_t count, size_t size)
+{
+	void *pointer = PELX_func(allocate)(context, count * size);
+	if (pointer != NULL)
+	{
+		memset(pointer, 0, count * size);
+	}
+
+	return pointer;
+}
+
+// Grows the scratch memory of a context to at least size bytes
+static uint8_t *PELX_func(scratch)(PELX_type(context) *context, size_t size)
+{
+	if (size > context->scratch_size)
+	{
+		uint8_t *scratch = (uint8_t *)PELX_func(reallocate)(context, context->scratch, context->scratch_size, size);
+		if (scratch == NULL)
+		{
+			return NULL;
+		}
+
+		context->scratch = scratch;
+		context->scratch_size = size;
+	}
+
+	return context->scratch;
+}
+
+// Image writers (and stb_image_write) allocate through the context of the encode running on their thread
+static PELX_thread_local PELX_type(context) *PELX_func(writer_context);
+
+static void *PELX_func(writer_alloc)(size_t size)
+{
+	return PELX_func(allocate)(PELX_func(writer_context), size);
+}
+
+static void *PELX_func(writer_realloc)(void *pointer, size_t old_size, size_t new_size)
+{
+	return PELX_func(reallocate)(PELX_func(writer_context), pointer, old_size, new_size);
+}
+
+static void PELX_func(writer_free)(void *pointer)
+{
+	PELX_func(deallocate)(PELX_func(writer_context), pointer);
+}
+
+PELX_def void PELX_func(init_context)(PELX_type(context) *context,
+                                      void *(*alloc)(void *user, size_t size),
+                                      void *(*realloc)(void *user, void *pointer, size_t old_size, size_t new_size),
+                                      void (*free)(void *user, void *pointer), void *user)
+{
+	if (context == NULL)
+	{
+		return;
+	}
+
+	memset(context, 0, sizeof(*context));
+	context->alloc = alloc;
+	context->realloc = realloc;
+	context->free = free;
+	context->user = user;
+}
+
+// Pooled contexts:
+//     Blocks are rounded up to a power of two and freed blocks are kept on a free list per size, so the
+//     allocation pattern of a repeated encode is served entirely from blocks of the previous ones.
+//     The pool holds on to the peak memory of the calls made through it until free_context.
+
+#define PELX_pool_classes 48
+#define PELX_pool_header 16 // keeps blocks 16 byte aligned
+
+typedef struct
+{
+	void *free_lists[PELX_pool_classes];
+} PELX_type(pool);
+
+static void *PELX_func(pool_alloc)(void *user, size_t size)
+{
+	PELX_type(pool) *pool = (PELX_type(pool) *)user;
+
+	uint32_t size_class = 5;
+	while (size_class < PELX_pool_classes && ((size_t)1 << size_class) < size + PELX_pool_header)
+	{
+		size_class++;
+	}
+
+	if (size_class == PELX_pool_classes)
+	{
+		return NULL;
+	}
+
+	uint8_t *block = (uint8_t *)pool->free_lists[size_class];
+	if (block != NULL)
+	{
+		memcpy(&pool->free_lists[size_class], block + PELX_pool_header, sizeof(void *));
+	}
+	else
+	{
+		block = (uint8_t *)malloc((size_t)1 << size_class);
+		if (block == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	memcpy(block, &size_class, sizeof(size_class));
+	return block + PELX_pool_header;
+}
+
+static void PELX_func(pool_free)(void *user, void *pointer)
+{
+	PELX_type(pool) *pool = (PELX_type(pool) *)user;
+	uint8_t *block = (uint8_t *)pointer - PELX_pool_header;
+
+	uint32_t size_class;
+	memcpy(&size_class, block, sizeof(size_class));
+
+	memcpy(block + PELX_pool_header, &pool->free_lists[size_class], sizeof(void *));
+	pool->free_lists[size_class] = block;
+}
+
+static void *PELX_func(pool_realloc)(void *user, void *pointer, size_t old_size, size_t new_size)
+{
+	if (pointer != NULL)
+	{
+		uint32_t size_class;
+		memcpy(&size_class, (uint8_t *)pointer - PELX_pool_header, sizeof(size_class));
+
+		if (new_size + PELX_pool_header <= ((size_t)1 << size_class))
+		{
+			return pointer;
+		}
+	}
+
+	void *grown = PELX_func(pool_alloc)(user, new_size);
+	if (grown != NULL && pointer != NULL)
+	{
+		memcpy(grown, pointer, old_size < new_size ? old_size : new_size);
+		PELX_func(pool_free)(user, pointer);
+	}
+
+	return grown;
+}
+
+PELX_def PELX_type(result) PELX_func(init_pooled_context)(PELX_type(context) *context)
+{
+	if (context == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(pool) *pool = (PELX_type(pool) *)calloc(1, sizeof(PELX_type(pool)));
+	if (pool == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_func(init_context)(context, PELX_func(pool_alloc), PELX_func(pool_realloc), PELX_func(pool_free), pool);
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(free_context)(PELX_type(context) *context)
+{
+	if (context == NULL)
+	{
+		return;
+	}
+
+	PELX_func(deallocate)(context, context->scratch);
+	PELX_func(deallocate)(context, context->output);
+	context->scratch = NULL;
+	context->scratch_size = 0;
+	context->output = NULL;
+	context->output_size = 0;
+
+	if (context->alloc == PELX_func(pool_alloc))
+	{
+		PELX_type(pool) *pool = (PELX_type(pool) *)context->user;
+
+		for (uint32_t i = 0; i < PELX_pool_classes; i++)
+		{
+			uint8_t *block = (uint8_t *)pool->free_lists[i];
+			while (block != NULL)
+			{
+				uint8_t *next;
+				memcpy(&next, block + PELX_pool_header, sizeof(void *));
+				free(block);
+				block = next;
+			}
+		}
+
+		free(pool);
+		PELX_func(init_context)(context, NULL, NULL, NULL, NULL);
+	}
+}
+
+// 64-bit FNV-1a, continuing from seed (pass PELX_hash_seed to begin)
+#define PELX_hash_seed 0xCBF29CE484222325ull
+
+static uint64_t PELX_func(hash_bytes)(uint64_t seed, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+// 64-bit hash for long inputs such as pixel data, continuing from seed: four independent lanes
+// over 8-byte words (xxHash64 rounds), the tail through hash_bytes, then a final avalanche
+#define PELX_hash_prime_1 0x9E3779B185EBCA87ull
+#define PELX_hash_prime_2 0xC2B2AE3D27D4EB4Full
+
+static uint64_t PELX_func(hash_round)(uint64_t lane, const uint8_t *p)
+{
+	uint64_t word;
+	memcpy(&word, p, 8);
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word); // same hashes on every host
+#endif
+
+	lane += word * PELX_hash_prime_2;
+	lane = (lane << 31) | (lane >> 33);
+	return lane * PELX_hash_prime_1;
+}
+
+static uint64_t PELX_func(hash_words)(uint64_t seed, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t hash = seed ^ ((uint64_t)size * PELX_hash_prime_1);
+
+	if (size >= 32)
+	{
+		uint64_t lane_0 = seed + PELX_hash_prime_1 + PELX_hash_prime_2;
+		uint64_t lane_1 = seed + PELX_hash_prime_2;
+		uint64_t lane_2 = seed;
+		uint64_t lane_3 = seed - PELX_hash_prime_1;
+
+		for (; size >= 32; bytes += 32, size -= 32)
+		{
+			lane_0 = PELX_func(hash_round)(lane_0, bytes);
+			lane_1 = PELX_func(hash_round)(lane_1, bytes + 8);
+			lane_2 = PELX_func(hash_round)(lane_2, bytes + 16);
+			lane_3 = PELX_func(hash_round)(lane_3, bytes + 24);
+		}
+
+		hash ^= ((lane_0 << 1) | (lane_0 >> 63)) + ((lane_1 << 7) | (lane_1 >> 57)) +
+		        ((lane_2 << 12) | (lane_2 >> 52)) + ((lane_3 << 18) | (lane_3 >> 46));
+	}
+
+	for (; size >= 8; bytes += 8, size -= 8)
+	{
+		hash = PELX_func(hash_round)(hash, bytes);
+	}
+
+	hash = PELX_func(hash_bytes)(hash, bytes, size);
+
+	hash ^= hash >> 33;
+	hash *= PELX_hash_prime_2;
+	hash ^= hash >> 29;
+	hash *= PELX_hash_prime_1;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// Rebuilds the name lookup table of the embedded palettes, sized to keep the load factor at or below 1/2
+static PELX_type(result) PELX_func(build_palette_lookup)(PELX_type(context) *context, PELX_type(file_data) *pelx_data)
+{
+	uint32_t lookup_size = 4;
+	while (lookup_size < (uint32_t)pelx_data->palettes.count * 2)
+	{
+		lookup_size <<= 1;
+	}
+
+	uint16_t *lookup = (uint16_t *)PELX_func(callocate)(context, lookup_size, sizeof(uint16_t));
+	if (lookup == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	for (uint16_t i = 0; i < pelx_data->palettes.count; i++)
+	{
+		const char *name = pelx_data->palettes.data[i].name;
+		uint32_t slot = (uint32_t)PELX_func(hash_bytes)(PELX_hash_seed, name, strlen(name)) & (lookup_size - 1);
+
+		while (lookup[slot] != 0)
+		{
+			slot = (slot + 1) & (lookup_size - 1);
+		}
+
+		lookup[slot] = (uint16_t)(i + 1);
+	}
+
+	PELX_func(deallocate)(context, pelx_data->palettes.lookup);
+	pelx_data->palettes.lookup = lookup;
+	pelx_data->palettes.lookup_size = lookup_size;
+
+	return PELX_enum(success);
+}
+
+// Parses the palette definitions block, see "Format of the Palette Definitions"
+static PELX_type(result) PELX_func(parse_palette_block)(PELX_type(context) *context, PELX_type(file_data) *pelx_data,
+                                                        const uint8_t *block, size_t block_size)
+{
+	const uint8_t palette_channels = pelx_data->header.palette_channel_count;
+	const uint16_t palette_count = pelx_data->header.palette_count;
+	size_t pos = 0;
+
+	if (palette_channels != 3 && palette_channels != 4)
+	{
+		return PELX_enum(header_invalid_palette_channels);
+	}
+
+	if (block_size < 2)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint16_t set_count = (uint16_t)(((uint16_t)block[0] << 8) | block[1]);
+	pos += 2;
+
+	for (uint16_t i = 0; i < set_count; i++)
+	{
+		if (pos + 1 > block_size)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		char name[PELX_palette_name_max + 1];
+		const uint8_t name_length = block[pos++];
+
+		if (pos + name_length + (size_t)palette_count * palette_channels > block_size)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		memcpy(name, &block[pos], name_length);
+		name[name_length] = '\0';
+		pos += name_length;
+
+		PELX_type(palette_entry) *entries = (PELX_type(palette_entry) *)PELX_func(allocate)(context, (size_t)palette_count * sizeof(PELX_type(palette_entry)));
+		if (entries == NULL)
+		{
+			return PELX_enum(memory_allocation_failed);
+		}
+
+		for (uint16_t e = 0; e < palette_count; e++)
+		{
+			entries[e].r = block[pos++];
+			entries[e].g = block[pos++];
+			entries[e].b = block[pos++];
+			entries[e].a = palette_channels == 4 ? block[pos++] : 0xFF;
+		}
+
+		PELX_type(result) result = PELX_func(add_palette_context)(context, pelx_data, name, entries);
+		PELX_func(deallocate)(context, entries);
+
+		if (result != PELX_enum(success))
+		{
+			return result;
+		}
+	}
+
+	return PELX_enum(success);
+}
+
+// Size of the palette definitions block as written by encode_pelx (0 without embedded palettes)
+static size_t PELX_func(palette_block_size)(const PELX_type(file_data) *pelx_data)
+{
+	if (pelx_data->palettes.count == 0)
+	{
+		return 0;
+	}
+
+	size_t size = 2;
+	for (uint16_t i = 0; i < pelx_data->palettes.count; i++)
+	{
+		size += 1 + strlen(pelx_data->palettes.data[i].name);
+		size += (size_t)pelx_data->header.palette_count * pelx_data->header.palette_channel_count;
+	}
+
+	return size;
+}
+
+PELX_def void PELX_func(free_file)(PELX_type(file) *file)
+{
+	PELX_func(free_file_context)(NULL, file);
+}
+
+PELX_def void PELX_func(free_file_context)(PELX_type(context) *context, PELX_type(file) *file)
+{
+	if (file == NULL || *file == NULL)
+	{
+		return;
+	}
+
+	const int view = ((*file)->flags & PELX_file_view) != 0;
+
+	if (!view)
+	{
+		PELX_func(deallocate)(context, (*file)->body.data);
+	}
+
+	(*file)->body.data = NULL;
+
+	for (uint16_t i = 0; i < (*file)->palettes.count; i++)
+	{
+		PELX_func(deallocate)(context, (*file)->palettes.data[i].entries);
+	}
+
+	PELX_func(deallocate)(context, (*file)->palettes.data);
+	PELX_func(deallocate)(context, (*file)->palettes.lookup);
+	memset(&(*file)->palettes, 0, sizeof((*file)->palettes));
+
+	if (!view)
+	{
+		PELX_func(deallocate)(context, *file);
+	}
+
+	*file = NULL;
+}
+
+PELX_def PELX_type(result) PELX_func(init_view)(PELX_type(file_data) *view, const PELX_type(header) *header,
+                                                const uint8_t *body, uint32_t body_size)
+{
+	if (view == NULL || header == NULL || (body == NULL && body_size > 0))
+	{
+		return PELX_enum(io_error);
+	}
+
+	memset(view, 0, sizeof(*view));
+	view->header = *header;
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&view->header);
+	if (result != PELX_enum(success))
+	{
+		memset(view, 0, sizeof(*view));
+		return result;
+	}
+
+	view->body.data = (uint8_t *)body; // never written through
+	view->body.size = body_size;
+	view->flags = PELX_file_view;
+
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(sanitize_header)(PELX_type(header) *header)
+{
+	if (header == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (memcmp(header->magic, "PELX\0", 5) != 0)
+	{
+		return PELX_enum(header_mismatched_magic_number);
+	}
+
+	const uint16_t width = header->width;
+	const uint16_t height = header->height;
+	const uint8_t true_channels = header->true_channel_count;
+	const uint8_t palette_channels = header->palette_channel_count;
+	const uint16_t palette_count = header->palette_count;
+
+	if (width == 0 || height == 0)
+	{
+		return PELX_enum(header_invalid_size);
+	}
+
+	if (true_channels != 3 && true_channels != 4)
+	{
+		return PELX_enum(header_invalid_true_channels);
+	}
+
+	if (palette_channels != 3 && palette_channels != 4)
+	{
+		return PELX_enum(header_invalid_palette_channels);
+	}
+
+	if (palette_count == 0)
+	{
+		return PELX_enum(header_invalid_palette_count);
+	}
+
+	return PELX_enum(success);
+}
+
+// Resolves palette entries into an RGBA lookup table, alpha is forced opaque for 3 channel palettes
+static void PELX_func(resolve_palette)(const PELX_type(palette_entry) *palette_entries, uint16_t palette_count,
+                                       uint8_t palette_channels, uint8_t lut[256][4])
+{
+	const uint16_t count = palette_count < 256 ? palette_count : 256;
+
+	for (uint16_t i = 0; i < count; i++)
+	{
+		lut[i][0] = palette_entries[i].r;
+		lut[i][1] = palette_entries[i].g;
+		lut[i][2] = palette_entries[i].b;
+		lut[i][3] = palette_channels == 4 ? palette_entries[i].a : 0xFF;
+	}
+}
+
+// Decodes the tagged pixel at src[*src_pos] (which must be in range) into out, advancing *src_pos
+static PELX_type(result) PELX_func(decode_pixel)(const uint8_t *src, size_t src_size, size_t *src_pos,
+                                                 uint8_t true_channels, const uint8_t (*lut)[4], uint16_t lut_count,
+                                                 uint8_t png_channels, uint8_t *out)
+{
+	size_t pos = *src_pos;
+	uint8_t tag = src[pos++];
+
+	if (tag == PELX_tag_void)
+	{
+		PELX_stats_add(tags[PELX_tag_void], 1);
+		memset(out, 0x00, png_channels);
+	}
+	else if (tag == PELX_tag_true)
+	{
+		if (pos + true_channels > src_size)
+		{
+			return PELX_enum(io_error);
+		}
+
+		PELX_stats_add(tags[PELX_tag_true], 1);
+		out[0] = src[pos + 0]; // R
+		out[1] = src[pos + 1]; // G
+		out[2] = src[pos + 2]; // B
+
+		if (png_channels == 4)
+		{
+			out[3] = true_channels == 4 ? src[pos + 3] : 0xFF; // A
+		}
+
+		pos += true_channels;
+	}
+	else if (tag == PELX_tag_pale)
+	{
+		if (pos + 1 > src_size)
+		{
+			return PELX_enum(io_error);
+		}
+
+		uint8_t palette_index = src[pos++];
+		if (palette_index >= lut_count)
+		{
+			return PELX_enum(io_error);
+		}
+
+		PELX_stats_add(tags[PELX_tag_pale], 1);
+		memcpy(out, lut[palette_index], png_channels);
+	}
+	else
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	*src_pos = pos;
+	return PELX_enum(success);
+}
+
+// Expands the pixel data into rows of width * png_channels bytes, out_stride bytes apart,
+// resolving palette indices through lut
+static PELX_type(result) PELX_func(expand_pixels)(const PELX_type(file_data) *pelx_data,
+                                                  const uint8_t (*lut)[4], uint16_t lut_count,
+                                                  uint8_t png_channels, uint8_t *out, size_t out_stride)
+{
+	const uint8_t true_channels = pelx_data->header.true_channel_count;
+	const uint16_t height = pelx_data->header.height;
+	const size_t row_size = (size_t)pelx_data->header.width * png_channels;
+
+	const uint8_t *src = pelx_data->body.data;
+	size_t src_pos = 0;
+	size_t src_size = pelx_data->body.size;
+
+	for (uint16_t y = 0; y < height; y++)
+	{
+		uint8_t *row = out + (size_t)y * out_stride;
+
+		for (size_t x = 0; x < row_size; x += png_channels)
+		{
+			if (src_pos >= src_size)
+			{
+			#if defined (PELX_error_output)
+				fprintf(stderr, "Mismatch: expected %zu bytes, but wrote %zu\n", row_size * height, row_size * y + x);
+			#endif // PELX_error_output
+				return PELX_enum(invalid_data_format);
+			}
+
+			PELX_type(result) result = PELX_func(decode_pixel)(src, src_size, &src_pos, true_channels, lut, lut_count, png_channels, &row[x]);
+			if (result != PELX_enum(success))
+			{
+				return result;
+			}
+		}
+	}
+
+	return PELX_enum(success);
+}
+
+// Allocates and expands an image, *png_buffer is NULL on failure
+static PELX_type(result) PELX_func(render)(PELX_type(context) *context, const PELX_type(file_data) *pelx_data,
+                                           const uint8_t (*lut)[4], uint16_t lut_count,
+                                           uint8_t png_channels, uint8_t **png_buffer)
+{
+	*png_buffer = NULL;
+
+	// Animations are played through open_animation
+	if (pelx_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	size_t output_buffer_size = (size_t)pelx_data->header.width * pelx_data->header.height * png_channels;
+
+	*png_buffer = (uint8_t *)PELX_func(allocate)(context, output_buffer_size);
+	if (*png_buffer == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_trace_begin("render");
+	PELX_stats_start(decode_start);
+	PELX_type(result) result = PELX_func(expand_pixels)(pelx_data, lut, lut_count, png_channels, *png_buffer,
+	                                                     (size_t)pelx_data->header.width * png_channels);
+	PELX_stats_phase(phase_decode, decode_start);
+	PELX_trace_end("render");
+
+	if (result != PELX_enum(success))
+	{
+		PELX_func(deallocate)(context, *png_buffer);
+		*png_buffer = NULL;
+	}
+
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(to_png)(PELX_type(file) *pelx_data,
+                                             uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                             uint8_t png_channels, uint8_t **png_buffer)
+{
+	return PELX_func(to_png_context)(NULL, pelx_data, palette_count, palette_entries, png_channels, png_buffer);
+}
+
+PELX_def PELX_type(result) PELX_func(to_png_context)(PELX_type(context) *context, PELX_type(file) *pelx_data,
+                                                     uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                     uint8_t png_channels, uint8_t **png_buffer)
+{
+	if (pelx_data == NULL || *pelx_data == NULL || palette_entries == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+	
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_trace_begin("to_png");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&(*pelx_data)->header);
+	if (result == PELX_enum(success))
+	{
+		uint8_t lut[256][4];
+		PELX_func(resolve_palette)(palette_entries, palette_count, (*pelx_data)->header.palette_channel_count, lut);
+		PELX_stats_phase(phase_parse, parse_start);
+
+		result = PELX_func(render)(context, *pelx_data, (const uint8_t (*)[4])lut, palette_count, png_channels, png_buffer);
+		if (result == PELX_enum(success))
+		{
+			PELX_stats_add(bytes_in, (*pelx_data)->body.size);
+			PELX_stats_add(bytes_out, (size_t)(*pelx_data)->header.width * (*pelx_data)->header.height * png_channels);
+		}
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("to_png");
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(decode_pelx)(const char *file, PELX_type(file) *pelx)
+{
+	return PELX_func(decode_pelx_context)(NULL, file, pelx);
+}
+
+PELX_def PELX_type(result) PELX_func(decode_pelx_context)(PELX_type(context) *context, const char *file, PELX_type(file) *pelx)
+{
+	PELX_trace_begin("decode_pelx");
+	PELX_stats_begin();
+	PELX_stats_start(open_start);
+
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL || pelx == NULL)
+	{
+		PELX_stats_end();
+		PELX_trace_end("decode_pelx");
+		return PELX_enum(io_error);
+	}
+
+	PELX_stats_phase(phase_read, open_start);
+
+	PELX_type(file_data) *pelx_file = (PELX_type(file_data) *)PELX_func(allocate)(context, sizeof(PELX_type(file_data)));
+	if (pelx_file == NULL)
+	{
+		fclose(fp);
+		PELX_stats_end();
+		PELX_trace_end("decode_pelx");
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_stats_start(parse_start);
+
+	memset(pelx_file, 0, sizeof(PELX_type(file_data)));
+
+	// Read magic PELX\0 (5 bytes)
+	if (fread(pelx_file->header.magic, 1, 5, fp) != 5)
+	{
+		goto return_failure;
+	}
+
+	// Read header size: 4 bytes
+	if (PELX_func(read_uint32)(fp, &pelx_file->header.header_size) < 0)
+	{
+		goto return_failure;
+	}
+
+	// Read palette offset: 4 bytes
+	if (PELX_func(read_uint32)(fp, &pelx_file->header.palette_offset) < 0)
+	{
+		goto return_failure;
+	}
+	
+	// Read width: 2 bytes
+	if (PELX_func(read_uint16)(fp, &pelx_file->header.width) < 0)
+	{
+		goto return_failure;
+	}
+
+	// Read height: 2 bytes
+	if (PELX_func(read_uint16)(fp, &pelx_file->header.height) < 0)
+	{
+		goto return_failure;
+	}
+	
+	// Read palette channels: 1 byte
+	if (PELX_func(read_uint8)(fp, &pelx_file->header.palette_channel_count) < 0)
+	{
+		goto return_failure;
+	}
+
+	// Read true channels: 1 byte
+	if (PELX_func(read_uint8)(fp, &pelx_file->header.true_channel_count) < 0)
+	{
+		goto return_failure;
+	}
+	
+	// Read palette count: 1 byte
+	if (PELX_func(read_uint16)(fp, &pelx_file->header.palette_count) < 0)
+	{
+		goto return_failure;
+	}
+
+	// Read reserved: 5 bytes
+	if (fread(pelx_file->header.reserved, 1, 5, fp) != 5)
+	{
+		goto return_failure;
+	}
+
+	if (fseek(fp, 0, SEEK_END) != 0)
+	{
+		goto return_failure;
+	}
+
+	long file_size = ftell(fp);
+	if (file_size < 0 || pelx_file->header.header_size > (uint32_t)file_size)
+	{
+		goto return_failure;
+	}
+
+	// Read the palette definitions block, if any
+	if (pelx_file->header.palette_offset >= PELX_header_disk_size &&
+	    pelx_file->header.palette_offset < pelx_file->header.header_size)
+	{
+		size_t block_size = pelx_file->header.header_size - pelx_file->header.palette_offset;
+		uint8_t *block = (uint8_t *)PELX_func(allocate)(context, block_size);
+		if (block == NULL)
+		{
+			goto return_failure;
+		}
+
+		if (fseek(fp, pelx_file->header.palette_offset, SEEK_SET) != 0 || fread(block, 1, block_size, fp) != block_size ||
+		    PELX_func(parse_palette_block)(context, pelx_file, block, block_size) != PELX_enum(success))
+		{
+			PELX_func(deallocate)(context, block);
+			goto return_failure;
+		}
+
+		PELX_func(deallocate)(context, block);
+	}
+
+	PELX_stats_phase(phase_parse, parse_start);
+	PELX_stats_start(read_start);
+
+	size_t raw_data_size = (size_t)file_size - pelx_file->header.header_size;
+	if (raw_data_size > UINT32_MAX)
+	{
+		goto return_failure;
+	}
+
+	pelx_file->body.data = (uint8_t *)PELX_func(allocate)(context, raw_data_size);
+	if (pelx_file->body.data == NULL)
+	{
+		goto return_failure;
+	}
+
+	pelx_file->body.size = (uint32_t)raw_data_size;
+
+	if (fseek(fp, pelx_file->header.header_size, SEEK_SET) != 0)
+	{
+		goto return_failure;
+	}
+
+	// Read body data
+	if (fread(pelx_file->body.data, 1, raw_data_size, fp) != raw_data_size)
+	{
+		goto return_failure;
+	}
+
+	fclose(fp);
+	PELX_stats_phase(phase_read, read_start);
+	PELX_stats_add(bytes_in, file_size);
+	PELX_stats_end();
+	PELX_trace_end("decode_pelx");
+
+	*pelx = pelx_file;
+	return PELX_enum(success);
+
+return_failure:
+	PELX_func(free_file_context)(context, &pelx_file);
+	fclose(fp);
+	PELX_stats_end();
+	PELX_trace_end("decode_pelx");
+	return PELX_enum(invalid_data_format);
+}
+
+PELX_def PELX_type(result) PELX_func(decode_png)(const char *file,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t png_channels, uint8_t **png_buffer)
+{
+	return PELX_func(decode_png_context)(NULL, file, palette_count, palette_entries, png_channels, png_buffer);
+}
+
+PELX_def PELX_type(result) PELX_func(decode_png_context)(PELX_type(context) *context, const char *file,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t png_channels, uint8_t **png_buffer)
+{
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_type(file) pelx_file = NULL;
+
+	PELX_type(result) result = PELX_func(decode_pelx_context)(context, file, &pelx_file);
+	if (result != PELX_enum(success))
+	{
+		return result;
 	}
 	
-	uint8_t *src = (*pelx_data)->body.data;
-	size_t src_pos = 0;
-	size_t src_size = (*pelx_data)->body.size;
-	
-	uint8_t *out_ptr = *png_buffer;
-	size_t out_pos = 0;
-	
-	while (out_pos < output_buffer_size && src_pos < src_size)
+	result = PELX_func(to_png_context)(context, &pelx_file, palette_count, palette_entries, png_channels, png_buffer);
+
+	PELX_func(free_file_context)(context, &pelx_file);
+	return result;
+}
+
+// Size of a PELX file as written by encode_pelx
+static size_t PELX_func(pelx_disk_size)(const PELX_type(file_data) *input_data)
+{
+	return PELX_header_disk_size + PELX_func(palette_block_size)(input_data) + input_data->body.size;
+}
+
+// Writes a PELX file at the current position of fp
+static PELX_type(result) PELX_func(write_pelx)(FILE *fp, const PELX_type(file_data) *input_data)
+{
+	// Write magic (5 bytes)
+	if (fwrite(input_data->header.magic, 1, 5, fp) != 5)
+	{
+		return PELX_enum(io_error);
+	}
+
+	// The palette definitions block always directly follows the header
+	const size_t palette_block_size = PELX_func(palette_block_size)(input_data);
+
+	PELX_func(write_uint32)(fp, (uint32_t)(PELX_header_disk_size + palette_block_size));
+	PELX_func(write_uint32)(fp, PELX_header_disk_size);
+
+	PELX_func(write_uint16)(fp, input_data->header.width);
+	PELX_func(write_uint16)(fp, input_data->header.height);
+
+	PELX_func(write_uint8)(fp, input_data->header.palette_channel_count);
+	PELX_func(write_uint8)(fp, input_data->header.true_channel_count);
+
+	PELX_func(write_uint16)(fp, input_data->header.palette_count);
+
+	if (fwrite(input_data->header.reserved, 1, 5, fp) != 5)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (palette_block_size > 0)
+	{
+		PELX_func(write_uint16)(fp, input_data->palettes.count);
+
+		for (uint16_t i = 0; i < input_data->palettes.count; i++)
+		{
+			const PELX_type(palette) *palette = &input_data->palettes.data[i];
+			const uint8_t name_length = (uint8_t)strlen(palette->name);
+
+			PELX_func(write_uint8)(fp, name_length);
+			fwrite(palette->name, 1, name_length, fp);
+
+			for (uint16_t e = 0; e < input_data->header.palette_count; e++)
+			{
+				const PELX_type(palette_entry) *entry = &palette->entries[e];
+				uint8_t channels[4] = { entry->r, entry->g, entry->b, entry->a };
+
+				if (fwrite(channels, 1, input_data->header.palette_channel_count, fp) != input_data->header.palette_channel_count)
+				{
+					return PELX_enum(io_error);
+				}
+			}
+		}
+	}
+
+	if (fwrite(input_data->body.data, 1, input_data->body.size, fp) != input_data->body.size)
+	{
+		return PELX_enum(io_error);
+	}
+
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_pelx)(const char *file, PELX_type(file_data) *input_data)
+{
+	if (file == NULL || input_data == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(result) result = PELX_func(write_pelx)(fp, input_data);
+
+	if (fclose(fp) != 0 && result == PELX_enum(success))
+	{
+		result = PELX_enum(io_error);
+	}
+
+	return result;
+}
+
+// Writes an expanded image to a file, returns 0 on failure (same convention as stb_image_write)
+typedef int (*PELX_type(image_writer))(const char *file, int width, int height, int channels, const uint8_t *data);
+
+#if defined (PELX_with_stats)
+// Called by stb_image_write between filtering and compression, marks the split of a png_to_memory
+static void PELX_func(png_filtered)(void)
+{
+	if (PELX_func(stats_split) == 1)
+	{
+		PELX_func(stats_split) = PELX_func(monotonic_time)();
+	}
+}
+#endif
+
+// Encodes a PNG in memory (free it with STBIW_FREE), timing the filters and the compression apart
+// through the STBIW_PNG_FILTERED hook
+static uint8_t *PELX_func(png_to_memory)(int width, int height, int channels, const uint8_t *data, int *length)
+{
+#if defined (PELX_with_stats)
+	const uint64_t start = PELX_func(monotonic_time)();
+	PELX_func(stats_split) = 1;
+#endif
+
+	PELX_trace_begin("stbi_write_png");
+	uint8_t *png = stbi_write_png_to_mem(data, width * channels, width, height, channels, length);
+	PELX_trace_end("stbi_write_png");
+
+#if defined (PELX_with_stats)
+	const uint64_t end = PELX_func(monotonic_time)();
+	const uint64_t split = PELX_func(stats_split);
+	PELX_func(stats_split) = 0;
+
+	if (split > 1) // with a stb_image_write lacking the hook it is all counted as compression
+	{
+		PELX_stats_add(nanoseconds[PELX_enum(phase_filter)], split - start);
+		PELX_stats_add(nanoseconds[PELX_enum(phase_deflate)], end - split);
+	}
+	else
+	{
+		PELX_stats_add(nanoseconds[PELX_enum(phase_deflate)], end - start);
+	}
+#endif
+
+	return png;
+}
+
+static int PELX_func(write_png_image)(const char *file, int width, int height, int channels, const uint8_t *data)
+{
+	int length = 0;
+	uint8_t *png = PELX_func(png_to_memory)(width, height, channels, data, &length);
+	if (png == NULL)
+	{
+		return 0;
+	}
+
+	PELX_stats_start(write_start);
+
+	FILE *fp = fopen(file, "wb");
+	int write_success = fp != NULL && fwrite(png, 1, (size_t)length, fp) == (size_t)length;
+	if (fp != NULL)
+	{
+		write_success &= fclose(fp) == 0;
+	}
+
+	PELX_stats_phase(phase_write, write_start);
+
+	STBIW_FREE(png);
+	return write_success;
+}
+
+static int PELX_func(write_bmp_image)(const char *file, int width, int height, int channels, const uint8_t *data)
+{
+	PELX_stats_start(write_start);
+	int write_success = stbi_write_bmp(file, width, height, channels, data);
+	PELX_stats_phase(phase_write, write_start);
+
+	return write_success;
+}
+
+// Writes an uncompressed TGA image: an 18 byte header, then BGR(A) rows from the bottom up, the same bytes
+// stbi_write_tga produces without RLE (written here so stb_image_write's global RLE switch is never touched)
+static int PELX_func(write_tga_image)(const char *file, int width, int height, int channels, const uint8_t *data)
+{
+	if (width > 0xFFFF || height > 0xFFFF)
+	{
+		return 0;
+	}
+
+	PELX_stats_start(write_start);
+
+	const size_t row_size = (size_t)width * channels;
+	const int has_alpha = channels == 4;
+
+	uint8_t *out = (uint8_t *)PELX_func(writer_alloc)(18 + row_size * height);
+	if (out == NULL)
+	{
+		return 0;
+	}
+
+	memset(out, 0, 18);
+	out[2] = 2; // uncompressed true colour
+	out[12] = (uint8_t)width;
+	out[13] = (uint8_t)(width >> 8);
+	out[14] = (uint8_t)height;
+	out[15] = (uint8_t)(height >> 8);
+	out[16] = (uint8_t)(channels * 8);
+	out[17] = (uint8_t)(has_alpha * 8); // alpha bits, origin at the bottom left
+
+	uint8_t *dst = out + 18;
+	for (int y = height - 1; y >= 0; y--)
+	{
+		const uint8_t *src = data + (size_t)y * row_size;
+		for (int x = 0; x < width; x++, src += channels, dst += channels)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			if (has_alpha)
+			{
+				dst[3] = src[3];
+			}
+		}
+	}
+
+	const size_t size = 18 + row_size * height;
+
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+	{
+		PELX_func(writer_free)(out);
+		return 0;
+	}
+
+	int write_success = fwrite(out, 1, size, fp) == size;
+	write_success &= fclose(fp) == 0;
+
+	PELX_func(writer_free)(out);
+	PELX_stats_phase(phase_write, write_start);
+
+	return write_success;
+}
+
+#define PELX_qoi_op_index 0x00
+#define PELX_qoi_op_diff  0x40
+#define PELX_qoi_op_luma  0x80
+#define PELX_qoi_op_run   0xC0
+#define PELX_qoi_op_rgb   0xFE
+#define PELX_qoi_op_rgba  0xFF
+
+// Writes a QOI image (https://qoiformat.org/qoi-specification.pdf)
+static int PELX_func(write_qoi_image)(const char *file, int width, int height, int channels, const uint8_t *data)
+{
+	PELX_stats_start(write_start);
+
+	const size_t pixel_count = (size_t)width * height;
+
+	// Worst case is one RGBA op per pixel, plus the 14 byte header and 8 byte end marker
+	uint8_t *out = (uint8_t *)PELX_func(writer_alloc)(14 + pixel_count * 5 + 8);
+	if (out == NULL)
+	{
+		return 0;
+	}
+
+	size_t out_pos = 0;
+
+	memcpy(out, "qoif", 4);
+	out[4] = (uint8_t)(width >> 24);
+	out[5] = (uint8_t)(width >> 16);
+	out[6] = (uint8_t)(width >> 8);
+	out[7] = (uint8_t)width;
+	out[8] = (uint8_t)(height >> 24);
+	out[9] = (uint8_t)(height >> 16);
+	out[10] = (uint8_t)(height >> 8);
+	out[11] = (uint8_t)height;
+	out[12] = (uint8_t)channels;
+	out[13] = 0; // sRGB with linear alpha
+	out_pos = 14;
+
+	uint8_t index[64][4];
+	memset(index, 0, sizeof(index));
+
+	uint8_t prev[4] = { 0x00, 0x00, 0x00, 0xFF };
+	uint8_t run = 0;
+
+	for (size_t i = 0; i < pixel_count; i++)
+	{
+		const uint8_t *src = &data[i * channels];
+		uint8_t px[4] = { src[0], src[1], src[2], channels == 4 ? src[3] : 0xFF };
+
+		if (memcmp(px, prev, 4) == 0)
+		{
+			run++;
+			if (run == 62 || i + 1 == pixel_count)
+			{
+				out[out_pos++] = PELX_qoi_op_run | (run - 1);
+				run = 0;
+			}
+			continue;
+		}
+
+		if (run > 0)
+		{
+			out[out_pos++] = PELX_qoi_op_run | (run - 1);
+			run = 0;
+		}
+
+		const uint8_t hash = (uint8_t)((px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64);
+
+		if (memcmp(index[hash], px, 4) == 0)
+		{
+			out[out_pos++] = PELX_qoi_op_index | hash;
+		}
+		else
+		{
+			memcpy(index[hash], px, 4);
+
+			if (px[3] == prev[3])
+			{
+				const int8_t vr = (int8_t)(px[0] - prev[0]);
+				const int8_t vg = (int8_t)(px[1] - prev[1]);
+				const int8_t vb = (int8_t)(px[2] - prev[2]);
+				const int8_t vg_r = (int8_t)(vr - vg);
+				const int8_t vg_b = (int8_t)(vb - vg);
+
+				if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+				{
+					out[out_pos++] = (uint8_t)(PELX_qoi_op_diff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+				}
+				else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+				{
+					out[out_pos++] = (uint8_t)(PELX_qoi_op_luma | (vg + 32));
+					out[out_pos++] = (uint8_t)((vg_r + 8) << 4 | (vg_b + 8));
+				}
+				else
+				{
+					out[out_pos++] = PELX_qoi_op_rgb;
+					out[out_pos++] = px[0];
+					out[out_pos++] = px[1];
+					out[out_pos++] = px[2];
+				}
+			}
+			else
+			{
+				out[out_pos++] = PELX_qoi_op_rgba;
+				out[out_pos++] = px[0];
+				out[out_pos++] = px[1];
+				out[out_pos++] = px[2];
+				out[out_pos++] = px[3];
+			}
+		}
+
+		memcpy(prev, px, 4);
+	}
+
+	static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(&out[out_pos], end_marker, 8);
+	out_pos += 8;
+
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+	{
+		PELX_func(writer_free)(out);
+		return 0;
+	}
+
+	int write_success = fwrite(out, 1, out_pos, fp) == out_pos;
+	write_success &= fclose(fp) == 0;
+
+	PELX_func(writer_free)(out);
+	PELX_stats_phase(phase_write, write_start);
+
+	return write_success;
+}
+
+// Disk cache:
+//     Encoded files are stored under the hex SHA-256 digest of everything that determines their bytes
+//     (header fields, pixel data, resolved palette, channels, format and writer settings). The digest is
+//     collision resistant, so a hit never hands out the file of other (or crafted) inputs without any
+//     need to store and compare the inputs themselves. A repeated encode is therefore a lookup
+//     plus a hard link (or a copy across devices) to the requested path. Files are published by renaming
+//     a private temporary file, so concurrent encoders and processes never see partial files.
+//     Hits refresh the modification time, and eviction removes the least recently used files first.
+
+#define PELX_disk_cache_path_max 4096
+#define PELX_disk_cache_key_length 64
+#define PELX_disk_cache_name_max 128
+
+// Caches before version 3 named files by a 64-bit hash (16 hex digits), the eviction scan removes them
+#define PELX_disk_cache_legacy_key_length 16
+
+// Part of every key, bump it whenever unchanged inputs encode to different files (a stb_image_write update, ...)
+#define PELX_disk_cache_version 3
+
+// SHA-256 (FIPS 180-4), streamed so that the key parts need not be copied together
+typedef struct
+{
+	uint32_t state[8];
+	uint64_t size;
+	uint8_t block[64];
+} PELX_type(sha256);
+
+static const uint32_t PELX_func(sha256_constants)[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static void PELX_func(sha256_init)(PELX_type(sha256) *sha)
+{
+	static const uint32_t initial[8] =
+	{
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+	};
+
+	memcpy(sha->state, initial, sizeof(initial));
+	sha->size = 0;
+}
+
+#define PELX_sha256_rotate(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void PELX_func(sha256_block)(uint32_t state[8], const uint8_t *block)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+	}
+
+	for (int i = 16; i < 64; i++)
+	{
+		const uint32_t s0 = PELX_sha256_rotate(w[i - 15], 7) ^ PELX_sha256_rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const uint32_t s1 = PELX_sha256_rotate(w[i - 2], 17) ^ PELX_sha256_rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < 64; i++)
+	{
+		const uint32_t t1 = h + (PELX_sha256_rotate(e, 6) ^ PELX_sha256_rotate(e, 11) ^ PELX_sha256_rotate(e, 25)) +
+		                    ((e & f) ^ (~e & g)) + PELX_func(sha256_constants)[i] + w[i];
+		const uint32_t t2 = (PELX_sha256_rotate(a, 2) ^ PELX_sha256_rotate(a, 13) ^ PELX_sha256_rotate(a, 22)) +
+		                    ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void PELX_func(sha256_update)(PELX_type(sha256) *sha, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	size_t fill = (size_t)(sha->size & 63);
+	sha->size += size;
+
+	if (fill > 0)
+	{
+		const size_t take = size < 64 - fill ? size : 64 - fill;
+		memcpy(sha->block + fill, bytes, take);
+		bytes += take;
+		size -= take;
+
+		if (fill + take < 64)
+		{
+			return;
+		}
+
+		PELX_func(sha256_block)(sha->state, sha->block);
+	}
+
+	for (; size >= 64; bytes += 64, size -= 64)
+	{
+		PELX_func(sha256_block)(sha->state, bytes);
+	}
+
+	memcpy(sha->block, bytes, size);
+}
+
+// Finishes the digest as lower case hex digits, hex needs room for 65 characters
+static void PELX_func(sha256_hex)(PELX_type(sha256) *sha, char *hex)
+{
+	const uint64_t bits = sha->size * 8;
+	size_t fill = (size_t)(sha->size & 63);
+
+	sha->block[fill++] = 0x80;
+	if (fill > 56)
+	{
+		memset(sha->block + fill, 0, 64 - fill);
+		PELX_func(sha256_block)(sha->state, sha->block);
+		fill = 0;
+	}
+
+	memset(sha->block + fill, 0, 56 - fill);
+	for (int i = 0; i < 8; i++)
+	{
+		sha->block[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+	}
+
+	PELX_func(sha256_block)(sha->state, sha->block);
+
+	for (int i = 0; i < 8; i++)
+	{
+		snprintf(hex + i * 8, 9, "%08x", (unsigned int)sha->state[i]);
+	}
+}
+
+// Eviction goes down to this share of max_bytes, so that a full cache is not rescanned on every publish
+#define PELX_disk_cache_low_water(max_bytes) ((max_bytes) / 10 * 9)
+
+// Temporary files older than this (seconds) are left behind by a crashed writer, the eviction scan removes them
+#define PELX_disk_cache_temporary_age 3600
+
+static struct
+{
+	PELX_type(mutex) mutex;
+	char directory[PELX_disk_cache_path_max];
+	uint64_t max_bytes;
+	uint64_t bytes; // running total of the published files, refreshed by every eviction scan
+	uint32_t counter; // for unique temporary names
+} PELX_func(disk_cache) = { PELX_mutex_initializer, { 0 }, 0, 0, 0 };
+
+typedef struct
+{
+	char name[PELX_disk_cache_name_max];
+	uint64_t size;
+	int64_t time;
+	int temporary; // being written, or left behind by a crashed writer
+	int legacy; // named by an older version of the cache
+} PELX_type(disk_cache_file);
+
+// Returns the extension of the files a writer produces
+static const char *PELX_func(writer_extension)(PELX_type(image_writer) writer)
+{
+	if (writer == PELX_func(write_qoi_image)) return "qoi";
+	if (writer == PELX_func(write_bmp_image)) return "bmp";
+	if (writer == PELX_func(write_tga_image)) return "tga";
+	return "png";
+}
+
+// Returns non-zero when name starts with digits lower case hex digits followed by a dot
+static int PELX_func(is_hex_prefix)(const char *name, int digits)
+{
+	for (int i = 0; i < digits; i++)
+	{
+		if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+		{
+			return 0;
+		}
+	}
+
+	return name[digits] == '.';
+}
+
+// Returns non-zero when name is a cache file, <64 hex digits>.<3 letter extension>
+static int PELX_func(is_disk_cache_name)(const char *name)
+{
+	return PELX_func(is_hex_prefix)(name, PELX_disk_cache_key_length) && strlen(name) == PELX_disk_cache_key_length + 4;
+}
+
+// Returns non-zero when name is a cache file of a version before 3, <16 hex digits>.<3 letter extension>
+static int PELX_func(is_disk_cache_legacy_name)(const char *name)
+{
+	return PELX_func(is_hex_prefix)(name, PELX_disk_cache_legacy_key_length) && strlen(name) == PELX_disk_cache_legacy_key_length + 4;
+}
+
+// Returns non-zero when name is a temporary file of a cache writer, <64 hex digits>.<process>-<counter>.tmp
+static int PELX_func(is_disk_cache_temporary_name)(const char *name)
+{
+	if (!PELX_func(is_hex_prefix)(name, PELX_disk_cache_key_length))
+	{
+		return 0;
+	}
+
+	const size_t length = strlen(name);
+	return length < PELX_disk_cache_name_max && length > PELX_disk_cache_key_length + 5 && strcmp(name + length - 4, ".tmp") == 0;
+}
+
+// Size of a file, 0 when it does not exist
+static int PELX_func(file_size)(const char *path, uint64_t *size)
+{
+#if defined (_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+	{
+		return 0;
+	}
+
+	*size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+#else
+	struct stat status;
+	if (stat(path, &status) != 0)
+	{
+		return 0;
+	}
+
+	*size = (uint64_t)status.st_size;
+#endif
+	return 1;
+}
+
+// Marks a cache file as recently used
+static void PELX_func(touch_file)(const char *path)
+{
+#if defined (_WIN32)
+	HANDLE handle = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle != INVALID_HANDLE_VALUE)
+	{
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		SetFileTime(handle, NULL, NULL, &now);
+		CloseHandle(handle);
+	}
+#else
+	utime(path, NULL);
+#endif
+}
+
+// Atomically replaces to with from
+static int PELX_func(replace_file)(const char *from, const char *to)
+{
+#if defined (_WIN32)
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+	return rename(from, to);
+#endif
+}
+
+// Makes to a hard link of from, or a copy when linking is not possible
+static PELX_type(result) PELX_func(link_or_copy)(const char *from, const char *to)
+{
+	remove(to);
+
+#if defined (_WIN32)
+	if (CreateHardLinkA(to, from, NULL))
+	{
+		return PELX_enum(success);
+	}
+#else
+	if (link(from, to) == 0)
+	{
+		return PELX_enum(success);
+	}
+#endif
+
+	FILE *source = fopen(from, "rb");
+	if (source == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	FILE *target = fopen(to, "wb");
+	if (target == NULL)
+	{
+		fclose(source);
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(result) result = PELX_enum(success);
+
+	char buffer[16384];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), source)) > 0)
+	{
+		if (fwrite(buffer, 1, read, target) != read)
+		{
+			result = PELX_enum(io_error);
+			break;
+		}
+	}
+
+	if (ferror(source))
+	{
+		result = PELX_enum(io_error);
+	}
+
+	fclose(source);
+	if (fclose(target) != 0)
+	{
+		result = PELX_enum(io_error);
+	}
+
+	return result;
+}
+
+static int PELX_func(compare_disk_cache_files)(const void *a, const void *b)
+{
+	const int64_t time_a = ((const PELX_type(disk_cache_file) *)a)->time;
+	const int64_t time_b = ((const PELX_type(disk_cache_file) *)b)->time;
+	return (time_a > time_b) - (time_a < time_b);
+}
+
+// Lists the cache files of a directory, returns the number of files or -1
+static long PELX_func(list_disk_cache)(const char *directory, PELX_type(disk_cache_file) **files)
+{
+	size_t count = 0;
+	size_t capacity = 0;
+	*files = NULL;
+
+#if defined (_WIN32)
+	char pattern[PELX_disk_cache_path_max + 4];
+	snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA(pattern, &found);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return -1;
+	}
+
+	do
+	{
+		const char *name = found.cFileName;
+		const int temporary = PELX_func(is_disk_cache_temporary_name)(name);
+		const int legacy = PELX_func(is_disk_cache_legacy_name)(name);
+		uint64_t size = ((uint64_t)found.nFileSizeHigh << 32) | found.nFileSizeLow;
+		int64_t time = (int64_t)(((uint64_t)found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime);
+#else
+	DIR *dir = opendir(directory);
+	if (dir == NULL)
+	{
+		return -1;
+	}
+
+	struct dirent *found;
+	while ((found = readdir(dir)) != NULL)
+	{
+		const char *name = found->d_name;
+		const int temporary = PELX_func(is_disk_cache_temporary_name)(name);
+		const int legacy = PELX_func(is_disk_cache_legacy_name)(name);
+		if (!temporary && !legacy && !PELX_func(is_disk_cache_name)(name))
+		{
+			continue;
+		}
+
+		char path[PELX_disk_cache_path_max + sizeof(found->d_name) + 1];
+		snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+		struct stat status;
+		if (stat(path, &status) != 0)
+		{
+			continue;
+		}
+
+		uint64_t size = (uint64_t)status.st_size;
+		int64_t time = (int64_t)status.st_mtime;
+#endif
+
+		if (temporary || legacy || PELX_func(is_disk_cache_name)(name))
+		{
+			if (count == capacity)
+			{
+				capacity = capacity ? capacity * 2 : 64;
+				PELX_type(disk_cache_file) *grown = (PELX_type(disk_cache_file) *)realloc(*files, capacity * sizeof(**files));
+				if (grown == NULL)
+				{
+					break;
+				}
+				*files = grown;
+			}
+
+			strcpy((*files)[count].name, name);
+			(*files)[count].size = size;
+			(*files)[count].time = time;
+			(*files)[count].temporary = temporary;
+			(*files)[count].legacy = legacy;
+			count++;
+		}
+#if defined (_WIN32)
+	} while (FindNextFileA(find, &found));
+
+	FindClose(find);
+#else
+	}
+
+	closedir(dir);
+#endif
+
+	return (long)count;
+}
+
+// Removes stale temporary files and the files of older cache versions, then the least recently used files until
+// the cache is down to its low-water mark, called with the lock held
+static void PELX_func(evict_disk_cache)(void)
+{
+	PELX_type(disk_cache_file) *files;
+	long count = PELX_func(list_disk_cache)(PELX_func(disk_cache).directory, &files);
+	if (count < 0)
+	{
+		return;
+	}
+
+	// In the units of the listed times
+#if defined (_WIN32)
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	const int64_t stale = (int64_t)(((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime) - (int64_t)PELX_disk_cache_temporary_age * 10000000;
+#else
+	const int64_t stale = (int64_t)time(NULL) - PELX_disk_cache_temporary_age;
+#endif
+
+	const uint64_t low_water = PELX_disk_cache_low_water(PELX_func(disk_cache).max_bytes);
+	uint64_t bytes = 0;
+
+	for (long i = 0; i < count; i++)
+	{
+		if ((files[i].temporary && files[i].time < stale) || files[i].legacy)
+		{
+			char path[PELX_disk_cache_path_max + PELX_disk_cache_name_max + 2];
+			snprintf(path, sizeof(path), "%s/%s", PELX_func(disk_cache).directory, files[i].name);
+
+			if (remove(path) == 0)
+			{
+				files[i].size = 0;
+			}
+		}
+
+		bytes += files[i].size;
+	}
+
+	if (count > 1)
+	{
+		qsort(files, (size_t)count, sizeof(*files), PELX_func(compare_disk_cache_files));
+	}
+
+	// Temporary files still being written are counted but left to their writer
+	for (long i = 0; i < count && bytes > low_water; i++)
+	{
+		if (files[i].temporary)
+		{
+			continue;
+		}
+
+		char path[PELX_disk_cache_path_max + PELX_disk_cache_name_max + 2];
+		snprintf(path, sizeof(path), "%s/%s", PELX_func(disk_cache).directory, files[i].name);
+
+		if (remove(path) == 0)
+		{
+			bytes -= files[i].size;
+		}
+	}
+
+	PELX_func(disk_cache).bytes = bytes;
+	free(files);
+}
+
+PELX_def PELX_type(result) PELX_func(set_disk_cache)(const char *directory, uint64_t max_bytes)
+{
+	if (directory != NULL && strlen(directory) >= PELX_disk_cache_path_max)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (directory != NULL)
+	{
+#if defined (_WIN32)
+		CreateDirectoryA(directory, NULL);
+		DWORD attributes = GetFileAttributesA(directory);
+		if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+#else
+		mkdir(directory, 0777);
+		struct stat status;
+		if (stat(directory, &status) != 0 || !S_ISDIR(status.st_mode))
+#endif
+		{
+			return PELX_enum(io_error);
+		}
+	}
+
+	PELX_mutex_lock(&PELX_func(disk_cache).mutex);
+
+	if (directory != NULL)
+	{
+		strcpy(PELX_func(disk_cache).directory, directory);
+		PELX_func(disk_cache).max_bytes = max_bytes;
+		PELX_func(evict_disk_cache)();
+	}
+	else
+	{
+		PELX_func(disk_cache).directory[0] = '\0';
+	}
+
+	PELX_mutex_unlock(&PELX_func(disk_cache).mutex);
+	return PELX_enum(success);
+}
+
+// Encodes through the disk cache, returns 0 when the cache is disabled and the caller must encode itself
+static int PELX_func(encode_cached_image)(PELX_type(context) *context, const char *file, const PELX_type(file_data) *input_data,
+                                          const uint8_t (*lut)[4], uint16_t lut_count,
+                                          uint8_t channels, PELX_type(image_writer) writer, PELX_type(result) *result)
+{
+	char directory[PELX_disk_cache_path_max];
+	uint32_t counter;
+
+	PELX_mutex_lock(&PELX_func(disk_cache).mutex);
+	strcpy(directory, PELX_func(disk_cache).directory);
+	counter = PELX_func(disk_cache).counter++;
+	PELX_mutex_unlock(&PELX_func(disk_cache).mutex);
+
+	if (directory[0] == '\0')
+	{
+		return 0;
+	}
+
+	const char *extension = PELX_func(writer_extension)(writer);
+
+	// The writer settings of stb_image_write change the encoded bytes as well, the sizes of the palette
+	// and pixel data keep their boundary unambiguous
+	const uint16_t entry_count = lut_count < 256 ? lut_count : 256;
+	const uint32_t body_size = input_data->body.size;
+	const uint8_t key[19] =
+	{
+		PELX_disk_cache_version,
+		(uint8_t)(input_data->header.width >> 8), (uint8_t)input_data->header.width,
+		(uint8_t)(input_data->header.height >> 8), (uint8_t)input_data->header.height,
+		input_data->header.true_channel_count, input_data->header.palette_channel_count,
+		channels, (uint8_t)extension[0], (uint8_t)extension[1], (uint8_t)extension[2],
+		(uint8_t)stbi_write_png_compression_level, (uint8_t)stbi_write_force_png_filter,
+		(uint8_t)(entry_count >> 8), (uint8_t)entry_count,
+		(uint8_t)(body_size >> 24), (uint8_t)(body_size >> 16), (uint8_t)(body_size >> 8), (uint8_t)body_size
+	};
+
+	PELX_type(sha256) sha;
+	PELX_func(sha256_init)(&sha);
+	PELX_func(sha256_update)(&sha, key, sizeof(key));
+	PELX_func(sha256_update)(&sha, lut, (size_t)entry_count * 4);
+	PELX_func(sha256_update)(&sha, input_data->body.data, body_size);
+
+	char digest[PELX_disk_cache_key_length + 1];
+	PELX_func(sha256_hex)(&sha, digest);
+
+	char path[PELX_disk_cache_path_max + PELX_disk_cache_key_length + 8];
+	snprintf(path, sizeof(path), "%s/%s.%s", directory, digest, extension);
+
+	uint64_t size = 0;
+	if (PELX_func(file_size)(path, &size))
+	{
+		PELX_stats_start(write_start);
+		PELX_func(touch_file)(path);
+		*result = PELX_func(link_or_copy)(path, file);
+		PELX_stats_phase(phase_write, write_start);
+		return 1;
+	}
+
+	uint8_t *image_buffer = NULL;
+
+	*result = PELX_func(render)(context, input_data, lut, lut_count, channels, &image_buffer);
+	if (*result != PELX_enum(success))
+	{
+		return 1;
+	}
+
+#if defined (_WIN32)
+	unsigned long process = (unsigned long)GetCurrentProcessId();
+#else
+	unsigned long process = (unsigned long)getpid();
+#endif
+
+	char temporary[PELX_disk_cache_path_max + PELX_disk_cache_key_length + 40];
+	snprintf(temporary, sizeof(temporary), "%s/%s.%lu-%lu.tmp", directory, digest, process, (unsigned long)counter);
+
+	PELX_type(context) *writer_context = PELX_func(writer_context);
+	PELX_func(writer_context) = context;
+	int write_success = writer(temporary, input_data->header.width, input_data->header.height, channels, image_buffer);
+	PELX_func(writer_context) = writer_context;
+
+	PELX_func(deallocate)(context, image_buffer);
+
+	if (write_success == 0 || PELX_func(replace_file)(temporary, path) != 0)
+	{
+		remove(temporary);
+		*result = PELX_enum(io_error);
+		return 1;
+	}
+
+	*result = PELX_func(link_or_copy)(path, file);
+
+	PELX_func(file_size)(path, &size);
+
+	PELX_mutex_lock(&PELX_func(disk_cache).mutex);
+	if (strcmp(directory, PELX_func(disk_cache).directory) == 0)
+	{
+		PELX_func(disk_cache).bytes += size;
+		if (PELX_func(disk_cache).bytes > PELX_func(disk_cache).max_bytes)
+		{
+			PELX_func(evict_disk_cache)();
+		}
+	}
+	PELX_mutex_unlock(&PELX_func(disk_cache).mutex);
+
+	return 1;
+}
+
+// Expands a PELX file through a resolved palette and hands the pixels to an image writer,
+// expanding into the context scratch when there is a context
+static PELX_type(result) PELX_func(encode_image)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                 const uint8_t (*lut)[4], uint16_t lut_count,
+                                                 uint8_t channels, PELX_type(image_writer) writer)
+{
+	const uint16_t width = input_data->header.width;
+	const uint16_t height = input_data->header.height;
+
+	PELX_type(result) result;
+	if (PELX_func(encode_cached_image)(context, file, input_data, lut, lut_count, channels, writer, &result))
+	{
+		return result;
+	}
+
+	uint8_t *image_buffer = NULL;
+
+	if (context != NULL)
+	{
+		if (input_data->header.reserved[0] & PELX_flag_animated)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		image_buffer = PELX_func(scratch)(context, (size_t)width * height * channels);
+		if (image_buffer == NULL)
+		{
+			return PELX_enum(memory_allocation_failed);
+		}
+
+		PELX_trace_begin("render");
+		PELX_stats_start(decode_start);
+		result = PELX_func(expand_pixels)(input_data, lut, lut_count, channels, image_buffer, (size_t)width * channels);
+		PELX_stats_phase(phase_decode, decode_start);
+		PELX_trace_end("render");
+	}
+	else
+	{
+		result = PELX_func(render)(NULL, input_data, lut, lut_count, channels, &image_buffer);
+	}
+
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	PELX_type(context) *writer_context = PELX_func(writer_context);
+	PELX_func(writer_context) = context;
+	int write_success = writer(file, width, height, channels, image_buffer);
+	PELX_func(writer_context) = writer_context;
+
+	if (context == NULL)
+	{
+		free(image_buffer);
+	}
+
+	if (write_success == 0)
+	{
+		return PELX_enum(io_error);
+	}
+
+	return PELX_enum(success);
+}
+
+// Validates the arguments shared by all encode_* entry points and encodes with caller palette entries
+static PELX_type(result) PELX_func(encode_with_entries)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                        uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t channels, PELX_type(image_writer) writer)
+{
+	if (file == NULL || input_data == NULL || palette_entries == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (channels != 3 && channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_trace_begin("encode");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
+	if (result == PELX_enum(success))
+	{
+		uint8_t lut[256][4];
+		PELX_func(resolve_palette)(palette_entries, palette_count, input_data->header.palette_channel_count, lut);
+		PELX_stats_phase(phase_parse, parse_start);
+
+		result = PELX_func(encode_image)(context, file, input_data, (const uint8_t (*)[4])lut, palette_count, channels, writer);
+
+	#if defined (PELX_with_stats)
+		uint64_t written = 0;
+		if (result == PELX_enum(success) && PELX_func(file_size)(file, &written))
+		{
+			PELX_stats_add(bytes_in, input_data->body.size);
+			PELX_stats_add(bytes_out, written);
+		}
+	#endif // PELX_with_stats
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("encode");
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t png_channels)
+{
+	return PELX_func(encode_with_entries)(NULL, file, input_data, palette_count, palette_entries, png_channels, PELX_func(write_png_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t png_channels)
+{
+	return PELX_func(encode_with_entries)(context, file, input_data, palette_count, palette_entries, png_channels, PELX_func(write_png_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_qoi)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t qoi_channels)
+{
+	return PELX_func(encode_with_entries)(NULL, file, input_data, palette_count, palette_entries, qoi_channels, PELX_func(write_qoi_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_qoi_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t qoi_channels)
+{
+	return PELX_func(encode_with_entries)(context, file, input_data, palette_count, palette_entries, qoi_channels, PELX_func(write_qoi_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_bmp)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t bmp_channels)
+{
+	return PELX_func(encode_with_entries)(NULL, file, input_data, palette_count, palette_entries, bmp_channels, PELX_func(write_bmp_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_bmp_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t bmp_channels)
+{
+	return PELX_func(encode_with_entries)(context, file, input_data, palette_count, palette_entries, bmp_channels, PELX_func(write_bmp_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_tga)(const char *file, PELX_type(file_data) *input_data,
+                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                 uint8_t tga_channels)
+{
+	return PELX_func(encode_with_entries)(NULL, file, input_data, palette_count, palette_entries, tga_channels, PELX_func(write_tga_image));
+}
+
+PELX_def PELX_type(result) PELX_func(encode_tga_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                         uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                         uint8_t tga_channels)
+{
+	return PELX_func(encode_with_entries)(context, file, input_data, palette_count, palette_entries, tga_channels, PELX_func(write_tga_image));
+}
+
+static PELX_type(result) PELX_func(encode_png_memory)(PELX_type(context) *context, PELX_type(file_data) *input_data,
+                                                      uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                      uint8_t png_channels, const uint8_t **png, size_t *png_size)
+{
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	if (input_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint16_t width = input_data->header.width;
+	const uint16_t height = input_data->header.height;
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(palette_entries, palette_count, input_data->header.palette_channel_count, lut);
+	PELX_stats_phase(phase_parse, parse_start);
+
+	uint8_t *image_buffer = PELX_func(scratch)(context, (size_t)width * height * png_channels);
+	if (image_buffer == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_trace_begin("render");
+	PELX_stats_start(decode_start);
+	result = PELX_func(expand_pixels)(input_data, (const uint8_t (*)[4])lut, palette_count, png_channels,
+	                                  image_buffer, (size_t)width * png_channels);
+	PELX_stats_phase(phase_decode, decode_start);
+	PELX_trace_end("render");
+
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	// The previous output goes back first, so a pooled context hands the same block out again
+	PELX_func(deallocate)(context, context->output);
+	context->output = NULL;
+	context->output_size = 0;
+
+	PELX_type(context) *writer_context = PELX_func(writer_context);
+	PELX_func(writer_context) = context;
+	int length = 0;
+	uint8_t *output = PELX_func(png_to_memory)(width, height, png_channels, image_buffer, &length);
+	PELX_func(writer_context) = writer_context;
+
+	if (output == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	context->output = output;
+	context->output_size = (size_t)length;
+
+	PELX_stats_add(bytes_in, input_data->body.size);
+	PELX_stats_add(bytes_out, length);
+
+	*png = output;
+	*png_size = (size_t)length;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_memory_context)(PELX_type(context) *context, PELX_type(file_data) *input_data,
+                                                                uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                                uint8_t png_channels, const uint8_t **png, size_t *png_size)
+{
+	if (context == NULL || input_data == NULL || palette_entries == NULL || png == NULL || png_size == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_trace_begin("encode");
+	PELX_stats_begin();
+	PELX_type(result) result = PELX_func(encode_png_memory)(context, input_data, palette_count, palette_entries,
+	                                                        png_channels, png, png_size);
+	PELX_stats_end();
+	PELX_trace_end("encode");
+
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_named)(const char *file, PELX_type(file_data) *input_data,
+                                                       const char *palette_name, uint8_t png_channels)
+{
+	return PELX_func(encode_png_named_context)(NULL, file, input_data, palette_name, png_channels);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_named_context)(PELX_type(context) *context, const char *file, PELX_type(file_data) *input_data,
+                                                               const char *palette_name, uint8_t png_channels)
+{
+	if (input_data == NULL || palette_name == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(palette) *palette = PELX_func(find_palette)(input_data, palette_name);
+	if (palette == NULL)
+	{
+		return PELX_enum(palette_not_found);
+	}
+
+	return PELX_func(encode_png_context)(context, file, input_data, input_data->header.palette_count, palette->entries, png_channels);
+}
+
+// Scaling:
+//     Pixel art is mostly shown at 2x to 8x, so the scaled decoders write every decoded pixel straight into its
+//     scale x scale block: the pixel is broadcast across the columns of the block (SSE2 stores for RGBA on x86),
+//     then each finished output row is copied to the scale - 1 rows under it. There is no unscaled image in between
+//     and no second pass over the output. The disk cache is not used, its key does not cover the scale.
+
+#if defined (PELX_simd_x86) && (defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PELX_simd_sse2 1 // baseline of x86-64, used without runtime dispatch
+#endif
+
+// Writes pixel count times from out, the row must have room bytes from out on
+static void PELX_func(broadcast_pixel)(uint8_t *out, const uint8_t *pixel, uint8_t png_channels, uint8_t count, size_t room)
+{
+#if defined (PELX_simd_sse2)
+	// Whole vectors may run into the following blocks of the row, which are written after this one
+	const size_t vector_bytes = ((size_t)count + 3) / 4 * 16;
+	if (png_channels == 4 && vector_bytes <= room)
+	{
+		uint32_t value;
+		memcpy(&value, pixel, 4);
+
+		const __m128i broadcast = _mm_set1_epi32((int)value);
+		for (size_t i = 0; i < vector_bytes; i += 16)
+		{
+			_mm_storeu_si128((__m128i *)(out + i), broadcast);
+		}
+
+		return;
+	}
+#else
+	(void)room;
+#endif // PELX_simd_sse2
+
+	// Constant sizes, so that the copies become plain stores
+	if (png_channels == 4)
+	{
+		for (uint8_t i = 0; i < count; i++)
+		{
+			memcpy(out + (size_t)i * 4, pixel, 4);
+		}
+	}
+	else
+	{
+		for (uint8_t i = 0; i < count; i++)
+		{
+			memcpy(out + (size_t)i * 3, pixel, 3);
+		}
+	}
+}
+
+// As expand_pixels, writing every pixel as a scale x scale block into rows of width * scale * png_channels bytes
+static PELX_type(result) PELX_func(expand_pixels_scaled)(const PELX_type(file_data) *pelx_data,
+                                                         const uint8_t (*lut)[4], uint16_t lut_count,
+                                                         uint8_t png_channels, uint8_t scale, uint8_t *out)
+{
+	const uint8_t true_channels = pelx_data->header.true_channel_count;
+	const uint16_t width = pelx_data->header.width;
+	const uint16_t height = pelx_data->header.height;
+	const size_t block_size = (size_t)scale * png_channels;
+	const size_t row_size = (size_t)width * block_size;
+
+	const uint8_t *src = pelx_data->body.data;
+	size_t src_pos = 0;
+	size_t src_size = pelx_data->body.size;
+
+	for (uint16_t y = 0; y < height; y++)
+	{
+		uint8_t *row = out + (size_t)y * scale * row_size;
+
+		for (size_t x = 0; x < row_size; x += block_size)
+		{
+			if (src_pos >= src_size)
+			{
+				return PELX_enum(invalid_data_format);
+			}
+
+			uint8_t pixel[4];
+			PELX_type(result) result = PELX_func(decode_pixel)(src, src_size, &src_pos, true_channels, lut, lut_count, png_channels, pixel);
+			if (result != PELX_enum(success))
+			{
+				return result;
+			}
+
+			PELX_func(broadcast_pixel)(&row[x], pixel, png_channels, scale, row_size - x);
+		}
+
+		for (uint8_t r = 1; r < scale; r++)
+		{
+			memcpy(row + (size_t)r * row_size, row, row_size);
+		}
+	}
+
+	return PELX_enum(success);
+}
+
+// As render, for an image scaled up by scale
+static PELX_type(result) PELX_func(render_scaled)(PELX_type(context) *context, const PELX_type(file_data) *pelx_data,
+                                                  const uint8_t (*lut)[4], uint16_t lut_count,
+                                                  uint8_t png_channels, uint8_t scale, uint8_t **png_buffer)
+{
+	*png_buffer = NULL;
+
+	if (pelx_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint64_t output_size = (uint64_t)pelx_data->header.width * scale * pelx_data->header.height * scale * png_channels;
+	if (output_size > (uint64_t)SIZE_MAX)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	*png_buffer = (uint8_t *)PELX_func(allocate)(context, (size_t)output_size);
+	if (*png_buffer == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_trace_begin("render");
+	PELX_stats_start(decode_start);
+	PELX_type(result) result = PELX_func(expand_pixels_scaled)(pelx_data, lut, lut_count, png_channels, scale, *png_buffer);
+	PELX_stats_phase(phase_decode, decode_start);
+	PELX_trace_end("render");
+
+	if (result != PELX_enum(success))
+	{
+		PELX_func(deallocate)(context, *png_buffer);
+		*png_buffer = NULL;
+	}
+
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(to_png_scaled)(PELX_type(file) *pelx_data,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t png_channels, uint8_t scale, uint8_t **png_buffer)
+{
+	if (pelx_data == NULL || *pelx_data == NULL || palette_entries == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	if (scale == 0 || scale > PELX_scale_max)
+	{
+		return PELX_enum(invalid_scale);
+	}
+
+	PELX_trace_begin("to_png");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&(*pelx_data)->header);
+	if (result == PELX_enum(success))
+	{
+		uint8_t lut[256][4];
+		PELX_func(resolve_palette)(palette_entries, palette_count, (*pelx_data)->header.palette_channel_count, lut);
+		PELX_stats_phase(phase_parse, parse_start);
+
+		result = PELX_func(render_scaled)(NULL, *pelx_data, (const uint8_t (*)[4])lut, palette_count, png_channels, scale, png_buffer);
+		if (result == PELX_enum(success))
+		{
+			PELX_stats_add(bytes_in, (*pelx_data)->body.size);
+			PELX_stats_add(bytes_out, (size_t)(*pelx_data)->header.width * scale * (*pelx_data)->header.height * scale * png_channels);
+		}
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("to_png");
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_scaled)(const char *file, PELX_type(file_data) *input_data,
+                                                        uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t png_channels, uint8_t scale)
+{
+	if (file == NULL || input_data == NULL || palette_entries == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	if (scale == 0 || scale > PELX_scale_max)
+	{
+		return PELX_enum(invalid_scale);
+	}
+
+	PELX_trace_begin("encode");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
+	if (result == PELX_enum(success))
+	{
+		uint8_t lut[256][4];
+		PELX_func(resolve_palette)(palette_entries, palette_count, input_data->header.palette_channel_count, lut);
+		PELX_stats_phase(phase_parse, parse_start);
+
+		uint8_t *image_buffer = NULL;
+		result = PELX_func(render_scaled)(NULL, input_data, (const uint8_t (*)[4])lut, palette_count, png_channels, scale, &image_buffer);
+		if (result == PELX_enum(success))
+		{
+			if (PELX_func(write_png_image)(file, input_data->header.width * scale, input_data->header.height * scale,
+			                               png_channels, image_buffer) == 0)
+			{
+				result = PELX_enum(io_error);
+			}
+
+			free(image_buffer);
+		}
+
+	#if defined (PELX_with_stats)
+		uint64_t written = 0;
+		if (result == PELX_enum(success) && PELX_func(file_size)(file, &written))
+		{
+			PELX_stats_add(bytes_in, input_data->body.size);
+			PELX_stats_add(bytes_out, written);
+		}
+	#endif // PELX_with_stats
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("encode");
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(add_palette)(PELX_type(file_data) *pelx_data, const char *name,
+                                                  const PELX_type(palette_entry) *palette_entries)
+{
+	return PELX_func(add_palette_context)(NULL, pelx_data, name, palette_entries);
+}
+
+PELX_def PELX_type(result) PELX_func(add_palette_context)(PELX_type(context) *context, PELX_type(file_data) *pelx_data, const char *name,
+                                                          const PELX_type(palette_entry) *palette_entries)
+{
+	if (pelx_data == NULL || name == NULL || palette_entries == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	const size_t name_length = strlen(name);
+	if (name_length == 0 || name_length > PELX_palette_name_max || PELX_func(find_palette)(pelx_data, name) != NULL)
+	{
+		return PELX_enum(invalid_palette_name);
+	}
+
+	if (pelx_data->header.palette_count == 0)
+	{
+		return PELX_enum(header_invalid_palette_count);
+	}
+
+	if (pelx_data->palettes.count == UINT16_MAX)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const size_t entries_size = (size_t)pelx_data->header.palette_count * sizeof(PELX_type(palette_entry));
+	PELX_type(palette_entry) *entries = (PELX_type(palette_entry) *)PELX_func(allocate)(context, entries_size);
+	if (entries == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	memcpy(entries, palette_entries, entries_size);
+
+	// The palette array grows to the next power of two, so it only reallocates when count is zero or a power of two (0, 1, 2, 4, ...)
+	const uint16_t count = pelx_data->palettes.count;
+	if ((count & (count - 1)) == 0)
+	{
+		const size_t capacity = count == 0 ? 1 : (size_t)count * 2;
+		PELX_type(palette) *palettes = (PELX_type(palette) *)PELX_func(reallocate)(context, pelx_data->palettes.data,
+		                                                                            (size_t)count * sizeof(PELX_type(palette)),
+		                                                                            capacity * sizeof(PELX_type(palette)));
+		if (palettes == NULL)
+		{
+			PELX_func(deallocate)(context, entries);
+			return PELX_enum(memory_allocation_failed);
+		}
+
+		pelx_data->palettes.data = palettes;
+	}
+
+	PELX_type(palette) *palette = &pelx_data->palettes.data[count];
+	memcpy(palette->name, name, name_length + 1);
+	palette->entries = entries;
+
+	pelx_data->palettes.count++;
+
+	if (pelx_data->palettes.lookup_size < (uint32_t)pelx_data->palettes.count * 2)
+	{
+		PELX_type(result) result = PELX_func(build_palette_lookup)(context, pelx_data);
+		if (result != PELX_enum(success))
+		{
+			pelx_data->palettes.count--;
+			PELX_func(deallocate)(context, entries);
+		}
+
+		return result;
+	}
+
+	const uint32_t mask = pelx_data->palettes.lookup_size - 1;
+	uint32_t slot = (uint32_t)PELX_func(hash_bytes)(PELX_hash_seed, name, name_length) & mask;
+
+	while (pelx_data->palettes.lookup[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	pelx_data->palettes.lookup[slot] = pelx_data->palettes.count;
+
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(palette) *PELX_func(get_palette)(PELX_type(file_data) *pelx_data, uint16_t index)
+{
+	if (pelx_data == NULL || index >= pelx_data->palettes.count)
+	{
+		return NULL;
+	}
+
+	return &pelx_data->palettes.data[index];
+}
+
+PELX_def PELX_type(palette) *PELX_func(find_palette)(PELX_type(file_data) *pelx_data, const char *name)
+{
+	if (pelx_data == NULL || name == NULL || pelx_data->palettes.lookup == NULL)
+	{
+		return NULL;
+	}
+
+	const uint32_t mask = pelx_data->palettes.lookup_size - 1;
+	uint32_t slot = (uint32_t)PELX_func(hash_bytes)(PELX_hash_seed, name, strlen(name)) & mask;
+
+	while (pelx_data->palettes.lookup[slot] != 0)
+	{
+		PELX_type(palette) *palette = &pelx_data->palettes.data[pelx_data->palettes.lookup[slot] - 1];
+		if (strcmp(palette->name, name) == 0)
+		{
+			return palette;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+// Palette registry:
+//     Palettes are content-hashed and deduplicated, every distinct palette is stored once
+//     together with its resolved lookup tables, so rendering through a handle skips palette setup entirely.
+//     Renders hold a reference to their slot and use it outside the lock, reset_palette_registry leaves slots
+//     still referenced to be freed by the last render. Handles carry the generation of the registry, which
+//     every reset advances, so a handle from before a reset is rejected instead of naming a new palette.
+
+typedef struct
+{
+	uint64_t hash;
+	uint32_t references; // renders using the slot, guarded by the registry lock
+	int retired; // released by reset_palette_registry, freed when the last reference goes
+	uint16_t count;
+	PELX_type(palette_entry) *entries;
+	uint8_t lut[2][256][4]; // [0] for 4 channel palettes, [1] with alpha forced opaque for 3 channel palettes
+} PELX_type(registry_slot);
+
+static struct
+{
+	PELX_type(mutex) mutex;
+	PELX_type(registry_slot) **slots;
+	uint32_t count;
+	uint32_t capacity;
+	uint16_t *lookup; // open addressing table of slot numbers (index + 1) by content hash (0 is empty)
+	uint32_t lookup_size; // power of two
+	uint16_t generation; // upper half of every handle, never 0
+} PELX_func(registry) = { PELX_mutex_initializer, NULL, 0, 0, NULL, 0, 1 };
+
+// Rebuilds the registry lookup table with room for twice the registered palettes, called with the lock held
+static PELX_type(result) PELX_func(registry_grow_lookup)(void)
+{
+	uint32_t lookup_size = PELX_func(registry).lookup_size ? PELX_func(registry).lookup_size * 2 : 64;
+
+	uint16_t *lookup = (uint16_t *)calloc(lookup_size, sizeof(uint16_t));
+	if (lookup == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	for (uint32_t i = 0; i < PELX_func(registry).count; i++)
+	{
+		uint32_t slot = (uint32_t)PELX_func(registry).slots[i]->hash & (lookup_size - 1);
+		while (lookup[slot] != 0)
+		{
+			slot = (slot + 1) & (lookup_size - 1);
+		}
+
+		lookup[slot] = (uint16_t)(i + 1);
+	}
+
+	free(PELX_func(registry).lookup);
+	PELX_func(registry).lookup = lookup;
+	PELX_func(registry).lookup_size = lookup_size;
+
+	return PELX_enum(success);
+}
+
+// Returns the handle of the slot number (index + 1) in the current generation, called with the lock held
+static PELX_type(palette_handle) PELX_func(registry_handle)(uint16_t number)
+{
+	return ((PELX_type(palette_handle))PELX_func(registry).generation << 16) | number;
+}
+
+static void PELX_func(free_registry_slot)(PELX_type(registry_slot) *slot)
+{
+	free(slot->entries);
+	free(slot);
+}
+
+// Returns the slot of a handle with a reference taken, or NULL, release it with registry_release
+static const PELX_type(registry_slot) *PELX_func(registry_acquire)(PELX_type(palette_handle) handle)
+{
+	PELX_type(registry_slot) *slot = NULL;
+	const uint16_t number = (uint16_t)handle;
+
+	PELX_mutex_lock(&PELX_func(registry).mutex);
+	if ((handle >> 16) == PELX_func(registry).generation && number != 0 && number <= PELX_func(registry).count)
+	{
+		slot = PELX_func(registry).slots[number - 1];
+		slot->references++;
+	}
+	PELX_mutex_unlock(&PELX_func(registry).mutex);
+
+	return slot;
+}
+
+// Drops a reference taken by registry_acquire, freeing the slot when a reset retired it meanwhile
+static void PELX_func(registry_release)(const PELX_type(registry_slot) *slot)
+{
+	PELX_type(registry_slot) *released = (PELX_type(registry_slot) *)slot;
+	int unused;
+
+	PELX_mutex_lock(&PELX_func(registry).mutex);
+	unused = --released->references == 0 && released->retired;
+	PELX_mutex_unlock(&PELX_func(registry).mutex);
+
+	if (unused)
+	{
+		PELX_func(free_registry_slot)(released);
+	}
+}
+
+PELX_def PELX_type(result) PELX_func(register_palette)(uint16_t palette_count, const PELX_type(palette_entry) *palette_entries,
+                                                       PELX_type(palette_handle) *handle)
+{
+	if (palette_entries == NULL || handle == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (palette_count == 0)
+	{
+		return PELX_enum(header_invalid_palette_count);
+	}
+
+	const size_t entries_size = (size_t)palette_count * sizeof(PELX_type(palette_entry));
+	const uint64_t hash = PELX_func(hash_bytes)(PELX_func(hash_bytes)(PELX_hash_seed, &palette_count, sizeof(palette_count)),
+	                                            palette_entries, entries_size);
+
+	PELX_type(result) result = PELX_enum(success);
+	uint32_t mask;
+	uint32_t slot;
+
+	PELX_mutex_lock(&PELX_func(registry).mutex);
+
+	// Look for an identical palette first
+	if (PELX_func(registry).lookup != NULL)
+	{
+		mask = PELX_func(registry).lookup_size - 1;
+		slot = (uint32_t)hash & mask;
+
+		while (PELX_func(registry).lookup[slot] != 0)
+		{
+			const PELX_type(registry_slot) *existing = PELX_func(registry).slots[PELX_func(registry).lookup[slot] - 1];
+			if (existing->hash == hash && existing->count == palette_count && memcmp(existing->entries, palette_entries, entries_size) == 0)
+			{
+				*handle = PELX_func(registry_handle)(PELX_func(registry).lookup[slot]);
+				goto unlock;
+			}
+
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	if (PELX_func(registry).count == UINT16_MAX)
+	{
+		result = PELX_enum(invalid_palette_handle);
+		goto unlock;
+	}
+
+	if (PELX_func(registry).count == PELX_func(registry).capacity)
+	{
+		uint32_t capacity = PELX_func(registry).capacity ? PELX_func(registry).capacity * 2 : 32;
+		PELX_type(registry_slot) **slots = (PELX_type(registry_slot) **)realloc(PELX_func(registry).slots, capacity * sizeof(*slots));
+		if (slots == NULL)
+		{
+			result = PELX_enum(memory_allocation_failed);
+			goto unlock;
+		}
+
+		PELX_func(registry).slots = slots;
+		PELX_func(registry).capacity = capacity;
+	}
+
+	if ((PELX_func(registry).count + 1) * 2 > PELX_func(registry).lookup_size)
+	{
+		result = PELX_func(registry_grow_lookup)();
+		if (result != PELX_enum(success))
+		{
+			goto unlock;
+		}
+	}
+
+	PELX_type(registry_slot) *new_slot = (PELX_type(registry_slot) *)calloc(1, sizeof(PELX_type(registry_slot)));
+	PELX_type(palette_entry) *entries = (PELX_type(palette_entry) *)malloc(entries_size);
+	if (new_slot == NULL || entries == NULL)
+	{
+		free(new_slot);
+		free(entries);
+		result = PELX_enum(memory_allocation_failed);
+		goto unlock;
+	}
+
+	memcpy(entries, palette_entries, entries_size);
+	new_slot->hash = hash;
+	new_slot->count = palette_count;
+	new_slot->entries = entries;
+	PELX_func(resolve_palette)(entries, palette_count, 4, new_slot->lut[0]);
+	PELX_func(resolve_palette)(entries, palette_count, 3, new_slot->lut[1]);
+
+	PELX_func(registry).slots[PELX_func(registry).count++] = new_slot;
+	*handle = PELX_func(registry_handle)((uint16_t)PELX_func(registry).count);
+
+	mask = PELX_func(registry).lookup_size - 1;
+	slot = (uint32_t)hash & mask;
+	while (PELX_func(registry).lookup[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	PELX_func(registry).lookup[slot] = (uint16_t)PELX_func(registry).count;
+
+unlock:
+	PELX_mutex_unlock(&PELX_func(registry).mutex);
+	return result;
+}
+
+PELX_def uint16_t PELX_func(palette_handle_count)(PELX_type(palette_handle) handle)
+{
+	const PELX_type(registry_slot) *slot = PELX_func(registry_acquire)(handle);
+	if (slot == NULL)
+	{
+		return 0;
+	}
+
+	const uint16_t count = slot->count;
+	PELX_func(registry_release)(slot);
+
+	return count;
+}
+
+PELX_def void PELX_func(reset_palette_registry)(void)
+{
+	PELX_mutex_lock(&PELX_func(registry).mutex);
+
+	for (uint32_t i = 0; i < PELX_func(registry).count; i++)
+	{
+		PELX_type(registry_slot) *slot = PELX_func(registry).slots[i];
+		if (slot->references > 0)
+		{
+			slot->retired = 1; // freed by the last registry_release
+		}
+		else
+		{
+			PELX_func(free_registry_slot)(slot);
+		}
+	}
+
+	free(PELX_func(registry).slots);
+	free(PELX_func(registry).lookup);
+
+	PELX_func(registry).slots = NULL;
+	PELX_func(registry).count = 0;
+	PELX_func(registry).capacity = 0;
+	PELX_func(registry).lookup = NULL;
+	PELX_func(registry).lookup_size = 0;
+	PELX_func(registry).generation = PELX_func(registry).generation == UINT16_MAX ? 1 : PELX_func(registry).generation + 1;
+
+	PELX_mutex_unlock(&PELX_func(registry).mutex);
+}
+
+PELX_def PELX_type(result) PELX_func(to_png_handle)(PELX_type(file) *pelx_data, PELX_type(palette_handle) handle,
+                                                    uint8_t png_channels, uint8_t **png_buffer)
+{
+	if (pelx_data == NULL || *pelx_data == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_trace_begin("to_png");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&(*pelx_data)->header);
+	if (result == PELX_enum(success))
+	{
+		const PELX_type(registry_slot) *slot = PELX_func(registry_acquire)(handle);
+		if (slot == NULL)
+		{
+			result = PELX_enum(invalid_palette_handle);
+		}
+		else
+		{
+			const uint8_t (*lut)[4] = slot->lut[(*pelx_data)->header.palette_channel_count == 4 ? 0 : 1];
+			PELX_stats_phase(phase_parse, parse_start);
+
+			result = PELX_func(render)(NULL, *pelx_data, lut, slot->count, png_channels, png_buffer);
+			PELX_func(registry_release)(slot);
+
+			if (result == PELX_enum(success))
+			{
+				PELX_stats_add(bytes_in, (*pelx_data)->body.size);
+				PELX_stats_add(bytes_out, (size_t)(*pelx_data)->header.width * (*pelx_data)->header.height * png_channels);
+			}
+		}
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("to_png");
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(encode_png_handle)(const char *file, PELX_type(file_data) *input_data,
+                                                        PELX_type(palette_handle) handle, uint8_t png_channels)
+{
+	if (file == NULL || input_data == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_trace_begin("encode");
+	PELX_stats_begin();
+	PELX_stats_start(parse_start);
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
+	if (result == PELX_enum(success))
+	{
+		const PELX_type(registry_slot) *slot = PELX_func(registry_acquire)(handle);
+		if (slot == NULL)
+		{
+			result = PELX_enum(invalid_palette_handle);
+		}
+		else
+		{
+			const uint8_t (*lut)[4] = slot->lut[input_data->header.palette_channel_count == 4 ? 0 : 1];
+			PELX_stats_phase(phase_parse, parse_start);
+
+			result = PELX_func(encode_image)(NULL, file, input_data, lut, slot->count, png_channels, PELX_func(write_png_image));
+			PELX_func(registry_release)(slot);
+		}
+
+	#if defined (PELX_with_stats)
+		uint64_t written = 0;
+		if (result == PELX_enum(success) && PELX_func(file_size)(file, &written))
+		{
+			PELX_stats_add(bytes_in, input_data->body.size);
+			PELX_stats_add(bytes_out, written);
+		}
+	#endif // PELX_with_stats
+	}
+
+	PELX_stats_end();
+	PELX_trace_end("encode");
+	return result;
+}
+
+// Packs:
+//     A pack is mapped read-only and never copied, views are filled straight from the mapping.
+//     Entries are sorted by name hash so that lookups by name are a binary search over the index.
+
+#define PELX_pack_header_size 24
+#define PELX_pack_entry_size 24
+
+// Reads a big-endian uint16 from memory
+static uint16_t PELX_func(load_uint16)(const uint8_t *p)
+{
+	return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+// Reads a big-endian uint32 from memory
+static uint32_t PELX_func(load_uint32)(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Reads a big-endian uint64 from memory
+static uint64_t PELX_func(load_uint64)(const uint8_t *p)
+{
+	return ((uint64_t)PELX_func(load_uint32)(p) << 32) | PELX_func(load_uint32)(p + 4);
+}
+
+// Writes a uint64 to a file (big-endianess)
+static void PELX_func(write_uint64)(FILE *fp, uint64_t value)
+{
+	PELX_func(write_uint32)(fp, (uint32_t)(value >> 32));
+	PELX_func(write_uint32)(fp, (uint32_t)value);
+}
+
+// Parses a header from memory, returns -1 when the data is too short
+static int PELX_func(parse_header)(const uint8_t *data, size_t size, PELX_type(header) *header)
+{
+	if (size < PELX_header_disk_size)
+	{
+		return -1;
+	}
+
+	memcpy(header->magic, data, 5);
+	header->header_size = PELX_func(load_uint32)(data + 5);
+	header->palette_offset = PELX_func(load_uint32)(data + 9);
+	header->width = PELX_func(load_uint16)(data + 13);
+	header->height = PELX_func(load_uint16)(data + 15);
+	header->palette_channel_count = data[17];
+	header->true_channel_count = data[18];
+	header->palette_count = PELX_func(load_uint16)(data + 19);
+	memcpy(header->reserved, data + 21, 5);
+
+	return 0;
+}
+
+typedef struct
+{
+	uint64_t hash;
+	const char *name;
+	uint32_t source;
+} PELX_type(pack_sort_entry);
+
+static int PELX_func(compare_pack_entries)(const void *a, const void *b)
+{
+	const PELX_type(pack_sort_entry) *lhs = (const PELX_type(pack_sort_entry) *)a;
+	const PELX_type(pack_sort_entry) *rhs = (const PELX_type(pack_sort_entry) *)b;
+
+	if (lhs->hash != rhs->hash)
+	{
+		return lhs->hash < rhs->hash ? -1 : 1;
+	}
+
+	return strcmp(lhs->name, rhs->name);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_pack)(const char *file, uint32_t count,
+                                                  const char *const *names, PELX_type(file_data) *const *images)
+{
+	if (file == NULL || (count > 0 && (names == NULL || images == NULL)))
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(pack_sort_entry) *entries = (PELX_type(pack_sort_entry) *)malloc(((size_t)count + 1) * sizeof(PELX_type(pack_sort_entry)));
+	if (entries == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	size_t names_size = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (names[i] == NULL || names[i][0] == '\0' || images[i] == NULL)
+		{
+			free(entries);
+			return PELX_enum(invalid_entry_name);
+		}
+
+		entries[i].hash = PELX_func(hash_bytes)(PELX_hash_seed, names[i], strlen(names[i]));
+		entries[i].name = names[i];
+		entries[i].source = i;
+		names_size += strlen(names[i]) + 1;
+	}
+
+	qsort(entries, count, sizeof(PELX_type(pack_sort_entry)), PELX_func(compare_pack_entries));
+
+	for (uint32_t i = 1; i < count; i++)
+	{
+		if (entries[i].hash == entries[i - 1].hash && strcmp(entries[i].name, entries[i - 1].name) == 0)
+		{
+			free(entries);
+			return PELX_enum(invalid_entry_name);
+		}
+	}
+
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+	{
+		free(entries);
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(result) result = PELX_enum(success);
+
+	const uint64_t names_offset = PELX_pack_header_size + (uint64_t)count * PELX_pack_entry_size;
+	uint64_t image_offset = names_offset + names_size;
+	uint32_t name_offset = 0;
+
+	fwrite("PELXPAK\0", 1, 8, fp);
+	PELX_func(write_uint32)(fp, 1);
+	PELX_func(write_uint32)(fp, count);
+	PELX_func(write_uint64)(fp, names_offset);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const size_t image_size = PELX_func(pelx_disk_size)(images[entries[i].source]);
+		if (image_size > UINT32_MAX)
+		{
+			result = PELX_enum(invalid_data_format);
+			goto close;
+		}
+
+		PELX_func(write_uint64)(fp, entries[i].hash);
+		PELX_func(write_uint64)(fp, image_offset);
+		PELX_func(write_uint32)(fp, (uint32_t)image_size);
+		PELX_func(write_uint32)(fp, name_offset);
+
+		image_offset += image_size;
+		name_offset += (uint32_t)strlen(entries[i].name) + 1;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		fwrite(entries[i].name, 1, strlen(entries[i].name) + 1, fp);
+	}
+
+	for (uint32_t i = 0; i < count && result == PELX_enum(success); i++)
+	{
+		result = PELX_func(write_pelx)(fp, images[entries[i].source]);
+	}
+
+close:
+	if ((ferror(fp) || fclose(fp) != 0) && result == PELX_enum(success))
+	{
+		result = PELX_enum(io_error);
+	}
+
+	free(entries);
+	return result;
+}
+
+PELX_def PELX_type(result) PELX_func(open_pack)(const char *file, PELX_type(pack) *output)
+{
+	if (file == NULL || output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(pack_data) *pack = (PELX_type(pack_data) *)calloc(1, sizeof(PELX_type(pack_data)));
+	if (pack == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+#if defined (_WIN32)
+	HANDLE handle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		free(pack);
+		return PELX_enum(io_error);
+	}
+
+	LARGE_INTEGER file_size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(handle, &file_size) && file_size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(handle);
+
+	if (mapping == NULL)
+	{
+		free(pack);
+		return PELX_enum(io_error);
+	}
+
+	pack->data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	pack->size = (size_t)file_size.QuadPart;
+	pack->mapping = mapping;
+
+	if (pack->data == NULL)
+	{
+		CloseHandle(mapping);
+		free(pack);
+		return PELX_enum(io_error);
+	}
+#else
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+	{
+		free(pack);
+		return PELX_enum(io_error);
+	}
+
+	struct stat st;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		free(pack);
+		return PELX_enum(io_error);
+	}
+
+	pack->data = (const uint8_t *)data;
+	pack->size = (size_t)st.st_size;
+#endif
+
+	// Validate the header and the extent of the index and names block
+	if (pack->size < PELX_pack_header_size || memcmp(pack->data, "PELXPAK\0", 8) != 0 || PELX_func(load_uint32)(pack->data + 8) != 1)
+	{
+		PELX_func(close_pack)(&pack);
+		return PELX_enum(invalid_data_format);
+	}
+
+	pack->count = PELX_func(load_uint32)(pack->data + 12);
+	const uint64_t names_offset = PELX_func(load_uint64)(pack->data + 16);
+
+	if (names_offset != PELX_pack_header_size + (uint64_t)pack->count * PELX_pack_entry_size || names_offset > pack->size)
+	{
+		PELX_func(close_pack)(&pack);
+		return PELX_enum(invalid_data_format);
+	}
+
+	pack->index = pack->data + PELX_pack_header_size;
+	pack->names = pack->data + names_offset;
+	pack->names_size = pack->size - (size_t)names_offset;
+
+	*output = pack;
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(close_pack)(PELX_type(pack) *pack)
+{
+	if (pack == NULL || *pack == NULL)
+	{
+		return;
+	}
+
+#if defined (_WIN32)
+	UnmapViewOfFile((*pack)->data);
+	CloseHandle((HANDLE)(*pack)->mapping);
+#else
+	munmap((void *)(*pack)->data, (*pack)->size);
+#endif
+
+	free(*pack);
+	*pack = NULL;
+}
+
+PELX_def const char *PELX_func(pack_name)(PELX_type(pack) pack, uint32_t index)
+{
+	if (pack == NULL || index >= pack->count)
+	{
+		return NULL;
+	}
+
+	const uint32_t name_offset = PELX_func(load_uint32)(pack->index + (size_t)index * PELX_pack_entry_size + 20);
+	if (name_offset >= pack->names_size || memchr(pack->names + name_offset, '\0', pack->names_size - name_offset) == NULL)
+	{
+		return NULL;
+	}
+
+	return (const char *)pack->names + name_offset;
+}
+
+PELX_def PELX_type(result) PELX_func(pack_get)(PELX_type(pack) pack, uint32_t index, PELX_type(file_data) *view)
+{
+	if (pack == NULL || view == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (index >= pack->count)
+	{
+		return PELX_enum(entry_not_found);
+	}
+
+	const uint8_t *entry = pack->index + (size_t)index * PELX_pack_entry_size;
+	const uint64_t image_offset = PELX_func(load_uint64)(entry + 8);
+	const uint32_t image_size = PELX_func(load_uint32)(entry + 16);
+
+	if (image_offset > pack->size || image_size > pack->size - image_offset)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint8_t *image = pack->data + image_offset;
+
+	memset(view, 0, sizeof(*view));
+	if (PELX_func(parse_header)(image, image_size, &view->header) < 0 || view->header.header_size > image_size)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	// Embedded palettes are not loaded into views, that would need an allocation
+	view->body.data = (uint8_t *)(image + view->header.header_size);
+	view->body.size = image_size - view->header.header_size;
+	view->flags = PELX_file_view;
+
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(pack_find)(PELX_type(pack) pack, const char *name, PELX_type(file_data) *view)
+{
+	if (pack == NULL || name == NULL || view == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	const uint64_t hash = PELX_func(hash_bytes)(PELX_hash_seed, name, strlen(name));
+
+	// Find the first entry with the hash, then compare names over the (rare) run of equal hashes
+	uint32_t low = 0;
+	uint32_t high = pack->count;
+
+	while (low < high)
+	{
+		const uint32_t middle = low + (high - low) / 2;
+		if (PELX_func(load_uint64)(pack->index + (size_t)middle * PELX_pack_entry_size) < hash)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	for (uint32_t i = low; i < pack->count && PELX_func(load_uint64)(pack->index + (size_t)i * PELX_pack_entry_size) == hash; i++)
+	{
+		const char *entry_name = PELX_func(pack_name)(pack, i);
+		if (entry_name != NULL && strcmp(entry_name, name) == 0)
+		{
+			return PELX_func(pack_get)(pack, i, view);
+		}
+	}
+
+	return PELX_enum(entry_not_found);
+}
+
+// Atlases:
+//     Rectangles are placed tallest first on a skyline (the top edge of everything placed so far),
+//     each at the position that keeps it lowest. Decoding is then split over worker threads,
+//     which claim images one at a time and expand them in place with the atlas row stride.
+
+typedef struct
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+} PELX_type(skyline_segment);
+
+typedef struct
+{
+	PELX_type(atlas) atlas;
+	PELX_type(file_data) *const *images;
+	const uint16_t *palette_counts;
+	PELX_type(palette_entry) *const *palette_entries;
+	PELX_type(mutex) mutex;
+	uint32_t next;
+	PELX_type(result) result;
+} PELX_type(atlas_job);
+
+typedef struct
+{
+	uint16_t height;
+	uint16_t width;
+	uint32_t index;
+} PELX_type(atlas_sort_entry);
+
+// Orders tallest first, then widest, then by index so that equal sizes keep their input order
+static int PELX_func(compare_atlas_entries)(const void *a, const void *b)
+{
+	const PELX_type(atlas_sort_entry) *lhs = (const PELX_type(atlas_sort_entry) *)a;
+	const PELX_type(atlas_sort_entry) *rhs = (const PELX_type(atlas_sort_entry) *)b;
+
+	if (lhs->height != rhs->height)
+	{
+		return lhs->height > rhs->height ? -1 : 1;
+	}
+
+	if (lhs->width != rhs->width)
+	{
+		return lhs->width > rhs->width ? -1 : 1;
+	}
+
+	return lhs->index < rhs->index ? -1 : (lhs->index > rhs->index ? 1 : 0);
+}
+
+// Returns the y at which a rectangle of the given width rests when its left edge is on segment i, or UINT32_MAX
+static uint32_t PELX_func(skyline_fit)(const PELX_type(skyline_segment) *skyline, uint32_t segment_count, uint32_t i,
+                                       uint32_t width, uint32_t atlas_width)
+{
+	if (skyline[i].x + width > atlas_width)
+	{
+		return UINT32_MAX;
+	}
+
+	uint32_t y = 0;
+	uint32_t width_left = width;
+
+	for (; i < segment_count && width_left > 0; i++)
+	{
+		if (skyline[i].y > y)
+		{
+			y = skyline[i].y;
+		}
+
+		width_left = skyline[i].width >= width_left ? 0 : width_left - skyline[i].width;
+	}
+
+	return y;
+}
+
+// Places every rectangle, returns the atlas height or 0 when out of memory
+static uint32_t PELX_func(skyline_pack)(PELX_type(atlas_rect) *rects, const uint32_t *order, uint32_t count,
+                                        uint32_t atlas_width, uint8_t padding)
+{
+	// A placement splits at most one segment into three
+	PELX_type(skyline_segment) *skyline = (PELX_type(skyline_segment) *)malloc(((size_t)count * 2 + 1) * sizeof(PELX_type(skyline_segment)));
+	if (skyline == NULL)
+	{
+		return 0;
+	}
+
+	uint32_t segment_count = 1;
+	skyline[0].x = 0;
+	skyline[0].y = 0;
+	skyline[0].width = atlas_width;
+
+	uint32_t atlas_height = 0;
+
+	for (uint32_t n = 0; n < count; n++)
+	{
+		PELX_type(atlas_rect) *rect = &rects[order[n]];
+		const uint32_t width = (uint32_t)rect->width + padding;
+		const uint32_t height = (uint32_t)rect->height + padding;
+
+		uint32_t best_segment = 0;
+		uint32_t best_y = UINT32_MAX;
+
+		for (uint32_t i = 0; i < segment_count; i++)
+		{
+			uint32_t y = PELX_func(skyline_fit)(skyline, segment_count, i, width, atlas_width);
+			if (y < best_y)
+			{
+				best_y = y;
+				best_segment = i;
+			}
+		}
+
+		rect->x = skyline[best_segment].x;
+		rect->y = best_y;
+
+		if (best_y + height > atlas_height)
+		{
+			atlas_height = best_y + height;
+		}
+
+		// Insert the new top edge and trim the segments it covers
+		const uint32_t left = rect->x;
+		const uint32_t right = left + width;
+
+		memmove(&skyline[best_segment + 1], &skyline[best_segment], (segment_count - best_segment) * sizeof(PELX_type(skyline_segment)));
+		skyline[best_segment].x = left;
+		skyline[best_segment].y = best_y + height;
+		skyline[best_segment].width = width;
+		segment_count++;
+
+		uint32_t i = best_segment + 1;
+		while (i < segment_count && skyline[i].x < right)
+		{
+			const uint32_t end = skyline[i].x + skyline[i].width;
+			if (end <= right)
+			{
+				memmove(&skyline[i], &skyline[i + 1], (segment_count - i - 1) * sizeof(PELX_type(skyline_segment)));
+				segment_count--;
+			}
+			else
+			{
+				skyline[i].width = end - right;
+				skyline[i].x = right;
+				break;
+			}
+		}
+
+		// Merge neighbours of equal height
+		for (i = 0; i + 1 < segment_count;)
+		{
+			if (skyline[i].y == skyline[i + 1].y)
+			{
+				skyline[i].width += skyline[i + 1].width;
+				memmove(&skyline[i + 1], &skyline[i + 2], (segment_count - i - 2) * sizeof(PELX_type(skyline_segment)));
+				segment_count--;
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	free(skyline);
+	return atlas_height;
+}
+
+static PELX_thread_function(PELX_func(atlas_worker))
+{
+	PELX_type(atlas_job) *job = (PELX_type(atlas_job) *)argument;
+	PELX_type(atlas) atlas = job->atlas;
+	const size_t stride = (size_t)atlas->width * 4;
+
+	for (;;)
+	{
+		PELX_mutex_lock(&job->mutex);
+		const uint32_t index = job->next++;
+		const int failed = job->result != PELX_enum(success);
+		PELX_mutex_unlock(&job->mutex);
+
+		if (index >= atlas->count || failed)
+		{
+			break;
+		}
+
+		const PELX_type(file_data) *image = job->images[index];
+		const PELX_type(atlas_rect) *rect = &atlas->rects[index];
+
+		uint8_t lut[256][4];
+		PELX_func(resolve_palette)(job->palette_entries[index], job->palette_counts[index], image->header.palette_channel_count, lut);
+
+		PELX_type(result) result = PELX_func(expand_pixels)(image, (const uint8_t (*)[4])lut, job->palette_counts[index], 4,
+		                                                    atlas->pixels + (size_t)rect->y * stride + (size_t)rect->x * 4, stride);
+
+		if (result != PELX_enum(success))
+		{
+			PELX_mutex_lock(&job->mutex);
+			job->result = result;
+			PELX_mutex_unlock(&job->mutex);
+		}
+	}
+
+	return PELX_thread_result;
+}
+
+PELX_def PELX_type(result) PELX_func(build_atlas)(uint32_t count, PELX_type(file_data) *const *images,
+                                                  const uint16_t *palette_counts, PELX_type(palette_entry) *const *palette_entries,
+                                                  uint32_t max_width, uint8_t padding, uint32_t thread_count,
+                                                  PELX_type(atlas) *output)
+{
+	if (count == 0 || images == NULL || palette_counts == NULL || palette_entries == NULL || output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	uint64_t area = 0;
+	uint32_t widest = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (images[i] == NULL || palette_entries[i] == NULL)
+		{
+			return PELX_enum(io_error);
+		}
+
+		PELX_type(result) result = PELX_func(sanitize_header)(&images[i]->header);
+		if (result != PELX_enum(success))
+		{
+			return result;
+		}
+
+		if (images[i]->header.reserved[0] & PELX_flag_animated)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		const uint32_t width = (uint32_t)images[i]->header.width + padding;
+		area += (uint64_t)width * ((uint32_t)images[i]->header.height + padding);
+		if (width > widest)
+		{
+			widest = width;
+		}
+	}
+
+	// Without a limit, aim for a square power of two wide enough for the widest image
+	uint32_t atlas_width = max_width;
+	if (atlas_width == 0)
+	{
+		atlas_width = 1;
+		while ((uint64_t)atlas_width * atlas_width < area || atlas_width < widest)
+		{
+			atlas_width <<= 1;
+		}
+	}
+
+	if (atlas_width < widest)
+	{
+		return PELX_enum(header_invalid_size);
+	}
+
+	PELX_type(atlas_data) *atlas = (PELX_type(atlas_data) *)calloc(1, sizeof(PELX_type(atlas_data)));
+	uint32_t *order = (uint32_t *)malloc((size_t)count * sizeof(uint32_t));
+	PELX_type(atlas_sort_entry) *sort_entries = (PELX_type(atlas_sort_entry) *)malloc((size_t)count * sizeof(PELX_type(atlas_sort_entry)));
+	if (atlas == NULL || order == NULL || sort_entries == NULL)
+	{
+		free(atlas);
+		free(order);
+		free(sort_entries);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	atlas->count = count;
+	atlas->width = atlas_width;
+	atlas->rects = (PELX_type(atlas_rect) *)calloc(count, sizeof(PELX_type(atlas_rect)));
+	if (atlas->rects == NULL)
+	{
+		free(order);
+		free(sort_entries);
+		PELX_func(free_atlas)(&atlas);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	// Tallest first
+	for (uint32_t i = 0; i < count; i++)
+	{
+		atlas->rects[i].width = images[i]->header.width;
+		atlas->rects[i].height = images[i]->header.height;
+
+		sort_entries[i].height = images[i]->header.height;
+		sort_entries[i].width = images[i]->header.width;
+		sort_entries[i].index = i;
+	}
+
+	qsort(sort_entries, count, sizeof(PELX_type(atlas_sort_entry)), PELX_func(compare_atlas_entries));
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		order[i] = sort_entries[i].index;
+	}
+
+	free(sort_entries);
+
+	atlas->height = PELX_func(skyline_pack)(atlas->rects, order, count, atlas_width, padding);
+	free(order);
+
+	if (atlas->height == 0)
+	{
+		PELX_func(free_atlas)(&atlas);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		PELX_type(atlas_rect) *rect = &atlas->rects[i];
+		rect->u0 = (float)rect->x / (float)atlas->width;
+		rect->v0 = (float)rect->y / (float)atlas->height;
+		rect->u1 = (float)(rect->x + rect->width) / (float)atlas->width;
+		rect->v1 = (float)(rect->y + rect->height) / (float)atlas->height;
+	}
+
+	// Padding stays transparent black
+	atlas->pixels = (uint8_t *)calloc((size_t)atlas->width * atlas->height, 4);
+	if (atlas->pixels == NULL)
+	{
+		PELX_func(free_atlas)(&atlas);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_type(atlas_job) job;
+	job.atlas = atlas;
+	job.images = images;
+	job.palette_counts = palette_counts;
+	job.palette_entries = palette_entries;
+	job.next = 0;
+	job.result = PELX_enum(success);
+
+	if (PELX_mutex_init(&job.mutex) != 0)
+	{
+		PELX_func(free_atlas)(&atlas);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	if (thread_count == 0)
+	{
+		thread_count = PELX_func(cpu_count)();
+	}
+
+	if (thread_count > count)
+	{
+		thread_count = count;
+	}
+
+	// The calling thread is one of the workers
+	PELX_type(thread) *threads = NULL;
+	uint32_t started = 0;
+
+	if (thread_count > 1)
+	{
+		threads = (PELX_type(thread) *)malloc((size_t)(thread_count - 1) * sizeof(PELX_type(thread)));
+		for (; threads != NULL && started < thread_count - 1; started++)
+		{
+			if (PELX_func(thread_start)(&threads[started], PELX_func(atlas_worker), &job) != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	PELX_func(atlas_worker)(&job);
+
+	for (uint32_t i = 0; i < started; i++)
+	{
+		PELX_func(thread_join)(threads[i]);
+	}
+
+	free(threads);
+	PELX_mutex_destroy(&job.mutex);
+
+	if (job.result != PELX_enum(success))
+	{
+		PELX_func(free_atlas)(&atlas);
+		return job.result;
+	}
+
+	*output = atlas;
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(free_atlas)(PELX_type(atlas) *atlas)
+{
+	if (atlas == NULL || *atlas == NULL)
+	{
+		return;
+	}
+
+	free((*atlas)->pixels);
+	free((*atlas)->rects);
+	free(*atlas);
+	*atlas = NULL;
+}
+
+// Mipmaps:
+//     Level 0 is decoded row by row, and every finished pair of rows of a level is reduced right away into a row
+//     of the next level, so each row is filtered while it is still in cache and the chain is built in one pass.
+//     Level sizes halve rounding down (as OpenGL does), an odd last row or column is left out of the next level.
+//     The box filter averages 2x2 blocks with SSE2 for RGBA on x86; the palette filter keeps the most frequent
+//     colour of each block (the first one on ties), which suits pixel art and never invents colours.
+
+// Reduces the rows top and bottom of a level into one row of width pixels of the next level
+static void PELX_func(mip_reduce_row)(const uint8_t *top, const uint8_t *bottom, uint16_t source_width,
+                                      uint16_t width, uint8_t channels, PELX_type(mip_filter) filter, uint8_t *out)
+{
+	// A level one pixel wide is reduced vertically only
+	const size_t step = source_width > 1 ? channels : 0;
+	uint16_t x = 0;
+
+	if (filter == PELX_enum(mip_palette))
+	{
+		for (; x < width; x++)
+		{
+			const uint8_t *block[4] =
+			{
+				top + (size_t)x * 2 * channels, top + (size_t)x * 2 * channels + step,
+				bottom + (size_t)x * 2 * channels, bottom + (size_t)x * 2 * channels + step
+			};
+
+			// Pixels as integers, so that comparing them is one instruction
+			uint32_t value[4];
+			for (int i = 0; i < 4; i++)
+			{
+				value[i] = (uint32_t)block[i][0] | (uint32_t)block[i][1] << 8 | (uint32_t)block[i][2] << 16 |
+				           (channels == 4 ? (uint32_t)block[i][3] << 24 : 0);
+			}
+
+			int best = 0;
+			int best_count = 0;
+
+			for (int i = 0; i < 4 && best_count < 3; i++)
+			{
+				int count = 1;
+				for (int j = i + 1; j < 4; j++)
+				{
+					count += value[i] == value[j];
+				}
+
+				if (count > best_count)
+				{
+					best = i;
+					best_count = count;
+				}
+			}
+
+			memcpy(out + (size_t)x * channels, block[best], channels);
+		}
+
+		return;
+	}
+
+#if defined (PELX_simd_sse2)
+	if (channels == 4 && step != 0)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+
+		// Four output pixels from eight pixels of each row, summed in 16 bits
+		for (; x + 4 <= width; x += 4)
+		{
+			const __m128i a0 = _mm_loadu_si128((const __m128i *)(top + (size_t)x * 8));
+			const __m128i a1 = _mm_loadu_si128((const __m128i *)(top + (size_t)x * 8 + 16));
+			const __m128i b0 = _mm_loadu_si128((const __m128i *)(bottom + (size_t)x * 8));
+			const __m128i b1 = _mm_loadu_si128((const __m128i *)(bottom + (size_t)x * 8 + 16));
+
+			// Column sums, two source pixels per vector
+			const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+			// Neighbouring columns added, one output pixel per 64 bits
+			__m128i p01 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+			__m128i p23 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+			p01 = _mm_srli_epi16(_mm_add_epi16(p01, two), 2);
+			p23 = _mm_srli_epi16(_mm_add_epi16(p23, two), 2);
+
+			_mm_storeu_si128((__m128i *)(out + (size_t)x * 4), _mm_packus_epi16(p01, p23));
+		}
+	}
+#endif // PELX_simd_sse2
+
+	for (; x < width; x++)
+	{
+		const uint8_t *a = top + (size_t)x * 2 * channels;
+		const uint8_t *b = bottom + (size_t)x * 2 * channels;
+
+		for (uint8_t c = 0; c < channels; c++)
+		{
+			out[(size_t)x * channels + c] = (uint8_t)((a[c] + a[step + c] + b[c] + b[step + c] + 2) >> 2);
+		}
+	}
+}
+
+PELX_def PELX_type(result) PELX_func(build_mipmaps)(PELX_type(file_data) *input_data,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t channels, PELX_type(mip_filter) filter, PELX_type(mipmap) *output)
+{
+	if (input_data == NULL || palette_entries == NULL || output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	*output = NULL;
+
+	if (channels != 3 && channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	if (filter != PELX_enum(mip_box) && filter != PELX_enum(mip_palette))
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	if (input_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	PELX_type(mipmap_data) *mipmap = (PELX_type(mipmap_data) *)calloc(1, sizeof(PELX_type(mipmap_data)));
+	if (mipmap == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	mipmap->channels = channels;
+
+	uint16_t width = input_data->header.width;
+	uint16_t height = input_data->header.height;
+	size_t size = 0;
+
+	for (;;)
+	{
+		PELX_type(mip_level) *level = &mipmap->levels[mipmap->level_count++];
+		level->width = width;
+		level->height = height;
+		level->offset = size;
+		size += (size_t)width * height * channels;
+
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	mipmap->size = size;
+	mipmap->pixels = (uint8_t *)malloc(size);
+	if (mipmap->pixels == NULL)
+	{
+		PELX_func(free_mipmaps)(&mipmap);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(palette_entries, palette_count, input_data->header.palette_channel_count, lut);
+
+	const uint8_t true_channels = input_data->header.true_channel_count;
+	const uint8_t *src = input_data->body.data;
+	const size_t src_size = input_data->body.size;
+	size_t src_pos = 0;
+
+	PELX_trace_begin("render");
+
+	for (uint16_t y = 0; y < mipmap->levels[0].height && result == PELX_enum(success); y++)
+	{
+		uint8_t *row = mipmap->pixels + (size_t)y * mipmap->levels[0].width * channels;
+
+		for (uint16_t x = 0; x < mipmap->levels[0].width; x++)
+		{
+			if (src_pos >= src_size)
+			{
+				result = PELX_enum(invalid_data_format);
+				break;
+			}
+
+			result = PELX_func(decode_pixel)(src, src_size, &src_pos, true_channels, (const uint8_t (*)[4])lut, palette_count,
+			                                 channels, row + (size_t)x * channels);
+			if (result != PELX_enum(success))
+			{
+				break;
+			}
+		}
+
+		if (result != PELX_enum(success))
+		{
+			break;
+		}
+
+		// Carry the finished row down the chain for as long as it completes a pair of rows
+		uint16_t level_row = y;
+		for (uint8_t l = 0; l + 1 < mipmap->level_count; l++)
+		{
+			const PELX_type(mip_level) *level = &mipmap->levels[l];
+			const PELX_type(mip_level) *next = &mipmap->levels[l + 1];
+
+			if (((level_row & 1) == 0 && level->height > 1) || level_row / 2 >= next->height)
+			{
+				break;
+			}
+
+			level_row /= 2;
+
+			const size_t stride = (size_t)level->width * channels;
+			const uint8_t *bottom = mipmap->pixels + level->offset + (size_t)(level->height > 1 ? level_row * 2 + 1 : 0) * stride;
+			const uint8_t *top = level->height > 1 ? bottom - stride : bottom;
+
+			PELX_func(mip_reduce_row)(top, bottom, level->width, next->width, channels, filter,
+			                          mipmap->pixels + next->offset + (size_t)level_row * next->width * channels);
+		}
+	}
+
+	PELX_trace_end("render");
+
+	if (result != PELX_enum(success))
+	{
+		PELX_func(free_mipmaps)(&mipmap);
+		return result;
+	}
+
+	*output = mipmap;
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(free_mipmaps)(PELX_type(mipmap) *mipmap)
+{
+	if (mipmap == NULL || *mipmap == NULL)
+	{
+		return;
+	}
+
+	free((*mipmap)->pixels);
+	free(*mipmap);
+	*mipmap = NULL;
+}
+
+// Render cache:
+//     Rendered pixels are keyed by two 64-bit content hashes, one of the header and pixel data and one
+//     of the palette entries (with the palette and output channel counts), so equal inputs hit regardless of
+//     where they were loaded from. Every entry keeps a copy of its pixel data and palette entries, and a hash
+//     match only counts as a hit when both compare equal, so colliding or crafted inputs never share pixels.
+//     decode_png_cached keys on the identity of the file (path, size, modification time, and on POSIX the status
+//     change time, device and inode) instead of its content, so a hit needs neither reading nor parsing it. Times
+//     are taken in nanoseconds where the platform has them (st_mtim with _POSIX_C_SOURCE 200809L, the st_mtimespec
+//     family on macOS, 100 ns on Windows), so only a rewrite of the same size within one clock tick goes unnoticed.
+//     Keys are spread over independently locked shards, each with its own slice of the byte budget and its own
+//     LRU list. Entries are reference counted: an entry evicted while a caller still holds its pixels is only
+//     unlinked, and freed by the last release_png_cached.
+
+#define PELX_render_cache_shards 16
+
+#define PELX_render_cache_from_body 0
+#define PELX_render_cache_from_file 1
+
+// Everything a render is looked up by, the source is the pixel data or the identity of a file
+typedef struct
+{
+	uint8_t fields[11]; // source kind, width, height, true channels, flags, palette count, palette and png channels
+	const void *source;
+	size_t source_size;
+	const void *palette;
+	size_t palette_size;
+	uint64_t source_hash;
+	uint64_t palette_hash;
+	uint32_t shard;
+} PELX_type(render_cache_key);
+
+typedef struct PELX_type(render_cache_entry)
+{
+	uint64_t source_hash;
+	uint64_t palette_hash;
+	uint8_t fields[11];
+	uint32_t references;
+	uint32_t shard;
+	int linked; // in the shard table and LRU list
+	size_t size; // counted against the budget: pixels, source and palette
+	size_t pixels_size;
+	size_t source_size;
+	size_t palette_size;
+	struct PELX_type(render_cache_entry) *chain; // next in the same bucket
+	struct PELX_type(render_cache_entry) *newer;
+	struct PELX_type(render_cache_entry) *older;
+	uint8_t pixels[]; // followed by the copies of the source and the palette entries
+} PELX_type(render_cache_entry);
+
+typedef struct
+{
+	PELX_type(mutex) mutex;
+	PELX_type(render_cache_entry) **buckets;
+	uint32_t bucket_count; // power of two
+	uint32_t count;
+	size_t bytes;
+	PELX_type(render_cache_entry) *newest;
+	PELX_type(render_cache_entry) *oldest;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} PELX_type(render_cache_shard);
+
+struct PELX_type(render_cache_data)
+{
+	size_t shard_budget;
+	PELX_type(render_cache_shard) shards[PELX_render_cache_shards];
+};
+
+// Removes an entry from its shard, called with the shard lock held
+static void PELX_func(render_cache_unlink)(PELX_type(render_cache_shard) *shard, PELX_type(render_cache_entry) *entry)
+{
+	PELX_type(render_cache_entry) **link = &shard->buckets[entry->source_hash & (shard->bucket_count - 1)];
+	while (*link != entry)
+	{
+		link = &(*link)->chain;
+	}
+	*link = entry->chain;
+
+	if (entry->newer != NULL) entry->newer->older = entry->older; else shard->newest = entry->older;
+	if (entry->older != NULL) entry->older->newer = entry->newer; else shard->oldest = entry->newer;
+
+	entry->chain = entry->newer = entry->older = NULL;
+	entry->linked = 0;
+	shard->count--;
+	shard->bytes -= entry->size;
+}
+
+// Moves an entry to the front of the LRU list, called with the shard lock held
+static void PELX_func(render_cache_touch)(PELX_type(render_cache_shard) *shard, PELX_type(render_cache_entry) *entry)
+{
+	if (shard->newest == entry)
+	{
+		return;
+	}
+
+	if (entry->newer != NULL) entry->newer->older = entry->older;
+	if (entry->older != NULL) entry->older->newer = entry->newer; else shard->oldest = entry->newer;
+
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	shard->newest->newer = entry;
+	shard->newest = entry;
+}
+
+// Doubles the bucket table of a shard, called with the shard lock held
+static void PELX_func(render_cache_grow)(PELX_type(render_cache_shard) *shard)
+{
+	uint32_t bucket_count = shard->bucket_count * 2;
+
+	PELX_type(render_cache_entry) **buckets = (PELX_type(render_cache_entry) **)calloc(bucket_count, sizeof(*buckets));
+	if (buckets == NULL)
+	{
+		return; // longer chains, still correct
+	}
+
+	for (uint32_t i = 0; i < shard->bucket_count; i++)
+	{
+		PELX_type(render_cache_entry) *entry = shard->buckets[i];
+		while (entry != NULL)
+		{
+			PELX_type(render_cache_entry) *chain = entry->chain;
+			PELX_type(render_cache_entry) **bucket = &buckets[entry->source_hash & (bucket_count - 1)];
+			entry->chain = *bucket;
+			*bucket = entry;
+			entry = chain;
+		}
+	}
+
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->bucket_count = bucket_count;
+}
+
+PELX_def PELX_type(result) PELX_func(create_render_cache)(size_t byte_budget, PELX_type(render_cache) *output)
+{
+	if (output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_type(render_cache) cache = (PELX_type(render_cache))calloc(1, sizeof(struct PELX_type(render_cache_data)));
+	if (cache == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	cache->shard_budget = byte_budget / PELX_render_cache_shards;
+
+	// Every mutex is set up before free_render_cache can be reached, which destroys them all
+	for (uint32_t i = 0; i < PELX_render_cache_shards; i++)
+	{
+		if (PELX_mutex_init(&cache->shards[i].mutex) != 0)
+		{
+			while (i-- > 0)
+			{
+				PELX_mutex_destroy(&cache->shards[i].mutex);
+			}
+
+			free(cache);
+			return PELX_enum(memory_allocation_failed);
+		}
+	}
+
+	for (uint32_t i = 0; i < PELX_render_cache_shards; i++)
+	{
+		cache->shards[i].bucket_count = 16;
+		cache->shards[i].buckets = (PELX_type(render_cache_entry) **)calloc(16, sizeof(PELX_type(render_cache_entry) *));
+
+		if (cache->shards[i].buckets == NULL)
+		{
+			PELX_func(free_render_cache)(&cache);
+			return PELX_enum(memory_allocation_failed);
+		}
+	}
+
+	*output = cache;
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(free_render_cache)(PELX_type(render_cache) *cache)
+{
+	if (cache == NULL || *cache == NULL)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < PELX_render_cache_shards; i++)
+	{
+		PELX_type(render_cache_shard) *shard = &(*cache)->shards[i];
+
+		PELX_type(render_cache_entry) *entry = shard->newest;
+		while (entry != NULL)
+		{
+			PELX_type(render_cache_entry) *older = entry->older;
+			free(entry);
+			entry = older;
+		}
+
+		free(shard->buckets);
+		PELX_mutex_destroy(&shard->mutex);
+	}
+
+	free(*cache);
+	*cache = NULL;
+}
+
+// Hashes a key and picks its shard
+static void PELX_func(hash_render_cache_key)(PELX_type(render_cache_key) *key)
+{
+	key->source_hash = PELX_func(hash_words)(PELX_func(hash_bytes)(PELX_hash_seed, key->fields, 7), key->source, key->source_size);
+	key->palette_hash = PELX_func(hash_words)(PELX_func(hash_bytes)(PELX_hash_seed, key->fields + 7, 4), key->palette, key->palette_size);
+	key->shard = (uint32_t)((key->source_hash ^ key->palette_hash) >> 60) & (PELX_render_cache_shards - 1);
+}
+
+// Returns non-zero when an entry holds the render of key, comparing the content behind equal hashes
+static int PELX_func(render_cache_matches)(const PELX_type(render_cache_entry) *entry, const PELX_type(render_cache_key) *key)
+{
+	const uint8_t *source = entry->pixels + entry->pixels_size;
+	const uint8_t *palette = source + entry->source_size;
+
+	return entry->source_hash == key->source_hash && entry->palette_hash == key->palette_hash &&
+	       entry->source_size == key->source_size && entry->palette_size == key->palette_size &&
+	       memcmp(entry->fields, key->fields, sizeof(entry->fields)) == 0 &&
+	       memcmp(source, key->source, key->source_size) == 0 &&
+	       memcmp(palette, key->palette, key->palette_size) == 0;
+}
+
+// Returns the entry holding the render of key with a reference taken, or NULL
+static PELX_type(render_cache_entry) *PELX_func(render_cache_find)(PELX_type(render_cache) cache, const PELX_type(render_cache_key) *key)
+{
+	PELX_type(render_cache_shard) *shard = &cache->shards[key->shard];
+	PELX_type(render_cache_entry) *entry;
+
+	PELX_mutex_lock(&shard->mutex);
+
+	for (entry = shard->buckets[key->source_hash & (shard->bucket_count - 1)]; entry != NULL; entry = entry->chain)
+	{
+		if (PELX_func(render_cache_matches)(entry, key))
+		{
+			entry->references++;
+			PELX_func(render_cache_touch)(shard, entry);
+			break;
+		}
+	}
+
+	if (entry != NULL)
+	{
+		shard->hits++;
+	}
+	else
+	{
+		shard->misses++;
+	}
+
+	PELX_mutex_unlock(&shard->mutex);
+	return entry;
+}
+
+// Renders an image missing from the cache and adds it under key
+static PELX_type(result) PELX_func(render_cache_insert)(PELX_type(render_cache) cache, const PELX_type(render_cache_key) *key,
+                                                        PELX_type(file_data) *data, uint16_t palette_count,
+                                                        const PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t png_channels, const uint8_t **png_buffer)
+{
+	PELX_type(render_cache_shard) *shard = &cache->shards[key->shard];
+
+	// Render outside the lock, other threads may render the same key meanwhile
+	const size_t pixels_size = (size_t)data->header.width * data->header.height * png_channels;
+	const size_t size = pixels_size + key->source_size + key->palette_size;
+
+	PELX_type(render_cache_entry) *entry = (PELX_type(render_cache_entry) *)malloc(sizeof(PELX_type(render_cache_entry)) + size);
+	if (entry == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_type(result) result;
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(palette_entries, palette_count, data->header.palette_channel_count, lut);
+
+	if (data->header.reserved[0] & PELX_flag_animated)
+	{
+		result = PELX_enum(invalid_data_format);
+	}
+	else
+	{
+		result = PELX_func(expand_pixels)(data, (const uint8_t (*)[4])lut, palette_count, png_channels,
+		                                  entry->pixels, (size_t)data->header.width * png_channels);
+	}
+
+	if (result != PELX_enum(success))
+	{
+		free(entry);
+		return result;
+	}
+
+	memcpy(entry->pixels + pixels_size, key->source, key->source_size);
+	memcpy(entry->pixels + pixels_size + key->source_size, key->palette, key->palette_size);
+
+	entry->source_hash = key->source_hash;
+	entry->palette_hash = key->palette_hash;
+	memcpy(entry->fields, key->fields, sizeof(entry->fields));
+	entry->references = 1;
+	entry->shard = key->shard;
+	entry->linked = 0;
+	entry->size = size;
+	entry->pixels_size = pixels_size;
+	entry->source_size = key->source_size;
+	entry->palette_size = key->palette_size;
+	entry->chain = entry->newer = entry->older = NULL;
+
+	PELX_mutex_lock(&shard->mutex);
+
+	PELX_type(render_cache_entry) **bucket = &shard->buckets[key->source_hash & (shard->bucket_count - 1)];
+
+	for (PELX_type(render_cache_entry) *existing = *bucket; existing != NULL; existing = existing->chain)
+	{
+		if (PELX_func(render_cache_matches)(existing, key))
+		{
+			// Lost the race, share the entry that got in first
+			existing->references++;
+			PELX_func(render_cache_touch)(shard, existing);
+			PELX_mutex_unlock(&shard->mutex);
+
+			free(entry);
+			*png_buffer = existing->pixels;
+			return PELX_enum(success);
+		}
+	}
+
+	// Images larger than the shard budget are handed out uncached
+	if (size <= cache->shard_budget)
+	{
+		while (shard->bytes + size > cache->shard_budget)
+		{
+			PELX_type(render_cache_entry) *oldest = shard->oldest;
+			PELX_func(render_cache_unlink)(shard, oldest);
+			shard->evictions++;
+
+			if (oldest->references == 0)
+			{
+				free(oldest);
+			}
+		}
+
+		if (shard->count + 1 > shard->bucket_count)
+		{
+			PELX_func(render_cache_grow)(shard);
+			bucket = &shard->buckets[key->source_hash & (shard->bucket_count - 1)];
+		}
+
+		entry->chain = *bucket;
+		*bucket = entry;
+
+		entry->older = shard->newest;
+		if (shard->newest != NULL) shard->newest->newer = entry; else shard->oldest = entry;
+		shard->newest = entry;
+
+		entry->linked = 1;
+		shard->count++;
+		shard->bytes += size;
+	}
+
+	PELX_mutex_unlock(&shard->mutex);
+
+	*png_buffer = entry->pixels;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(to_png_cached)(PELX_type(render_cache) cache, PELX_type(file) *pelx_data,
+                                                    uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                    uint8_t png_channels, const uint8_t **png_buffer)
+{
+	if (cache == NULL || pelx_data == NULL || *pelx_data == NULL || palette_entries == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	*png_buffer = NULL;
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_type(file_data) *data = *pelx_data;
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	PELX_type(render_cache_key) key =
+	{
+		{
+			PELX_render_cache_from_body,
+			(uint8_t)(data->header.width >> 8), (uint8_t)data->header.width,
+			(uint8_t)(data->header.height >> 8), (uint8_t)data->header.height,
+			data->header.true_channel_count, data->header.reserved[0],
+			(uint8_t)(palette_count >> 8), (uint8_t)palette_count,
+			data->header.palette_channel_count, png_channels
+		},
+		data->body.data, data->body.size,
+		palette_entries, (size_t)palette_count * sizeof(PELX_type(palette_entry)),
+		0, 0, 0
+	};
+
+	PELX_func(hash_render_cache_key)(&key);
+
+	PELX_type(render_cache_entry) *entry = PELX_func(render_cache_find)(cache, &key);
+	if (entry != NULL)
+	{
+		*png_buffer = entry->pixels;
+		return PELX_enum(success);
+	}
+
+	return PELX_func(render_cache_insert)(cache, &key, data, palette_count, palette_entries, png_channels, png_buffer);
+}
+
+#define PELX_file_stamp_fields 7
+
+// Size, modification time and (on POSIX) status change time, device and inode of a file, 0 when it does not exist
+static int PELX_func(file_stamp)(const char *path, uint64_t stamp[PELX_file_stamp_fields])
+{
+#if defined (_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+	{
+		return 0;
+	}
+
+	stamp[0] = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	stamp[1] = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	memset(stamp + 2, 0, (PELX_file_stamp_fields - 2) * sizeof(uint64_t));
+#else
+	struct stat status;
+	if (stat(path, &status) != 0)
+	{
+		return 0;
+	}
+
+	stamp[0] = (uint64_t)status.st_size;
+	stamp[1] = (uint64_t)status.st_mtime;
+	stamp[3] = (uint64_t)status.st_ctime;
+#if defined (__APPLE__) && (!defined (_POSIX_C_SOURCE) || defined (_DARWIN_C_SOURCE))
+	stamp[2] = (uint64_t)status.st_mtimespec.tv_nsec;
+	stamp[4] = (uint64_t)status.st_ctimespec.tv_nsec;
+#elif defined (__APPLE__)
+	stamp[2] = (uint64_t)status.st_mtimensec;
+	stamp[4] = (uint64_t)status.st_ctimensec;
+#elif defined (_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L
+	stamp[2] = (uint64_t)status.st_mtim.tv_nsec;
+	stamp[4] = (uint64_t)status.st_ctim.tv_nsec;
+#elif defined (__GLIBC__)
+	stamp[2] = (uint64_t)status.st_mtimensec; // glibc's name without the POSIX 2008 feature set
+	stamp[4] = (uint64_t)status.st_ctimensec;
+#else
+	stamp[2] = 0; // whole seconds only
+	stamp[4] = 0;
+#endif
+	stamp[5] = (uint64_t)status.st_dev;
+	stamp[6] = (uint64_t)status.st_ino;
+#endif
+	return 1;
+}
+
+PELX_def PELX_type(result) PELX_func(decode_png_cached)(PELX_type(render_cache) cache, const char *file,
+                                                        uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                        uint8_t png_channels, const uint8_t **png_buffer)
+{
+	if (cache == NULL || file == NULL || palette_entries == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	*png_buffer = NULL;
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	// The identity of the file: its stamp followed by its path
+	const size_t path_length = strlen(file);
+	uint8_t *identity = (uint8_t *)malloc(sizeof(uint64_t) * PELX_file_stamp_fields + path_length);
+	if (identity == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	uint64_t stamp[PELX_file_stamp_fields];
+	if (!PELX_func(file_stamp)(file, stamp))
+	{
+		free(identity);
+		return PELX_enum(io_error);
+	}
+
+	memcpy(identity, stamp, sizeof(stamp));
+	memcpy(identity + sizeof(stamp), file, path_length);
+
+	PELX_type(render_cache_key) key =
+	{
+		{
+			PELX_render_cache_from_file, 0, 0, 0, 0, 0, 0,
+			(uint8_t)(palette_count >> 8), (uint8_t)palette_count, 0, png_channels
+		},
+		identity, sizeof(stamp) + path_length,
+		palette_entries, (size_t)palette_count * sizeof(PELX_type(palette_entry)),
+		0, 0, 0
+	};
+
+	PELX_func(hash_render_cache_key)(&key);
+
+	PELX_type(render_cache_entry) *entry = PELX_func(render_cache_find)(cache, &key);
+	if (entry != NULL)
+	{
+		free(identity);
+		*png_buffer = entry->pixels;
+		return PELX_enum(success);
+	}
+
+	PELX_type(file) pelx_file = NULL;
+
+	PELX_type(result) result = PELX_func(decode_pelx)(file, &pelx_file);
+	if (result == PELX_enum(success))
+	{
+		result = PELX_func(render_cache_insert)(cache, &key, pelx_file, palette_count, palette_entries, png_channels, png_buffer);
+	}
+
+	PELX_func(free_file)(&pelx_file);
+	free(identity);
+	return result;
+}
+
+PELX_def void PELX_func(release_png_cached)(PELX_type(render_cache) cache, const uint8_t *png_buffer)
+{
+	if (cache == NULL || png_buffer == NULL)
+	{
+		return;
+	}
+
+	PELX_type(render_cache_entry) *entry = (PELX_type(render_cache_entry) *)(png_buffer - offsetof(PELX_type(render_cache_entry), pixels));
+	PELX_type(render_cache_shard) *shard = &cache->shards[entry->shard];
+
+	PELX_mutex_lock(&shard->mutex);
+	const int unused = --entry->references == 0 && !entry->linked;
+	PELX_mutex_unlock(&shard->mutex);
+
+	if (unused)
+	{
+		free(entry);
+	}
+}
+
+PELX_def void PELX_func(render_cache_stats)(PELX_type(render_cache) cache, PELX_type(render_cache_stats) *stats)
+{
+	if (cache == NULL || stats == NULL)
+	{
+		return;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (uint32_t i = 0; i < PELX_render_cache_shards; i++)
+	{
+		PELX_type(render_cache_shard) *shard = &cache->shards[i];
+
+		PELX_mutex_lock(&shard->mutex);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->entries += shard->count;
+		stats->bytes += shard->bytes;
+		PELX_mutex_unlock(&shard->mutex);
+	}
+}
+
+// Animations:
+//     Frames are compared pixel by pixel on their tagged encodings, so a pixel counts as changed
+//     whenever its bytes differ. Playback decodes the first frame once and then only touches
+//     the pixels named by each delta, skipped runs cost a single pointer increment.
+
+#define PELX_animation_frame_entry_size 6
+
+// Returns the size of the tagged pixel at src[pos], or 0 when it is truncated or invalid
+static size_t PELX_func(tagged_pixel_size)(const uint8_t *src, size_t src_size, size_t pos, uint8_t true_channels)
+{
+	size_t size;
+	switch (src[pos])
+	{
+		case PELX_tag_void: size = 1; break;
+		case PELX_tag_true: size = 1 + (size_t)true_channels; break;
+		case PELX_tag_pale: size = 2; break;
+		default: return 0;
+	}
+
+	return pos + size <= src_size ? size : 0;
+}
+
+// Indexes the byte offset of every pixel of a frame, offsets has pixel_count + 1 entries
+static PELX_type(result) PELX_func(index_pixels)(const PELX_type(file_data) *frame, size_t pixel_count, size_t *offsets)
+{
+	size_t pos = 0;
+
+	for (size_t i = 0; i < pixel_count; i++)
+	{
+		if (pos >= frame->body.size)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		size_t size = PELX_func(tagged_pixel_size)(frame->body.data, frame->body.size, pos, frame->header.true_channel_count);
+		if (size == 0)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		offsets[i] = pos;
+		pos += size;
+	}
+
+	offsets[pixel_count] = pos;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_animation)(const char *file, uint16_t frame_count,
+                                                       PELX_type(file_data) *const *frames, const uint16_t *delays)
+{
+	if (file == NULL || frames == NULL || delays == NULL || frame_count == 0)
+	{
+		return PELX_enum(io_error);
+	}
+
+	const PELX_type(header) *header = &frames[0]->header;
+
+	for (uint16_t f = 0; f < frame_count; f++)
+	{
+		if (frames[f] == NULL)
+		{
+			return PELX_enum(io_error);
+		}
+
+		PELX_type(result) result = PELX_func(sanitize_header)(&frames[f]->header);
+		if (result != PELX_enum(success))
+		{
+			return result;
+		}
+
+		if (frames[f]->header.width != header->width || frames[f]->header.height != header->height ||
+		    frames[f]->header.true_channel_count != header->true_channel_count)
+		{
+			return PELX_enum(header_invalid_size);
+		}
+	}
+
+	const size_t pixel_count = (size_t)header->width * header->height;
+
+	size_t *previous = (size_t *)malloc((pixel_count + 1) * sizeof(size_t));
+	size_t *current = (size_t *)malloc((pixel_count + 1) * sizeof(size_t));
+
+	// A delta frame is never larger than its full frame plus one skip op per pixel
+	size_t capacity = 2 + (size_t)frame_count * PELX_animation_frame_entry_size;
+	for (uint16_t f = 0; f < frame_count; f++)
+	{
+		capacity += frames[f]->body.size + 3 * pixel_count;
+	}
+
+	uint8_t *body = (uint8_t *)malloc(capacity);
+
+	PELX_type(result) result = PELX_enum(success);
+
+	if (previous == NULL || current == NULL || body == NULL)
+	{
+		result = PELX_enum(memory_allocation_failed);
+		goto cleanup;
+	}
+
+	body[0] = (uint8_t)(frame_count >> 8);
+	body[1] = (uint8_t)frame_count;
+
+	size_t pos = 2 + (size_t)frame_count * PELX_animation_frame_entry_size;
+
+	for (uint16_t f = 0; f < frame_count; f++)
+	{
+		const PELX_type(file_data) *frame = frames[f];
+		const size_t frame_start = pos;
+
+		result = PELX_func(index_pixels)(frame, pixel_count, current);
+		if (result != PELX_enum(success))
+		{
+			goto cleanup;
+		}
+
+		if (f == 0)
+		{
+			memcpy(&body[pos], frame->body.data, current[pixel_count]);
+			pos += current[pixel_count];
+		}
+		else
+		{
+			const PELX_type(file_data) *before = frames[f - 1];
+			size_t skip = 0;
+
+			for (size_t i = 0; i < pixel_count; i++)
+			{
+				const size_t size = current[i + 1] - current[i];
+				const int unchanged = size == previous[i + 1] - previous[i] &&
+				                      memcmp(&frame->body.data[current[i]], &before->body.data[previous[i]], size) == 0;
+
+				if (unchanged)
+				{
+					skip++;
+					continue;
+				}
+
+				while (skip > 0)
+				{
+					const size_t run = skip < UINT16_MAX ? skip : UINT16_MAX;
+					body[pos++] = PELX_tag_skip;
+					body[pos++] = (uint8_t)(run >> 8);
+					body[pos++] = (uint8_t)run;
+					skip -= run;
+				}
+
+				memcpy(&body[pos], &frame->body.data[current[i]], size);
+				pos += size;
+			}
+			// Trailing unchanged pixels are implied
+		}
+
+		const size_t frame_size = pos - frame_start;
+		uint8_t *entry = &body[2 + (size_t)f * PELX_animation_frame_entry_size];
+		entry[0] = (uint8_t)(delays[f] >> 8);
+		entry[1] = (uint8_t)delays[f];
+		entry[2] = (uint8_t)(frame_size >> 24);
+		entry[3] = (uint8_t)(frame_size >> 16);
+		entry[4] = (uint8_t)(frame_size >> 8);
+		entry[5] = (uint8_t)frame_size;
+
+		size_t *swap = previous;
+		previous = current;
+		current = swap;
+	}
+
+	if (pos > UINT32_MAX)
+	{
+		result = PELX_enum(invalid_data_format);
+		goto cleanup;
+	}
+
+	// Write the container as the first frame with its body replaced and the animated flag set
+	PELX_type(file_data) container = *frames[0];
+	container.header.reserved[0] |= PELX_flag_animated;
+	container.body.data = body;
+	container.body.size = (uint32_t)pos;
+
+	result = PELX_func(encode_pelx)(file, &container);
+
+cleanup:
+	free(previous);
+	free(current);
+	free(body);
+	return result;
+}
+
+// Applies a delta frame onto the current pixels
+static PELX_type(result) PELX_func(apply_delta)(PELX_type(animation) animation, const uint8_t *src, size_t src_size)
+{
+	const PELX_type(header) *header = &animation->file->header;
+	const uint8_t channels = animation->channels;
+	const size_t pixel_count = (size_t)header->width * header->height;
+
+	size_t src_pos = 0;
+	size_t pixel = 0;
+
+	while (src_pos < src_size)
+	{
+		if (src[src_pos] == PELX_tag_skip)
+		{
+			if (src_pos + 3 > src_size)
+			{
+				return PELX_enum(invalid_data_format);
+			}
+
+			pixel += PELX_func(load_uint16)(&src[src_pos + 1]);
+			src_pos += 3;
+			continue;
+		}
+
+		if (pixel >= pixel_count)
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		PELX_type(result) result = PELX_func(decode_pixel)(src, src_size, &src_pos, header->true_channel_count,
+		                                                   (const uint8_t (*)[4])animation->lut, animation->lut_count,
+		                                                   channels, &animation->pixels[pixel * channels]);
+		if (result != PELX_enum(success))
+		{
+			return result;
+		}
+
+		pixel++;
+	}
+
+	return pixel <= pixel_count ? PELX_enum(success) : PELX_enum(invalid_data_format);
+}
+
+PELX_def PELX_type(result) PELX_func(open_animation)(PELX_type(file_data) *pelx_data,
+                                                     uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                     uint8_t png_channels, PELX_type(animation) *output)
+{
+	if (pelx_data == NULL || palette_entries == NULL || output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&pelx_data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	const uint8_t *body = pelx_data->body.data;
+	const size_t body_size = pelx_data->body.size;
+
+	if ((pelx_data->header.reserved[0] & PELX_flag_animated) == 0 || body_size < 2)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint16_t frame_count = PELX_func(load_uint16)(body);
+	size_t pos = 2 + (size_t)frame_count * PELX_animation_frame_entry_size;
+
+	if (frame_count == 0 || pos > body_size)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	PELX_type(animation_data) *animation = (PELX_type(animation_data) *)calloc(1, sizeof(PELX_type(animation_data)));
+	if (animation == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	animation->file = pelx_data;
+	animation->frame_count = frame_count;
+	animation->channels = png_channels;
+	animation->lut_count = palette_count;
+	animation->delays = (uint16_t *)malloc(frame_count * sizeof(uint16_t));
+	animation->frames = (const uint8_t **)malloc(frame_count * sizeof(const uint8_t *));
+	animation->frame_sizes = (uint32_t *)malloc(frame_count * sizeof(uint32_t));
+	animation->pixels = (uint8_t *)malloc((size_t)pelx_data->header.width * pelx_data->header.height * png_channels);
+
+	if (animation->delays == NULL || animation->frames == NULL || animation->frame_sizes == NULL || animation->pixels == NULL)
+	{
+		PELX_func(free_animation)(&animation);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	for (uint16_t f = 0; f < frame_count; f++)
+	{
+		const uint8_t *entry = &body[2 + (size_t)f * PELX_animation_frame_entry_size];
+		const uint32_t frame_size = PELX_func(load_uint32)(entry + 2);
+
+		if (frame_size > body_size - pos)
+		{
+			PELX_func(free_animation)(&animation);
+			return PELX_enum(invalid_data_format);
+		}
+
+		animation->delays[f] = PELX_func(load_uint16)(entry);
+		animation->frames[f] = &body[pos];
+		animation->frame_sizes[f] = frame_size;
+		pos += frame_size;
+	}
+
+	PELX_func(resolve_palette)(palette_entries, palette_count, pelx_data->header.palette_channel_count, animation->lut);
+
+	// The first frame is regular pixel data
+	PELX_type(file_data) first = *pelx_data;
+	first.body.data = (uint8_t *)animation->frames[0];
+	first.body.size = animation->frame_sizes[0];
+
+	result = PELX_func(expand_pixels)(&first, (const uint8_t (*)[4])animation->lut, animation->lut_count, png_channels,
+	                                  animation->pixels, (size_t)pelx_data->header.width * png_channels);
+	if (result != PELX_enum(success))
+	{
+		PELX_func(free_animation)(&animation);
+		return result;
+	}
+
+	animation->frame = 0;
+	*output = animation;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(next_frame)(PELX_type(animation) animation)
+{
+	if (animation == NULL)
 	{
-		uint8_t tag = src[src_pos++];
-		if (tag == PELX_tag_void)
+		return PELX_enum(io_error);
+	}
+
+	uint16_t frame = (uint16_t)(animation->frame + 1);
+
+	if (frame >= animation->frame_count)
+	{
+		// Back to the first frame, which is stored in full
+		PELX_type(file_data) first = *animation->file;
+		first.body.data = (uint8_t *)animation->frames[0];
+		first.body.size = animation->frame_sizes[0];
+
+		animation->frame = 0;
+		return PELX_func(expand_pixels)(&first, (const uint8_t (*)[4])animation->lut, animation->lut_count, animation->channels,
+		                                animation->pixels, (size_t)first.header.width * animation->channels);
+	}
+
+	animation->frame = frame;
+	return PELX_func(apply_delta)(animation, animation->frames[frame], animation->frame_sizes[frame]);
+}
+
+PELX_def void PELX_func(free_animation)(PELX_type(animation) *animation)
+{
+	if (animation == NULL || *animation == NULL)
+	{
+		return;
+	}
+
+	free((*animation)->delays);
+	free((*animation)->frames);
+	free((*animation)->frame_sizes);
+	free((*animation)->pixels);
+	free(*animation);
+	*animation = NULL;
+}
+
+// Palette targets:
+//     Binding decodes the image once and then builds an inverted index: the positions of the pixels of every
+//     palette index, grouped by index (counted, then filled, as in a counting sort), and a bounding box per index.
+//     A palette change rewrites only the positions of the entries whose resolved colour actually changed,
+//     and the union of their boxes tells the caller which rectangle to upload again.
+
+// Rewrites the pixels of the palette indices whose colour in lut differs from the target's, then adopts lut
+static void PELX_func(update_palette_target)(PELX_type(palette_target) target, uint16_t first, uint16_t count, const uint8_t (*lut)[4])
+{
+	const uint8_t channels = target->channels;
+	uint32_t x0 = UINT32_MAX, y0 = UINT32_MAX, x1 = 0, y1 = 0;
+
+	target->changed = 0;
+
+	for (uint16_t i = first; i < first + count; i++)
+	{
+		if (memcmp(target->lut[i], lut[i - first], channels) == 0)
+		{
+			continue;
+		}
+
+		memcpy(target->lut[i], lut[i - first], 4);
+
+		const uint32_t start = target->starts[i];
+		const uint32_t end = target->starts[i + 1];
+		if (start == end)
 		{
-			out_ptr[out_pos++] = 0x00; // R
-			out_ptr[out_pos++] = 0x00; // G
-			out_ptr[out_pos++] = 0x00; // B
+			continue;
+		}
 
-			if (png_channels == 4)
+		if (channels == 4)
+		{
+			for (uint32_t p = start; p < end; p++)
 			{
-				out_ptr[out_pos++] = 0x00; // A
+				memcpy(target->pixels + (size_t)target->positions[p] * 4, target->lut[i], 4);
 			}
 		}
-		else if (tag == PELX_tag_true)
+		else
+		{
+			for (uint32_t p = start; p < end; p++)
+			{
+				memcpy(target->pixels + (size_t)target->positions[p] * 3, target->lut[i], 3);
+			}
+		}
+
+		const uint16_t *box = target->bounds[i];
+		x0 = box[0] < x0 ? box[0] : x0;
+		y0 = box[1] < y0 ? box[1] : y0;
+		x1 = (uint32_t)box[0] + box[2] > x1 ? (uint32_t)box[0] + box[2] : x1;
+		y1 = (uint32_t)box[1] + box[3] > y1 ? (uint32_t)box[1] + box[3] : y1;
+		target->changed += end - start;
+	}
+
+	if (target->changed == 0)
+	{
+		memset(target->dirty, 0, sizeof(target->dirty));
+		return;
+	}
+
+	target->dirty[0] = (uint16_t)x0;
+	target->dirty[1] = (uint16_t)y0;
+	target->dirty[2] = (uint16_t)(x1 - x0);
+	target->dirty[3] = (uint16_t)(y1 - y0);
+}
+
+PELX_def PELX_type(result) PELX_func(bind_palette_target)(PELX_type(file_data) *pelx_data,
+                                                          uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                          uint8_t png_channels, PELX_type(palette_target) *output)
+{
+	if (pelx_data == NULL || palette_entries == NULL || output == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&pelx_data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	if (pelx_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	PELX_type(palette_target_data) *target = (PELX_type(palette_target_data) *)calloc(1, sizeof(PELX_type(palette_target_data)));
+	if (target == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	const uint16_t width = pelx_data->header.width;
+	const uint16_t height = pelx_data->header.height;
+
+	target->width = width;
+	target->height = height;
+	target->channels = png_channels;
+	target->palette_channels = pelx_data->header.palette_channel_count;
+	target->lut_count = palette_count < 256 ? palette_count : 256;
+	target->pixels = (uint8_t *)malloc((size_t)width * height * png_channels);
+	if (target->pixels == NULL)
+	{
+		PELX_func(free_palette_target)(&target);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	PELX_func(resolve_palette)(palette_entries, palette_count, target->palette_channels, target->lut);
+
+	// Decoding checks the pixel data, so the passes below can trust it
+	result = PELX_func(expand_pixels)(pelx_data, (const uint8_t (*)[4])target->lut, palette_count, png_channels,
+	                                  target->pixels, (size_t)width * png_channels);
+	if (result != PELX_enum(success))
+	{
+		PELX_func(free_palette_target)(&target);
+		return result;
+	}
+
+	uint32_t counts[256] = { 0 };
+	uint16_t x0[256], y0[256], x1[256], y1[256];
+	const uint8_t *body = pelx_data->body.data;
+	const size_t true_size = 1 + (size_t)pelx_data->header.true_channel_count;
+	size_t pos = 0;
+
+	for (uint16_t y = 0; y < height; y++)
+	{
+		for (uint16_t x = 0; x < width; x++)
 		{
-			if (src_pos + true_channels > src_size)
+			const uint8_t tag = body[pos];
+			if (tag != PELX_tag_pale)
 			{
-				free(*png_buffer);
-				*png_buffer = NULL;
-				return PELX_enum(io_error);
+				pos += tag == PELX_tag_true ? true_size : 1;
+				continue;
 			}
-			
-			out_ptr[out_pos++] = src[src_pos++]; // R
-			out_ptr[out_pos++] = src[src_pos++]; // G
-			out_ptr[out_pos++] = src[src_pos++]; // B
-			
-			if (png_channels == 4)
+
+			const uint8_t index = body[pos + 1];
+			pos += 2;
+
+			if (counts[index]++ == 0)
 			{
-				if (true_channels == 4)
-				{
-					out_ptr[out_pos++] = src[src_pos++]; // A
-				}
-				else
-				{
-					out_ptr[out_pos++] = 0xFF;
-				}
+				x0[index] = x1[index] = x;
+				y0[index] = y1[index] = y;
 			}
 			else
 			{
-				if (true_channels == 4)
-				{
-					src_pos++; // consume uneeded
-				}
+				x0[index] = x < x0[index] ? x : x0[index];
+				x1[index] = x > x1[index] ? x : x1[index];
+				y1[index] = y;
 			}
 		}
-		else if (tag == PELX_tag_pale)
+	}
+
+	for (uint16_t i = 0; i < 256; i++)
+	{
+		target->starts[i + 1] = target->starts[i] + counts[i];
+
+		if (counts[i] != 0)
+		{
+			target->bounds[i][0] = x0[i];
+			target->bounds[i][1] = y0[i];
+			target->bounds[i][2] = (uint16_t)(x1[i] - x0[i] + 1);
+			target->bounds[i][3] = (uint16_t)(y1[i] - y0[i] + 1);
+		}
+	}
+
+	target->positions = (uint32_t *)malloc(((size_t)target->starts[256] + 1) * sizeof(uint32_t));
+	if (target->positions == NULL)
+	{
+		PELX_func(free_palette_target)(&target);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	uint32_t next[256];
+	memcpy(next, target->starts, sizeof(next));
+	pos = 0;
+
+	for (uint32_t p = 0; p < (uint32_t)width * height; p++)
+	{
+		const uint8_t tag = body[pos];
+		if (tag == PELX_tag_pale)
+		{
+			target->positions[next[body[pos + 1]]++] = p;
+			pos += 2;
+		}
+		else
+		{
+			pos += tag == PELX_tag_true ? true_size : 1;
+		}
+	}
+
+	*output = target;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(set_palette_entries)(PELX_type(palette_target) target, uint16_t first, uint16_t count,
+                                                          const PELX_type(palette_entry) *palette_entries)
+{
+	if (target == NULL || palette_entries == NULL || (uint32_t)first + count > target->lut_count)
+	{
+		return PELX_enum(io_error);
+	}
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(palette_entries, count, target->palette_channels, lut);
+	PELX_func(update_palette_target)(target, first, count, (const uint8_t (*)[4])lut);
+
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(cycle_palette)(PELX_type(palette_target) target, uint16_t first, uint16_t count, int32_t steps)
+{
+	if (target == NULL || (uint32_t)first + count > target->lut_count)
+	{
+		return PELX_enum(io_error);
+	}
+
+	if (count == 0)
+	{
+		return PELX_enum(success);
+	}
+
+	// Entry i moves to i + steps, so the entry now at i is the one that was at i - steps
+	const uint32_t shift = (uint32_t)(((int64_t)steps % count + count) % count);
+
+	uint8_t lut[256][4];
+	for (uint16_t i = 0; i < count; i++)
+	{
+		memcpy(lut[i], target->lut[first + (i + count - shift) % count], 4);
+	}
+
+	PELX_func(update_palette_target)(target, first, count, (const uint8_t (*)[4])lut);
+
+	return PELX_enum(success);
+}
+
+PELX_def void PELX_func(free_palette_target)(PELX_type(palette_target) *target)
+{
+	if (target == NULL || *target == NULL)
+	{
+		return;
+	}
+
+	free((*target)->positions);
+	free((*target)->pixels);
+	free(*target);
+	*target = NULL;
+}
+
+// Index textures:
+//     Palette pixels keep their index in an R8 layer and true colour pixels are copied as they are to an RGBA layer,
+//     so the pixel data is read once and never expanded through a palette. A mask tells the three tags apart, void
+//     included, so that sprites with transparency but no true colour pixels need no RGBA layer at all: it is only
+//     allocated once the first true colour pixel turns up. The palettes go into a strip 256 entries wide,
+//     one palette per row, so swapping palettes is a 1 KB upload of a row.
+
+PELX_def PELX_type(result) PELX_func(build_index_texture)(PELX_type(file_data) *pelx_data, uint16_t palette_count,
+                                                          PELX_type(palette_entry) *const *palettes, PELX_type(index_texture) *output)
+{
+	if (pelx_data == NULL || output == NULL || (palette_count > 0 && palettes == NULL))
+	{
+		return PELX_enum(io_error);
+	}
+
+	*output = NULL;
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&pelx_data->header);
+	if (result != PELX_enum(success))
+	{
+		return result;
+	}
+
+	if (pelx_data->header.reserved[0] & PELX_flag_animated)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	const uint16_t strip_rows = palette_count > 0 ? palette_count : pelx_data->palettes.count;
+	if (strip_rows == 0)
+	{
+		return PELX_enum(palette_not_found);
+	}
+
+	const uint16_t width = pelx_data->header.width;
+	const uint16_t height = pelx_data->header.height;
+	const size_t pixel_count = (size_t)width * height;
+
+	PELX_type(index_texture_data) *texture = (PELX_type(index_texture_data) *)calloc(1, sizeof(PELX_type(index_texture_data)));
+	if (texture == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	texture->width = width;
+	texture->height = height;
+	texture->palette_count = strip_rows;
+	texture->indices = (uint8_t *)malloc(pixel_count);
+	texture->mask = (uint8_t *)malloc(pixel_count);
+	texture->palettes = (uint8_t *)calloc((size_t)strip_rows * 256, 4);
+
+	if (texture->indices == NULL || texture->mask == NULL || texture->palettes == NULL)
+	{
+		PELX_func(free_index_texture)(&texture);
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	const uint16_t entry_count = pelx_data->header.palette_count < 256 ? pelx_data->header.palette_count : 256;
+	for (uint16_t row = 0; row < strip_rows; row++)
+	{
+		const PELX_type(palette_entry) *entries = palette_count > 0 ? palettes[row] : pelx_data->palettes.data[row].entries;
+		if (entries == NULL)
+		{
+			PELX_func(free_index_texture)(&texture);
+			return PELX_enum(io_error);
+		}
+
+		PELX_func(resolve_palette)(entries, entry_count, pelx_data->header.palette_channel_count,
+		                           (uint8_t (*)[4])(texture->palettes + (size_t)row * 256 * 4));
+	}
+
+	// The checks and results of decode_pixel, without expanding anything
+	const uint8_t true_channels = pelx_data->header.true_channel_count;
+	const uint8_t *src = pelx_data->body.data;
+	const size_t src_size = pelx_data->body.size;
+	size_t pos = 0;
+
+	for (size_t p = 0; p < pixel_count; p++)
+	{
+		if (pos >= src_size)
+		{
+			result = PELX_enum(invalid_data_format);
+			break;
+		}
+
+		const uint8_t tag = src[pos++];
+
+		if (tag == PELX_tag_pale)
 		{
-			if (src_pos + 1 > src_size)
+			if (pos + 1 > src_size || src[pos] >= pelx_data->header.palette_count)
 			{
-				free(*png_buffer);
-				*png_buffer = NULL;
-				return PELX_enum(io_error);
+				result = PELX_enum(io_error);
+				break;
 			}
 
-			uint8_t palette_index = src[src_pos++];
-			if (palette_index >= palette_count)
+			texture->indices[p] = src[pos++];
+			texture->mask[p] = PELX_index_mask_palette;
+		}
+		else if (tag == PELX_tag_void)
+		{
+			texture->indices[p] = 0;
+			texture->mask[p] = PELX_index_mask_void;
+		}
+		else if (tag == PELX_tag_true)
+		{
+			if (pos + true_channels > src_size)
 			{
-				free(*png_buffer);
-				*png_buffer = NULL;
-				return PELX_enum(io_error);
+				result = PELX_enum(io_error);
+				break;
 			}
-			
-			PELX_type(palette_entry) *entry = &palette_entries[palette_index];
-			
-			out_ptr[out_pos++] = entry->r;
-			out_ptr[out_pos++] = entry->g;
-			out_ptr[out_pos++] = entry->b;
-			
-			if (png_channels == 4)
+
+			if (texture->true_colour == NULL)
 			{
-				if (palette_channels == 4)
-				{
-					out_ptr[out_pos++] = entry->a;
-				}
-				else
+				texture->true_colour = (uint8_t *)calloc(pixel_count, 4);
+				if (texture->true_colour == NULL)
 				{
-					out_ptr[out_pos++] = 0xFF;
+					result = PELX_enum(memory_allocation_failed);
+					break;
 				}
 			}
+
+			uint8_t *pixel = texture->true_colour + p * 4;
+			pixel[0] = src[pos + 0];
+			pixel[1] = src[pos + 1];
+			pixel[2] = src[pos + 2];
+			pixel[3] = true_channels == 4 ? src[pos + 3] : 0xFF;
+			pos += true_channels;
+
+			texture->indices[p] = 0;
+			texture->mask[p] = PELX_index_mask_true;
+			texture->true_colour_count++;
 		}
 		else
 		{
-			free(*png_buffer);
-			*png_buffer = NULL;
-			return PELX_enum(invalid_data_format);
+			result = PELX_enum(invalid_data_format);
+			break;
+		}
+	}
+
+	if (result != PELX_enum(success))
+	{
+		PELX_func(free_index_texture)(&texture);
+		return result;
+	}
+
+	*output = texture;
+	return PELX_enum(success);
+}
+
+PELX_def PELX_type(result) PELX_func(encode_index_texture)(const PELX_type(index_texture_data) *texture,
+                                                           const char *index_file, const char *palette_file,
+                                                           const char *true_colour_file, const char *mask_file)
+{
+	if (texture == NULL || index_file == NULL || palette_file == NULL)
+	{
+		return PELX_enum(io_error);
+	}
+
+	PELX_trace_begin("encode");
+
+	int write_success = PELX_func(write_png_image)(index_file, texture->width, texture->height, 1, texture->indices) &&
+	                    PELX_func(write_png_image)(palette_file, 256, texture->palette_count, 4, texture->palettes);
+
+	if (write_success && true_colour_file != NULL && texture->true_colour != NULL)
+	{
+		write_success = PELX_func(write_png_image)(true_colour_file, texture->width, texture->height, 4, texture->true_colour);
+	}
+
+	if (write_success && mask_file != NULL)
+	{
+		write_success = PELX_func(write_png_image)(mask_file, texture->width, texture->height, 1, texture->mask);
+	}
+
+	PELX_trace_end("encode");
+	return write_success ? PELX_enum(success) : PELX_enum(io_error);
+}
+
+PELX_def void PELX_func(free_index_texture)(PELX_type(index_texture) *texture)
+{
+	if (texture == NULL || *texture == NULL)
+	{
+		return;
+	}
+
+	free((*texture)->indices);
+	free((*texture)->mask);
+	free((*texture)->true_colour);
+	free((*texture)->palettes);
+	free(*texture);
+	*texture = NULL;
+}
+
+// Batches:
+//     Jobs are split into one contiguous range per worker. A worker takes jobs from the front of its own
+//     range, and once it runs dry steals the back half of another worker's range, so uneven job costs
+//     balance out without a shared queue. Each worker reads inputs and renders into its own buffers,
+//     which only grow, so after the first few jobs a worker no longer allocates.
+
+typedef struct
+{
+	PELX_type(mutex) mutex;
+	uint32_t begin; // next job of the owner
+	uint32_t end; // one past the last job, thieves take from here
+} PELX_type(batch_queue);
+
+typedef struct
+{
+	PELX_type(batch_job) *jobs;
+	PELX_type(batch_queue) *queues;
+	uint32_t worker_count;
+} PELX_type(batch);
+
+typedef struct
+{
+	PELX_type(batch) *batch;
+	uint32_t index;
+	uint8_t *file; // scratch for the input file
+	size_t file_capacity;
+	uint8_t *pixels; // scratch for the rendered image
+	size_t pixels_capacity;
+} PELX_type(batch_worker);
+
+// Takes the next job of a worker, stealing when its own range is empty, returns 0 when no job is left
+static int PELX_func(batch_take)(PELX_type(batch_worker) *worker, uint32_t *job)
+{
+	PELX_type(batch) *batch = worker->batch;
+	PELX_type(batch_queue) *own = &batch->queues[worker->index];
+
+	PELX_mutex_lock(&own->mutex);
+	const int found = own->begin < own->end;
+	if (found)
+	{
+		*job = own->begin++;
+	}
+	PELX_mutex_unlock(&own->mutex);
+
+	if (found)
+	{
+		return 1;
+	}
+
+	for (uint32_t i = 1; i < batch->worker_count; i++)
+	{
+		PELX_type(batch_queue) *victim = &batch->queues[(worker->index + i) % batch->worker_count];
+
+		PELX_mutex_lock(&victim->mutex);
+		const uint32_t remaining = victim->end - victim->begin;
+		const uint32_t end = victim->end;
+		const uint32_t begin = end - (remaining + 1) / 2;
+		victim->end = begin;
+		PELX_mutex_unlock(&victim->mutex);
+
+		if (remaining == 0)
+		{
+			continue;
 		}
-	}
-	
-	if (out_pos != output_buffer_size)
-	{
-	#if defined (PELX_error_output)
-		fprintf(stderr, "Mismatch: expected %zu bytes, but wrote %zu\n", output_buffer_size, out_pos);	
-	#endif // PELX_error_output
-		free(*png_buffer);
-		*png_buffer = NULL;
-		return PELX_enum(invalid_data_format);
+
+		*job = begin;
+
+		PELX_mutex_lock(&own->mutex);
+		own->begin = begin + 1;
+		own->end = end;
+		PELX_mutex_unlock(&own->mutex);
+
+		return 1;
 	}
 
-	return PELX_enum(success);
+	return 0;
 }
 
-PELX_def PELX_type(result) PELX_func(decode_pelx)(const char *file, PELX_type(file) *pelx)
+// Reads a whole file into the scratch buffer of a worker
+static PELX_type(result) PELX_func(batch_read)(PELX_type(batch_worker) *worker, const char *file, size_t *size)
 {
 	FILE *fp = fopen(file, "rb");
-	if (fp == NULL || pelx == NULL)
+	if (fp == NULL)
 	{
 		return PELX_enum(io_error);
 	}
 
-	PELX_type(file_data) *pelx_file = (PELX_type(file_data) *)malloc(sizeof(PELX_type(file_data)));
-	if (pelx_file == NULL)
+	long length = -1;
+	if (fseek(fp, 0, SEEK_END) == 0)
 	{
-		fclose(fp);
-		return PELX_enum(memory_allocation_failed);
+		length = ftell(fp);
 	}
 
-	memset(pelx_file, 0, sizeof(PELX_type(file_data)));
-
-	// Read magic PELX\0 (5 bytes)
-	if (fread(pelx_file->header.magic, 1, 5, fp) != 5)
+	if (length < 0 || fseek(fp, 0, SEEK_SET) != 0)
 	{
-		goto return_failure;
+		fclose(fp);
+		return PELX_enum(io_error);
 	}
 
-	// Read header size: 4 bytes
-	if (PELX_func(read_uint32)(fp, &pelx_file->header.header_size) < 0)
+	if ((size_t)length > worker->file_capacity)
 	{
-		goto return_failure;
-	}
+		uint8_t *grown = (uint8_t *)realloc(worker->file, (size_t)length);
+		if (grown == NULL)
+		{
+			fclose(fp);
+			return PELX_enum(memory_allocation_failed);
+		}
 
-	// Read palette offset: 4 bytes
-	if (PELX_func(read_uint32)(fp, &pelx_file->header.palette_offset) < 0)
-	{
-		goto return_failure;
+		worker->file = grown;
+		worker->file_capacity = (size_t)length;
 	}
-	
-	// Read width: 2 bytes
-	if (PELX_func(read_uint16)(fp, &pelx_file->header.width) < 0)
+
+	const size_t read = fread(worker->file, 1, (size_t)length, fp);
+	fclose(fp);
+
+	if (read != (size_t)length)
 	{
-		goto return_failure;
+		return PELX_enum(io_error);
 	}
 
-	// Read height: 2 bytes
-	if (PELX_func(read_uint16)(fp, &pelx_file->header.height) < 0)
+	*size = read;
+	return PELX_enum(success);
+}
+
+static PELX_type(result) PELX_func(batch_run)(PELX_type(batch_worker) *worker, const PELX_type(batch_job) *job)
+{
+	if (job->input == NULL || job->output == NULL || job->palette_entries == NULL)
 	{
-		goto return_failure;
+		return PELX_enum(io_error);
 	}
-	
-	// Read palette channels: 1 byte
-	if (PELX_func(read_uint8)(fp, &pelx_file->header.palette_channel_count) < 0)
+
+	if (job->png_channels != 3 && job->png_channels != 4)
 	{
-		goto return_failure;
+		return PELX_enum(invalid_png_channels);
 	}
 
-	// Read true channels: 1 byte
-	if (PELX_func(read_uint8)(fp, &pelx_file->header.true_channel_count) < 0)
+	size_t size;
+	PELX_stats_start(read_start);
+	PELX_type(result) result = PELX_func(batch_read)(worker, job->input, &size);
+	PELX_stats_phase(phase_read, read_start);
+
+	if (result != PELX_enum(success))
 	{
-		goto return_failure;
+		return result;
 	}
-	
-	// Read palette count: 1 byte
-	if (PELX_func(read_uint16)(fp, &pelx_file->header.palette_count) < 0)
+
+	// A view into the scratch buffer, embedded palettes are not needed as every job brings its entries
+	PELX_type(file_data) view;
+	memset(&view, 0, sizeof(view));
+
+	if (PELX_func(parse_header)(worker->file, size, &view.header) < 0 || view.header.header_size > size ||
+	    size - view.header.header_size > UINT32_MAX)
 	{
-		goto return_failure;
+		return PELX_enum(invalid_data_format);
 	}
 
-	// Read reserved: 5 bytes
-	if (fread(pelx_file->header.reserved, 1, 5, fp) != 5)
+	result = PELX_func(sanitize_header)(&view.header);
+	if (result != PELX_enum(success))
 	{
-		goto return_failure;
+		return result;
 	}
 
-	if (fseek(fp, 0, SEEK_END) != 0)
+	if (view.header.reserved[0] & PELX_flag_animated)
 	{
-		goto return_failure;
+		return PELX_enum(invalid_data_format);
 	}
 
-	long file_size = ftell(fp);
-	if (file_size < 0 || pelx_file->header.header_size > (uint32_t)file_size)
+	view.body.data = worker->file + view.header.header_size;
+	view.body.size = (uint32_t)(size - view.header.header_size);
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(job->palette_entries, job->palette_count, view.header.palette_channel_count, lut);
+
+	if (PELX_func(encode_cached_image)(NULL, job->output, &view, (const uint8_t (*)[4])lut, job->palette_count,
+	                                   job->png_channels, PELX_func(write_png_image), &result))
 	{
-		goto return_failure;
+		return result;
 	}
 
-	size_t raw_data_size = (size_t)file_size - pelx_file->header.header_size;
+	const size_t row_size = (size_t)view.header.width * job->png_channels;
+	const size_t image_size = row_size * view.header.height;
 
-	pelx_file->body.data = (uint8_t *)malloc(raw_data_size);
-	if (pelx_file->body.data == NULL)
+	if (image_size > worker->pixels_capacity)
 	{
-		goto return_failure;
+		uint8_t *grown = (uint8_t *)realloc(worker->pixels, image_size);
+		if (grown == NULL)
+		{
+			return PELX_enum(memory_allocation_failed);
+		}
+
+		worker->pixels = grown;
+		worker->pixels_capacity = image_size;
 	}
 
-	pelx_file->body.size = (uint16_t)raw_data_size;
+	PELX_trace_begin("render");
+	PELX_stats_start(decode_start);
+	result = PELX_func(expand_pixels)(&view, (const uint8_t (*)[4])lut, job->palette_count, job->png_channels,
+	                                  worker->pixels, row_size);
+	PELX_stats_phase(phase_decode, decode_start);
+	PELX_trace_end("render");
 
-	if (fseek(fp, pelx_file->header.header_size, SEEK_SET) != 0)
+	if (result != PELX_enum(success))
 	{
-		goto return_failure;
+		return result;
 	}
 
-	// Read body data
-	if (fread(pelx_file->body.data, 1, raw_data_size, fp) != raw_data_size)
+	if (PELX_func(write_png_image)(job->output, view.header.width, view.header.height, job->png_channels, worker->pixels) == 0)
 	{
-		goto return_failure;
+		return PELX_enum(io_error);
 	}
 
-	fclose(fp);
-	*pelx = pelx_file;
 	return PELX_enum(success);
+}
 
-return_failure:
-	free(pelx_file->body.data);
-	free(pelx_file);
-	fclose(fp);
-	return PELX_enum(invalid_data_format);
+static PELX_thread_function(PELX_func(batch_worker))
+{
+	PELX_type(batch_worker) *worker = (PELX_type(batch_worker) *)argument;
+	uint32_t job;
+
+	while (PELX_func(batch_take)(worker, &job))
+	{
+		PELX_trace_begin("batch_job");
+		PELX_stats_begin();
+		worker->batch->jobs[job].result = PELX_func(batch_run)(worker, &worker->batch->jobs[job]);
+		PELX_stats_end();
+		PELX_trace_end("batch_job");
+	}
+
+	return PELX_thread_result;
 }
 
-PELX_def PELX_type(result) PELX_func(decode_png)(const char *file,
-                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
-                                                 uint8_t png_channels, uint8_t **png_buffer)
+PELX_def PELX_type(result) PELX_func(encode_batch)(uint32_t count, PELX_type(batch_job) *jobs, uint32_t thread_count)
 {
-	if (png_channels != 3 && png_channels != 4)
+	if (jobs == NULL)
 	{
-		return PELX_enum(invalid_png_channels);
+		return PELX_enum(io_error);
 	}
 
-	PELX_type(file) pelx_file = NULL;
+	if (count == 0)
+	{
+		return PELX_enum(success);
+	}
 
-	PELX_type(result) result = PELX_func(decode_pelx)(file, &pelx_file);
-	if (result != PELX_enum(success))
+	if (thread_count == 0)
 	{
-		return result;
+		thread_count = PELX_func(cpu_count)();
 	}
-	
-	result = PELX_func(to_png)(&pelx_file, palette_count, palette_entries, png_channels, png_buffer);
 
-	PELX_func(free_file)(&pelx_file);
-	return result;
-}
+	if (thread_count > count)
+	{
+		thread_count = count;
+	}
 
-PELX_def PELX_type(result) PELX_func(encode_pelx)(const char *file, PELX_type(file_data) *input_data)
-{
-	FILE *fp = fopen(file, "wb");
-	if (fp == NULL || input_data == NULL)
+	PELX_type(batch_queue) *queues = (PELX_type(batch_queue) *)malloc((size_t)thread_count * sizeof(PELX_type(batch_queue)));
+	PELX_type(batch_worker) *workers = (PELX_type(batch_worker) *)calloc(thread_count, sizeof(PELX_type(batch_worker)));
+	PELX_type(thread) *threads = (PELX_type(thread) *)malloc((size_t)thread_count * sizeof(PELX_type(thread)));
+	if (queues == NULL || workers == NULL || threads == NULL)
 	{
-		return PELX_enum(io_error);
+		free(queues);
+		free(workers);
+		free(threads);
+		return PELX_enum(memory_allocation_failed);
 	}
 
-	// Write magic (5 bytes)
-	if (fwrite(input_data->header.magic, 1, 5, fp) != 5)
+	PELX_type(batch) batch;
+	batch.jobs = jobs;
+	batch.queues = queues;
+	batch.worker_count = thread_count;
+
+	for (uint32_t i = 0; i < thread_count; i++)
 	{
-		fclose(fp);
-		return PELX_enum(io_error);
+		if (PELX_mutex_init(&queues[i].mutex) != 0)
+		{
+			while (i-- > 0)
+			{
+				PELX_mutex_destroy(&queues[i].mutex);
+			}
+
+			free(queues);
+			free(workers);
+			free(threads);
+			return PELX_enum(memory_allocation_failed);
+		}
+
+		queues[i].begin = (uint32_t)((uint64_t)count * i / thread_count);
+		queues[i].end = (uint32_t)((uint64_t)count * (i + 1) / thread_count);
+
+		workers[i].batch = &batch;
+		workers[i].index = i;
 	}
 
-	PELX_func(write_uint32)(fp, input_data->header.header_size);
-	PELX_func(write_uint32)(fp, input_data->header.palette_offset);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		jobs[i].result = PELX_enum(success);
+	}
 
-	PELX_func(write_uint16)(fp, input_data->header.width);
-	PELX_func(write_uint16)(fp, input_data->header.height);
+	// The calling thread is worker 0, ranges of workers that fail to start are stolen by the others
+	uint32_t started = 1;
+	for (; started < thread_count; started++)
+	{
+		if (PELX_func(thread_start)(&threads[started], PELX_func(batch_worker), &workers[started]) != 0)
+		{
+			break;
+		}
+	}
 
-	PELX_func(write_uint8)(fp, input_data->header.palette_channel_count);
-	PELX_func(write_uint8)(fp, input_data->header.true_channel_count);
+	PELX_func(batch_worker)(&workers[0]);
 
-	PELX_func(write_uint16)(fp, input_data->header.palette_count);
+	for (uint32_t i = 1; i < started; i++)
+	{
+		PELX_func(thread_join)(threads[i]);
+	}
 
-	if (fwrite(input_data->header.reserved, 1, 5, fp) != 5)
+	for (uint32_t i = 0; i < thread_count; i++)
 	{
-		fclose(fp);
-		return PELX_enum(io_error);
+		free(workers[i].file);
+		free(workers[i].pixels);
+		PELX_mutex_destroy(&queues[i].mutex);
 	}
 
-	if (fwrite(input_data->body.data, 1, input_data->body.size, fp) != input_data->body.size)
+	free(queues);
+	free(workers);
+	free(threads);
+
+	for (uint32_t i = 0; i < count; i++)
 	{
-		fclose(fp);
-		return PELX_enum(io_error);
+		if (jobs[i].result != PELX_enum(success))
+		{
+			return jobs[i].result;
+		}
 	}
 
-	fclose(fp);
 	return PELX_enum(success);
 }
 
-PELX_def PELX_type(result) PELX_func(encode_png)(const char *file, PELX_type(file_data) *input_data,
-                                                 uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
-                                                 uint8_t png_channels)
+// Validation:
+//     The scan never writes pixels. Eight bytes are tested at once for the two shapes pixel art bodies are
+//     mostly made of, eight Void tags or four Pale pixels, and everything else is walked one tag at a time.
+//     The words are loaded big-endian so the masks do not depend on the host byte order.
+
+#define PELX_validation_void_word 0x0000000000000000ull
+#define PELX_validation_pale_mask 0xFF00FF00FF00FF00ull
+#define PELX_validation_pale_word 0x0200020002000200ull
+
+PELX_def PELX_type(result) PELX_func(validate_pixels)(const PELX_type(file_data) *pelx_data, PELX_type(validation) *validation)
 {
-	if (file == NULL || input_data == NULL || palette_entries == NULL)
+	if (pelx_data == NULL || validation == NULL)
 	{
 		return PELX_enum(io_error);
 	}
 
-	if (png_channels != 3 && png_channels != 4)
+	memset(validation, 0, sizeof(*validation));
+	validation->error_offset = UINT32_MAX;
+
+	PELX_type(header) header = pelx_data->header;
+
+	PELX_type(result) result = PELX_func(sanitize_header)(&header);
+	if (result == PELX_enum(success) && (header.reserved[0] & PELX_flag_animated))
 	{
-		return PELX_enum(invalid_png_channels);
+		result = PELX_enum(invalid_data_format);
 	}
 
-	PELX_type(result) result = PELX_func(sanitize_header)(&input_data->header);
 	if (result != PELX_enum(success))
 	{
+		validation->result = result;
 		return result;
 	}
 
-	const uint16_t width = input_data->header.width;
-	const uint16_t height = input_data->header.height;
+	const uint8_t *src = pelx_data->body.data;
+	const size_t src_size = pelx_data->body.size;
+	const size_t true_size = 1 + (size_t)header.true_channel_count;
+	const uint32_t expected = (uint32_t)header.width * header.height;
+	const uint16_t palette_count = header.palette_count;
+
+	size_t pos = 0;
+	uint32_t pixels = 0;
+	uint32_t palette_pixels = 0;
+	uint8_t max_index = 0;
 
-	size_t png_buffer_size = (size_t)width * height * png_channels;
-	uint8_t *png_buffer = (uint8_t *)malloc(png_buffer_size);
-	if (png_buffer == NULL)
+	while (pos < src_size)
 	{
-		return PELX_enum(memory_allocation_failed);
+		if (pixels == expected)
+		{
+			result = PELX_enum(invalid_data_format); // more pixels than the image holds
+			break;
+		}
+
+		if (pos + 8 <= src_size && expected - pixels >= 8)
+		{
+			const uint64_t word = PELX_func(load_uint64)(&src[pos]);
+
+			if (word == PELX_validation_void_word)
+			{
+				pixels += 8;
+				pos += 8;
+				continue;
+			}
+
+			if ((word & PELX_validation_pale_mask) == PELX_validation_pale_word)
+			{
+				uint8_t word_max = src[pos + 1];
+				word_max = src[pos + 3] > word_max ? src[pos + 3] : word_max;
+				word_max = src[pos + 5] > word_max ? src[pos + 5] : word_max;
+				word_max = src[pos + 7] > word_max ? src[pos + 7] : word_max;
+
+				// An index out of range is reported by the tag walk below, with its exact offset
+				if (word_max < palette_count)
+				{
+					max_index = word_max > max_index ? word_max : max_index;
+					palette_pixels += 4;
+					pixels += 4;
+					pos += 8;
+					continue;
+				}
+			}
+		}
+
+		const uint8_t tag = src[pos];
+
+		if (tag == PELX_tag_void)
+		{
+			pos += 1;
+		}
+		else if (tag == PELX_tag_true)
+		{
+			if (pos + true_size > src_size)
+			{
+				result = PELX_enum(io_error);
+				break;
+			}
+
+			pos += true_size;
+		}
+		else if (tag == PELX_tag_pale)
+		{
+			if (pos + 2 > src_size || src[pos + 1] >= palette_count)
+			{
+				result = PELX_enum(io_error);
+				break;
+			}
+
+			max_index = src[pos + 1] > max_index ? src[pos + 1] : max_index;
+			palette_pixels++;
+			pos += 2;
+		}
+		else
+		{
+			result = PELX_enum(invalid_data_format);
+			break;
+		}
+
+		pixels++;
 	}
 
-	result = PELX_func(to_png)(&input_data, palette_count, palette_entries, png_channels, &png_buffer);
+	if (result == PELX_enum(success) && pixels < expected)
+	{
+		result = PELX_enum(invalid_data_format);
+	}
+
+	validation->result = result;
+	validation->pixel_count = pixels;
+	validation->palette_pixel_count = palette_pixels;
+	validation->max_palette_index = max_index;
+	validation->body = src;
+	validation->body_size = src_size;
+	validation->true_channel_count = header.true_channel_count;
+
 	if (result != PELX_enum(success))
 	{
-		free(png_buffer);
-		return result;
+		validation->error_offset = (uint32_t)pos;
+	}
+
+	return result;
+}
+
+// Expands pixel data validate_pixels accepted, without any checks
+static void PELX_func(expand_pixels_unchecked)(const PELX_type(file_data) *pelx_data, const uint8_t (*lut)[4],
+                                               uint8_t png_channels, uint8_t *out)
+{
+	const uint8_t true_channels = pelx_data->header.true_channel_count;
+	const uint8_t *src = pelx_data->body.data;
+	const uint8_t *end = out + (size_t)pelx_data->header.width * pelx_data->header.height * png_channels;
+
+	for (; out < end; out += png_channels)
+	{
+		switch (src[0])
+		{
+			case PELX_tag_void:
+				memset(out, 0x00, png_channels);
+				src += 1;
+				break;
+
+			case PELX_tag_true:
+				out[0] = src[1];
+				out[1] = src[2];
+				out[2] = src[3];
+				if (png_channels == 4)
+				{
+					out[3] = true_channels == 4 ? src[4] : 0xFF;
+				}
+				src += 1 + true_channels;
+				break;
+
+			default: // PELX_tag_pale
+				memcpy(out, lut[src[1]], png_channels);
+				src += 2;
+				break;
+		}
+	}
+}
+
+PELX_def PELX_type(result) PELX_func(to_png_unchecked)(PELX_type(file) *pelx_data, const PELX_type(validation) *validation,
+                                                       uint16_t palette_count, PELX_type(palette_entry) *palette_entries,
+                                                       uint8_t png_channels, uint8_t **png_buffer)
+{
+	if (pelx_data == NULL || *pelx_data == NULL || validation == NULL || palette_entries == NULL || png_buffer == NULL)
+	{
+		return PELX_enum(io_error);
 	}
 
-	int write_success = stbi_write_png(file, width, height, png_channels, png_buffer, width * png_channels);
+	if (png_channels != 3 && png_channels != 4)
+	{
+		return PELX_enum(invalid_png_channels);
+	}
 
-	free(png_buffer);
+	const PELX_type(file_data) *data = *pelx_data;
 
-	if (write_success == 0)
+	// Cheap checks that the validation is of this pixel data and layout, the pixel data itself is trusted
+	if (validation->result != PELX_enum(success) ||
+	    validation->body != data->body.data || validation->body_size != data->body.size ||
+	    validation->true_channel_count != data->header.true_channel_count ||
+	    validation->pixel_count != (uint32_t)data->header.width * data->header.height)
+	{
+		return PELX_enum(invalid_data_format);
+	}
+
+	// The same result as to_png for an index past the palette
+	if (validation->palette_pixel_count > 0 && validation->max_palette_index >= palette_count)
 	{
 		return PELX_enum(io_error);
 	}
 
+	*png_buffer = (uint8_t *)malloc((size_t)data->header.width * data->header.height * png_channels);
+	if (*png_buffer == NULL)
+	{
+		return PELX_enum(memory_allocation_failed);
+	}
+
+	uint8_t lut[256][4];
+	PELX_func(resolve_palette)(palette_entries, palette_count, data->header.palette_channel_count, lut);
+
+	PELX_func(expand_pixels_unchecked)(data, (const uint8_t (*)[4])lut, png_channels, *png_buffer);
 	return PELX_enum(success);
 }
 #endif // PELX_with_implementation
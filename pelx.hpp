@@ -0,0 +1,588 @@
+// (c) A. C. Gäßler (a.k.a. Valken/knettia) 2025
+//
+// Overview:
+//     Optional C++20 wrapper of pelx.h. Images, pixel buffers and packs are move-only owners that free
+//     themselves, views are std::span based and never copy, and the decoders are templates on the channel
+//     counts so the per-pixel path of every format is compiled (and unrolled) on its own.
+//
+// To use the wrapper:
+//     The implementation stays C. Compile it in one C translation unit (a .c file defining PELX_with_implementation
+//     before including pelx.h) and include pelx.hpp from C++, without defining PELX_with_implementation there:
+//
+//     pelx::image image;
+//     pelx::result result = pelx::image::decode("texture.pelx", image);
+//
+//     const pelx::palette_entry entries[] = { { 0xFF, 0x00, 0x00, 0xFF }, { 0x00, 0xFF, 0x00, 0xFF } };
+//
+//     pelx::buffer pixels;
+//     result = pelx::decode<4>(image.view(), entries, pixels); // RGBA
+//
+//     for (uint16_t y = 0; y < pixels.height(); y++)
+//     {
+//         std::span<const uint8_t> row = pixels.row(y);
+//     }
+//
+// Functions return a pelx::result like their C counterparts and leave their outputs empty on failure.
+//
+// Embedded images (tag arrays declared PELX_constexpr, e.g. example/mushroom_texture.h) can also be decoded
+// while compiling, so that they are ready pixels in .rodata and cost nothing at startup:
+//
+//     static constexpr pelx::palette_entry overworld[] = { { 0xEA, 0x9E, 0x22, 0xFF }, { 0xB5, 0x31, 0x20, 0xFF } };
+//     static constexpr auto mushroom = pelx::decode_embedded<16, 16, 4>(mushroom_texture_data, overworld);
+//
+// Invalid data is a compile error there, naming pelx::detail::invalid_embedded_image.
+
+#if !defined (__PELX_HPP_LIBRARY__)
+#define __PELX_HPP_LIBRARY__ 1
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+#include <utility>
+
+#include "pelx.h"
+
+namespace pelx
+{
+	using result = PELX_type(result);
+	using palette_entry = PELX_type(palette_entry);
+	using context = PELX_type(context);
+
+	constexpr result success = PELX_enum(success);
+
+	// Non-owning view of an image, e.g. of a pelx::image, a pack entry or an embedded array
+	struct image_view
+	{
+		PELX_type(header) header;
+		std::span<const uint8_t> body; // tagged pixel data
+
+		uint16_t width() const noexcept { return header.width; }
+		uint16_t height() const noexcept { return header.height; }
+
+		bool animated() const noexcept { return (header.reserved[0] & PELX_flag_animated) != 0; }
+	};
+
+	// Owning pixel buffer of width * height * channels bytes, rows without padding
+	class buffer
+	{
+	public:
+		buffer() noexcept = default;
+
+		// Adopts data allocated through context (nullptr for the C library)
+		buffer(uint8_t *data, uint16_t width, uint16_t height, uint8_t channels, context *allocator = nullptr) noexcept
+			: data_(data), width_(width), height_(height), channels_(channels), context_(allocator)
+		{
+		}
+
+		buffer(buffer &&other) noexcept
+		{
+			*this = std::move(other);
+		}
+
+		buffer &operator=(buffer &&other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				data_ = std::exchange(other.data_, nullptr);
+				width_ = std::exchange(other.width_, 0);
+				height_ = std::exchange(other.height_, 0);
+				channels_ = std::exchange(other.channels_, 0);
+				context_ = std::exchange(other.context_, nullptr);
+			}
+
+			return *this;
+		}
+
+		buffer(const buffer &) = delete;
+		buffer &operator=(const buffer &) = delete;
+
+		~buffer()
+		{
+			reset();
+		}
+
+		// Allocates an uninitialised buffer through context (nullptr for the C library)
+		static result allocate(uint16_t width, uint16_t height, uint8_t channels, buffer &output, context *allocator = nullptr)
+		{
+			output.reset();
+
+			const std::size_t size = static_cast<std::size_t>(width) * height * channels;
+			void *data = allocator != nullptr && allocator->alloc != nullptr ? allocator->alloc(allocator->user, size) : std::malloc(size);
+			if (data == nullptr)
+			{
+				return PELX_enum(memory_allocation_failed);
+			}
+
+			output = buffer(static_cast<uint8_t *>(data), width, height, channels, allocator);
+			return success;
+		}
+
+		void reset() noexcept
+		{
+			if (data_ != nullptr)
+			{
+				if (context_ != nullptr && context_->alloc != nullptr)
+				{
+					if (context_->free != nullptr)
+					{
+						context_->free(context_->user, data_);
+					}
+				}
+				else
+				{
+					std::free(data_);
+				}
+			}
+
+			data_ = nullptr;
+			width_ = height_ = 0;
+			channels_ = 0;
+			context_ = nullptr;
+		}
+
+		// Gives up ownership, the caller frees the data through the buffer's context
+		uint8_t *release() noexcept
+		{
+			width_ = height_ = 0;
+			channels_ = 0;
+			context_ = nullptr;
+			return std::exchange(data_, nullptr);
+		}
+
+		explicit operator bool() const noexcept { return data_ != nullptr; }
+
+		uint16_t width() const noexcept { return width_; }
+		uint16_t height() const noexcept { return height_; }
+		uint8_t channels() const noexcept { return channels_; }
+		std::size_t stride() const noexcept { return static_cast<std::size_t>(width_) * channels_; }
+
+		std::span<uint8_t> bytes() noexcept { return { data_, stride() * height_ }; }
+		std::span<const uint8_t> bytes() const noexcept { return { data_, stride() * height_ }; }
+
+		std::span<uint8_t> row(uint16_t y) noexcept { return bytes().subspan(stride() * y, stride()); }
+		std::span<const uint8_t> row(uint16_t y) const noexcept { return bytes().subspan(stride() * y, stride()); }
+
+	private:
+		uint8_t *data_ = nullptr;
+		uint16_t width_ = 0;
+		uint16_t height_ = 0;
+		uint8_t channels_ = 0;
+		context *context_ = nullptr;
+	};
+
+	// Owning PELX file, freed through the context it was decoded with
+	class image
+	{
+	public:
+		image() noexcept = default;
+
+		// Adopts a file decoded through context (nullptr for the C library)
+		explicit image(PELX_type(file) file, context *allocator = nullptr) noexcept
+			: file_(file), context_(allocator)
+		{
+		}
+
+		image(image &&other) noexcept
+			: file_(std::exchange(other.file_, nullptr)), context_(std::exchange(other.context_, nullptr))
+		{
+		}
+
+		image &operator=(image &&other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				file_ = std::exchange(other.file_, nullptr);
+				context_ = std::exchange(other.context_, nullptr);
+			}
+
+			return *this;
+		}
+
+		image(const image &) = delete;
+		image &operator=(const image &) = delete;
+
+		~image()
+		{
+			reset();
+		}
+
+		static result decode(const char *path, image &output, context *allocator = nullptr)
+		{
+			output.reset();
+
+			PELX_type(file) file = nullptr;
+			result decode_result = PELX_func(decode_pelx_context)(allocator, path, &file);
+			if (decode_result == success)
+			{
+				output = image(file, allocator);
+			}
+
+			return decode_result;
+		}
+
+		void reset() noexcept
+		{
+			if (file_ != nullptr)
+			{
+				PELX_func(free_file_context)(context_, &file_);
+			}
+
+			file_ = nullptr;
+			context_ = nullptr;
+		}
+
+		// Gives up ownership, the caller frees the file with free_file_context
+		PELX_type(file) release() noexcept
+		{
+			context_ = nullptr;
+			return std::exchange(file_, nullptr);
+		}
+
+		PELX_type(file) get() const noexcept { return file_; }
+		explicit operator bool() const noexcept { return file_ != nullptr; }
+
+		image_view view() const noexcept
+		{
+			return { file_->header, { file_->body.data, file_->body.size } };
+		}
+
+		// Renders through the C library, as to_png_context
+		result to_png(std::span<const palette_entry> palette, uint8_t png_channels, buffer &output) const
+		{
+			output.reset();
+
+			uint8_t *pixels = nullptr;
+			PELX_type(file) file = file_;
+			result render_result = PELX_func(to_png_context)(context_, &file, static_cast<uint16_t>(palette.size()),
+			                                                  const_cast<palette_entry *>(palette.data()), png_channels, &pixels);
+			if (render_result == success)
+			{
+				output = buffer(pixels, file_->header.width, file_->header.height, png_channels, context_);
+			}
+
+			return render_result;
+		}
+
+		result encode_png(const char *path, std::span<const palette_entry> palette, uint8_t png_channels) const
+		{
+			return PELX_func(encode_png_context)(context_, path, file_, static_cast<uint16_t>(palette.size()),
+			                                     const_cast<palette_entry *>(palette.data()), png_channels);
+		}
+
+		result encode_pelx(const char *path) const
+		{
+			return PELX_func(encode_pelx)(path, file_);
+		}
+
+	private:
+		PELX_type(file) file_ = nullptr;
+		context *context_ = nullptr;
+	};
+
+	// Memory-mapped pack, its views stay valid until the pack is closed
+	class pack
+	{
+	public:
+		pack() noexcept = default;
+
+		pack(pack &&other) noexcept
+			: pack_(std::exchange(other.pack_, nullptr))
+		{
+		}
+
+		pack &operator=(pack &&other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				pack_ = std::exchange(other.pack_, nullptr);
+			}
+
+			return *this;
+		}
+
+		pack(const pack &) = delete;
+		pack &operator=(const pack &) = delete;
+
+		~pack()
+		{
+			reset();
+		}
+
+		static result open(const char *path, pack &output)
+		{
+			output.reset();
+			return PELX_func(open_pack)(path, &output.pack_);
+		}
+
+		void reset() noexcept
+		{
+			if (pack_ != nullptr)
+			{
+				PELX_func(close_pack)(&pack_);
+			}
+		}
+
+		uint32_t size() const noexcept { return pack_ != nullptr ? pack_->count : 0; }
+		const char *name(uint32_t index) const noexcept { return PELX_func(pack_name)(pack_, index); }
+
+		result get(uint32_t index, image_view &output) const
+		{
+			PELX_type(file_data) entry;
+			result get_result = PELX_func(pack_get)(pack_, index, &entry);
+			if (get_result == success)
+			{
+				output = { entry.header, { entry.body.data, entry.body.size } };
+			}
+
+			return get_result;
+		}
+
+		result find(const char *name, image_view &output) const
+		{
+			PELX_type(file_data) entry;
+			result find_result = PELX_func(pack_find)(pack_, name, &entry);
+			if (find_result == success)
+			{
+				output = { entry.header, { entry.body.data, entry.body.size } };
+			}
+
+			return find_result;
+		}
+
+	private:
+		PELX_type(pack) pack_ = nullptr;
+	};
+
+	namespace detail
+	{
+		// As expand_pixels of pelx.h, with the channel counts known at compile time
+		template <uint8_t TrueChannels, uint8_t PngChannels>
+		constexpr result expand(const image_view &view, const uint8_t (*lut)[4], uint16_t lut_count, uint8_t *out, std::size_t stride)
+		{
+			const uint8_t *src = view.body.data();
+			const std::size_t src_size = view.body.size();
+			std::size_t pos = 0;
+
+			for (uint16_t y = 0; y < view.header.height; y++)
+			{
+				uint8_t *pixel = out + stride * y;
+
+				for (uint16_t x = 0; x < view.header.width; x++, pixel += PngChannels)
+				{
+					if (pos >= src_size)
+					{
+						return PELX_enum(invalid_data_format);
+					}
+
+					const uint8_t tag = src[pos++];
+
+					if (tag == PELX_tag_void)
+					{
+						for (uint8_t c = 0; c < PngChannels; c++)
+						{
+							pixel[c] = 0x00;
+						}
+					}
+					else if (tag == PELX_tag_true)
+					{
+						if (pos + TrueChannels > src_size)
+						{
+							return PELX_enum(io_error);
+						}
+
+						pixel[0] = src[pos + 0];
+						pixel[1] = src[pos + 1];
+						pixel[2] = src[pos + 2];
+
+						if constexpr (PngChannels == 4)
+						{
+							pixel[3] = TrueChannels == 4 ? src[pos + 3] : 0xFF;
+						}
+
+						pos += TrueChannels;
+					}
+					else if (tag == PELX_tag_pale)
+					{
+						if (pos + 1 > src_size || src[pos] >= lut_count)
+						{
+							return PELX_enum(io_error);
+						}
+
+						const uint8_t *entry = lut[src[pos++]];
+						for (uint8_t c = 0; c < PngChannels; c++)
+						{
+							pixel[c] = entry[c];
+						}
+					}
+					else
+					{
+						return PELX_enum(invalid_data_format);
+					}
+				}
+			}
+
+			return success;
+		}
+	}
+
+	// Decodes a view into caller memory (e.g. a mapped texture) with rows stride bytes apart,
+	// PngChannels is 3 (RGB) or 4 (RGBA); checks and results are those of to_png
+	template <uint8_t PngChannels>
+	result decode_into(const image_view &view, std::span<const palette_entry> palette, std::span<uint8_t> output, std::size_t stride)
+	{
+		static_assert(PngChannels == 3 || PngChannels == 4, "PNG channels must be 3 or 4");
+
+		PELX_type(header) header = view.header;
+		result decode_result = PELX_func(sanitize_header)(&header);
+		if (decode_result != success)
+		{
+			return decode_result;
+		}
+
+		if (view.animated())
+		{
+			return PELX_enum(invalid_data_format);
+		}
+
+		const std::size_t row_size = static_cast<std::size_t>(header.width) * PngChannels;
+		if (stride < row_size || output.size() < stride * (header.height - 1) + row_size)
+		{
+			return PELX_enum(io_error);
+		}
+
+		uint8_t lut[256][4];
+		const std::size_t lut_count = palette.size() < 256 ? palette.size() : 256;
+		for (std::size_t i = 0; i < lut_count; i++)
+		{
+			lut[i][0] = palette[i].r;
+			lut[i][1] = palette[i].g;
+			lut[i][2] = palette[i].b;
+			lut[i][3] = header.palette_channel_count == 4 ? palette[i].a : 0xFF;
+		}
+
+		const uint16_t palette_count = static_cast<uint16_t>(palette.size() < 0xFFFF ? palette.size() : 0xFFFF);
+
+		if (header.true_channel_count == 4)
+		{
+			return detail::expand<4, PngChannels>(view, lut, palette_count, output.data(), stride);
+		}
+
+		return detail::expand<3, PngChannels>(view, lut, palette_count, output.data(), stride);
+	}
+
+	// Decodes a view into a new buffer allocated through context (nullptr for the C library)
+	template <uint8_t PngChannels>
+	result decode(const image_view &view, std::span<const palette_entry> palette, buffer &output, context *allocator = nullptr)
+	{
+		static_assert(PngChannels == 3 || PngChannels == 4, "PNG channels must be 3 or 4");
+
+		output.reset();
+
+		PELX_type(header) header = view.header;
+		result decode_result = PELX_func(sanitize_header)(&header);
+		if (decode_result != success)
+		{
+			return decode_result;
+		}
+
+		decode_result = buffer::allocate(header.width, header.height, PngChannels, output, allocator);
+		if (decode_result == success)
+		{
+			decode_result = decode_into<PngChannels>(view, palette, output.bytes(), output.stride());
+		}
+
+		if (decode_result != success)
+		{
+			output.reset();
+		}
+
+		return decode_result;
+	}
+
+	// Pixels of an image decoded at compile time, rows without padding
+	template <uint16_t Width, uint16_t Height, uint8_t PngChannels>
+	struct static_image
+	{
+		static constexpr uint16_t width = Width;
+		static constexpr uint16_t height = Height;
+		static constexpr uint8_t channels = PngChannels;
+		static constexpr std::size_t stride = static_cast<std::size_t>(Width) * PngChannels;
+
+		std::array<uint8_t, stride * Height> pixels;
+
+		constexpr std::span<const uint8_t> bytes() const noexcept { return pixels; }
+		constexpr std::span<const uint8_t> row(uint16_t y) const noexcept { return bytes().subspan(stride * y, stride); }
+	};
+
+	namespace detail
+	{
+		// Deliberately not constexpr, calling it ends the constant evaluation of decode_embedded with an error
+		inline void invalid_embedded_image(result) {}
+	}
+
+	// Decodes the pixel data of a still image at compile time, with the checks and results of to_png;
+	// true_channels and palette_channels are those of the header the data was written with
+	template <uint16_t Width, uint16_t Height, uint8_t PngChannels = 4>
+	consteval static_image<Width, Height, PngChannels> decode_embedded(std::span<const uint8_t> body,
+	                                                                   std::span<const palette_entry> palette,
+	                                                                   uint8_t true_channels = 4, uint8_t palette_channels = 4)
+	{
+		static_assert(PngChannels == 3 || PngChannels == 4, "PNG channels must be 3 or 4");
+		static_assert(Width > 0 && Height > 0, "embedded images cannot be empty");
+
+		static_image<Width, Height, PngChannels> output {};
+
+		if ((true_channels != 3 && true_channels != 4) || (palette_channels != 3 && palette_channels != 4))
+		{
+			detail::invalid_embedded_image(PELX_enum(invalid_data_format));
+		}
+
+		uint8_t lut[256][4] {};
+		const std::size_t lut_count = palette.size() < 256 ? palette.size() : 256;
+		for (std::size_t i = 0; i < lut_count; i++)
+		{
+			lut[i][0] = palette[i].r;
+			lut[i][1] = palette[i].g;
+			lut[i][2] = palette[i].b;
+			lut[i][3] = palette_channels == 4 ? palette[i].a : 0xFF;
+		}
+
+		image_view view {};
+		view.header.width = Width;
+		view.header.height = Height;
+		view.body = body;
+
+		const uint16_t palette_count = static_cast<uint16_t>(lut_count);
+		const result decode_result = true_channels == 4
+			? detail::expand<4, PngChannels>(view, lut, palette_count, output.pixels.data(), output.stride)
+			: detail::expand<3, PngChannels>(view, lut, palette_count, output.pixels.data(), output.stride);
+
+		if (decode_result != success)
+		{
+			detail::invalid_embedded_image(decode_result);
+		}
+
+		return output;
+	}
+
+	// Picks the decoder for channel counts known only at runtime
+	inline result decode(const image_view &view, std::span<const palette_entry> palette, uint8_t png_channels,
+	                     buffer &output, context *allocator = nullptr)
+	{
+		switch (png_channels)
+		{
+			case 3: return decode<3>(view, palette, output, allocator);
+			case 4: return decode<4>(view, palette, output, allocator);
+			default:
+				output.reset();
+				return PELX_enum(invalid_png_channels);
+		}
+	}
+}
+
+#endif // __PELX_HPP_LIBRARY__
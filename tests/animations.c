@@ -0,0 +1,194 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks the delta codec of animations against to_png: random frames (each changing some pixels of the one
+// before, a few with palette indices out of range) go through encode_animation, decode_pelx and open_animation,
+// and every frame next_frame plays, twice around, must equal a to_png of that frame, errors included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_animations 2000
+#define CHECK_frames_max 12
+#define CHECK_loops 2
+
+typedef struct
+{
+	uint8_t tag;
+	uint8_t bytes[4];
+} check_pixel_t;
+
+// A random pixel, about one palette pixel in invalid_index_rate with an index past the palette (0 for none)
+static void random_pixel(uint32_t *state, uint16_t palette_count, uint32_t invalid_index_rate, check_pixel_t *pixel)
+{
+	pixel->tag = (uint8_t)(random_next(state) % 3);
+
+	const uint32_t value = random_next(state);
+	memcpy(pixel->bytes, &value, 4);
+
+	if (pixel->tag == PELX_tag_pale)
+	{
+		const int invalid = invalid_index_rate > 0 && palette_count < 256 && random_next(state) % invalid_index_rate == 0;
+		pixel->bytes[0] = (uint8_t)(invalid ? palette_count : random_next(state) % palette_count);
+	}
+}
+
+// Writes the tagged encoding of pixels into body, returns its size
+static uint32_t encode_pixels(const check_pixel_t *pixels, size_t pixel_count, uint8_t true_channels, uint8_t *body)
+{
+	uint32_t size = 0;
+	for (size_t p = 0; p < pixel_count; p++)
+	{
+		body[size++] = pixels[p].tag;
+
+		const uint8_t count = pixels[p].tag == PELX_tag_true ? true_channels : pixels[p].tag == PELX_tag_pale ? 1 : 0;
+		memcpy(body + size, pixels[p].bytes, count);
+		size += count;
+	}
+
+	return size;
+}
+
+int main(void)
+{
+	uint32_t state = 17;
+	uint32_t frames_played = 0;
+	uint32_t mismatches = 0;
+
+	for (uint32_t i = 0; i < CHECK_animations; i++)
+	{
+		// Every 50th animation is large enough for skips past UINT16_MAX pixels
+		const int large = i % 50 == 0;
+		const uint16_t width = (uint16_t)random_range(&state, 1, large ? 300 : 40);
+		const uint16_t height = (uint16_t)random_range(&state, 1, large ? 250 : 40);
+		const size_t pixel_count = (size_t)width * height;
+
+		const uint16_t palette_count = (uint16_t)random_range(&state, 1, i % 3 == 0 ? 256 : 16);
+		const uint8_t true_channels = (uint8_t)random_range(&state, 3, 4);
+		const uint8_t channels = (uint8_t)random_range(&state, 3, 4);
+		const uint16_t frame_count = (uint16_t)random_range(&state, 1, CHECK_frames_max);
+		const uint32_t invalid_index_rate = i % 4 == 0 ? 20000 : 0;
+
+		PELX_type(palette_entry) palette[256];
+		random_palette(&state, palette, palette_count);
+
+		const PELX_type(header) header =
+		{
+			{ 'P', 'E', 'L', 'X', '\0' }, 26, 26, width, height,
+			(uint8_t)random_range(&state, 3, 4), true_channels, palette_count, { 0 }
+		};
+
+		check_pixel_t *pixels = (check_pixel_t *)malloc(pixel_count * sizeof(check_pixel_t));
+		uint8_t *bodies = (uint8_t *)malloc((size_t)frame_count * pixel_count * 5);
+		PELX_type(file_data) *frames = (PELX_type(file_data) *)calloc(frame_count, sizeof(PELX_type(file_data)));
+		PELX_type(file_data) **frame_pointers = (PELX_type(file_data) **)malloc(frame_count * sizeof(PELX_type(file_data) *));
+		if (pixels == NULL || bodies == NULL || frames == NULL || frame_pointers == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		uint16_t delays[CHECK_frames_max];
+
+		for (uint16_t f = 0; f < frame_count; f++)
+		{
+			// Frames change nothing, a few pixels, a share of them, or all of them
+			size_t changes = pixel_count;
+			if (f > 0)
+			{
+				switch (random_next(&state) % 4)
+				{
+					case 0: changes = 0; break;
+					case 1: changes = random_range(&state, 1, 3); break;
+					case 2: changes = random_next(&state) % (pixel_count / 4 + 1); break;
+					default: break;
+				}
+			}
+
+			for (size_t c = 0; c < changes; c++)
+			{
+				const size_t p = f == 0 || changes == pixel_count ? c : random_next(&state) % pixel_count;
+				random_pixel(&state, palette_count, invalid_index_rate, &pixels[p]);
+			}
+
+			uint8_t *body = bodies + (size_t)f * pixel_count * 5;
+			const uint32_t size = encode_pixels(pixels, pixel_count, true_channels, body);
+
+			if (PELX_func(init_view)(&frames[f], &header, body, size) != PELX_enum(success))
+			{
+				fprintf(stderr, "init_view failed\n");
+				return 1;
+			}
+
+			frame_pointers[f] = &frames[f];
+			delays[f] = (uint16_t)random_next(&state);
+		}
+
+		PELX_type(file) animated = NULL;
+		PELX_type(animation) animation = NULL;
+
+		if (PELX_func(encode_animation)("check_output/animation.pelx", frame_count, frame_pointers, delays) != PELX_enum(success) ||
+		    PELX_func(decode_pelx)("check_output/animation.pelx", &animated) != PELX_enum(success))
+		{
+			printf("animation %u: encode_animation or decode_pelx failed\n", i);
+			mismatches++;
+		}
+		else
+		{
+			PELX_type(result) result = PELX_func(open_animation)(animated, palette_count, palette, channels, &animation);
+
+			for (uint32_t played = 0; played < (uint32_t)frame_count * CHECK_loops; played++)
+			{
+				const uint16_t f = (uint16_t)(played % frame_count);
+
+				if (played > 0)
+				{
+					result = PELX_func(next_frame)(animation);
+				}
+
+				PELX_type(file) frame = &frames[f];
+				uint8_t *expected = NULL;
+				const PELX_type(result) expected_result = PELX_func(to_png)(&frame, palette_count, palette, channels, &expected);
+				frames_played++;
+
+				if (result != expected_result)
+				{
+					printf("animation %u: frame %u gave %d, to_png %d\n", i, (unsigned)f, result, expected_result);
+					mismatches++;
+				}
+				else if (result == PELX_enum(success) &&
+				         (animation->frame != f || animation->delays[f] != delays[f] ||
+				          memcmp(animation->pixels, expected, pixel_count * channels) != 0))
+				{
+					printf("animation %u: frame %u differs\n", i, (unsigned)f);
+					mismatches++;
+					result = PELX_enum(invalid_data_format);
+				}
+
+				free(expected);
+
+				// Pixels after a failed frame are undefined
+				if (result != PELX_enum(success))
+				{
+					break;
+				}
+			}
+		}
+
+		PELX_func(free_animation)(&animation);
+		PELX_func(free_file)(&animated);
+
+		free(frame_pointers);
+		free(frames);
+		free(bodies);
+		free(pixels);
+	}
+
+	printf("animations: %u animations, %u frames, %u mismatches\n", CHECK_animations, frames_played, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
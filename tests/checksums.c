@@ -0,0 +1,107 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks crc32 and adler32 (whichever kernels the running CPU picked) against the scalar kernels and a plain
+// bit-at-a-time reference, over random lengths, buffer offsets and starting values, and split into two calls.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_runs 20000
+#define CHECK_size_max 70000 // past several Adler-32 blocks of PELX_adler32_nmax bytes
+#define CHECK_offset_max 64
+
+static uint32_t reference_crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+	{
+		crc ^= data[i];
+		for (int k = 0; k < 8; k++)
+		{
+			crc = (crc & 1) ? (0xEDB88320u ^ (crc >> 1)) : (crc >> 1);
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t reference_adler32(uint32_t adler, const uint8_t *data, size_t size)
+{
+	uint32_t s1 = adler & 0xFFFF;
+	uint32_t s2 = adler >> 16;
+	for (size_t i = 0; i < size; i++)
+	{
+		s1 = (s1 + data[i]) % PELX_adler32_base;
+		s2 = (s2 + s1) % PELX_adler32_base;
+	}
+	return (s2 << 16) | s1;
+}
+
+int main(void)
+{
+	uint32_t state = 11;
+	uint32_t mismatches = 0;
+
+	// Check values of both algorithms
+	const uint8_t *digits = (const uint8_t *)"123456789";
+	if (PELX_func(crc32)(0, digits, 9) != 0xCBF43926u || PELX_func(adler32)(1, digits, 9) != 0x091E01DEu)
+	{
+		printf("check values differ\n");
+		mismatches++;
+	}
+
+	uint8_t *buffer = (uint8_t *)malloc(CHECK_size_max + CHECK_offset_max);
+	if (buffer == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < CHECK_size_max + CHECK_offset_max; i++)
+	{
+		buffer[i] = (uint8_t)random_next(&state);
+	}
+
+	for (uint32_t i = 0; i < CHECK_runs; i++)
+	{
+		// Mostly short inputs, which exercise the kernel heads and tails
+		const size_t size = random_range(&state, 0, i % 20 == 0 ? CHECK_size_max : 300);
+		const uint8_t *data = buffer + random_range(&state, 0, CHECK_offset_max - 1);
+		const size_t split = random_range(&state, 0, (uint32_t)size);
+
+		// Any CRC is a valid start, Adler-32 sums are below the modulus
+		const uint32_t crc_seed = i % 4 == 0 ? 0 : random_next(&state);
+		const uint32_t adler_seed = i % 4 == 0 ? 1 : (random_next(&state) % PELX_adler32_base) | ((random_next(&state) % PELX_adler32_base) << 16);
+
+		const uint32_t crc = PELX_func(crc32)(crc_seed, data, size);
+		const uint32_t adler = PELX_func(adler32)(adler_seed, data, size);
+
+		const uint32_t crc_split = PELX_func(crc32)(PELX_func(crc32)(crc_seed, data, split), data + split, size - split);
+		const uint32_t adler_split = PELX_func(adler32)(PELX_func(adler32)(adler_seed, data, split), data + split, size - split);
+
+		const uint32_t crc_scalar = ~PELX_func(crc32_scalar)(~crc_seed, data, size);
+		const uint32_t adler_scalar = PELX_func(adler32_scalar)(adler_seed, data, size);
+
+		if (crc != crc_scalar || crc != crc_split || crc != reference_crc32(crc_seed, data, size))
+		{
+			printf("run %u: crc32 of %zu bytes at offset %zu differs\n", i, size, (size_t)(data - buffer));
+			mismatches++;
+		}
+
+		if (adler != adler_scalar || adler != adler_split || adler != reference_adler32(adler_seed, data, size))
+		{
+			printf("run %u: adler32 of %zu bytes at offset %zu differs\n", i, size, (size_t)(data - buffer));
+			mismatches++;
+		}
+	}
+
+	free(buffer);
+
+	printf("checksums: %u runs, %u mismatches\n", CHECK_runs, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
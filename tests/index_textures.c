@@ -0,0 +1,162 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks build_index_texture against to_png: on random images (some invalid), looking every pixel up the way
+// a shader would (palette strip, void or true colour layer, as the mask says) must give the RGBA of to_png
+// for every palette row, with caller palettes and with embedded ones. encode_index_texture is compared with
+// the PNG files of the layers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_images 3000
+#define CHECK_rows_max 3
+
+int main(void)
+{
+	uint32_t state = 9;
+	uint32_t lookups = 0;
+	uint32_t mismatches = 0;
+
+	for (uint32_t i = 0; i < CHECK_images; i++)
+	{
+		const uint16_t palette_count = (uint16_t)random_range(&state, 1, i % 3 == 0 ? 256 : 16);
+
+		random_image_t image =
+		{
+			(uint16_t)random_range(&state, 1, 50), (uint16_t)random_range(&state, 1, 50),
+			(uint8_t)random_range(&state, 3, 4), (uint8_t)random_range(&state, 3, 4),
+			palette_count, palette_count, 2000, 500, 40
+		};
+
+		PELX_type(palette_entry) palettes[CHECK_rows_max][256];
+		PELX_type(palette_entry) *rows[CHECK_rows_max] = { palettes[0], palettes[1], palettes[2] };
+		for (int r = 0; r < CHECK_rows_max; r++)
+		{
+			random_palette(&state, palettes[r], palette_count);
+		}
+
+		random_view_t view;
+		if (random_view(&state, &image, &view) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		const int embedded = (int)(random_next(&state) % 2);
+		const uint16_t row_count = (uint16_t)random_range(&state, 1, CHECK_rows_max);
+
+		for (uint16_t r = 0; embedded && r < row_count; r++)
+		{
+			char name[8];
+			snprintf(name, sizeof(name), "p%u", (unsigned)r);
+			PELX_func(add_palette)(&view.view, name, palettes[r]);
+		}
+
+		PELX_type(index_texture) texture = NULL;
+		const PELX_type(result) result = PELX_func(build_index_texture)(&view.view, embedded ? 0 : row_count, rows, &texture);
+
+		PELX_type(file) pelx_file = &view.view;
+
+		for (uint16_t r = 0; r < row_count; r++)
+		{
+			uint8_t *expected = NULL;
+			const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, palette_count, palettes[r], 4, &expected);
+			lookups++;
+
+			if (result != expected_result)
+			{
+				printf("image %u: %d, to_png gave %d\n", i, result, expected_result);
+				mismatches++;
+				free(expected);
+				break;
+			}
+
+			if (result != PELX_enum(success))
+			{
+				free(expected);
+				break;
+			}
+
+			uint32_t true_colour_count = 0;
+
+			for (size_t p = 0; p < (size_t)image.width * image.height; p++)
+			{
+				uint8_t pixel[4] = { 0, 0, 0, 0 };
+
+				if (texture->mask[p] == PELX_index_mask_palette)
+				{
+					memcpy(pixel, texture->palettes + ((size_t)r * 256 + texture->indices[p]) * 4, 4);
+				}
+				else if (texture->mask[p] == PELX_index_mask_true)
+				{
+					memcpy(pixel, texture->true_colour + p * 4, 4);
+					true_colour_count++;
+				}
+				else if (texture->mask[p] != PELX_index_mask_void || texture->indices[p] != 0)
+				{
+					printf("image %u: pixel %zu has mask %u and index %u\n", i, p, texture->mask[p], texture->indices[p]);
+					mismatches++;
+					break;
+				}
+
+				if (memcmp(pixel, expected + p * 4, 4) != 0)
+				{
+					printf("image %u: pixel %zu differs in row %u\n", i, p, (unsigned)r);
+					mismatches++;
+					break;
+				}
+			}
+
+			if (true_colour_count != texture->true_colour_count || texture->palette_count != row_count ||
+			    (true_colour_count == 0) != (texture->true_colour == NULL))
+			{
+				printf("image %u: %u true colour pixels counted, %u reported\n", i, true_colour_count, texture->true_colour_count);
+				mismatches++;
+			}
+
+			// Entries past the palette are transparent black
+			for (uint32_t e = palette_count; e < 256; e++)
+			{
+				if (texture->palettes[((size_t)r * 256 + e) * 4 + 3] != 0)
+				{
+					printf("image %u: unused entry %u of row %u is not transparent\n", i, e, (unsigned)r);
+					mismatches++;
+					break;
+				}
+			}
+
+			free(expected);
+		}
+
+		if (texture != NULL && i % 100 == 0)
+		{
+			const int written = PELX_func(encode_index_texture)(texture, "check_output/indices.png", "check_output/palettes.png",
+			                                                    "check_output/true_colour.png", "check_output/mask.png") == PELX_enum(success);
+
+			if (!written ||
+			    !png_file_matches("check_output/indices.png", texture->width, texture->height, 1, texture->indices) ||
+			    !png_file_matches("check_output/palettes.png", 256, texture->palette_count, 4, texture->palettes) ||
+			    !png_file_matches("check_output/mask.png", texture->width, texture->height, 1, texture->mask) ||
+			    (texture->true_colour != NULL &&
+			     !png_file_matches("check_output/true_colour.png", texture->width, texture->height, 4, texture->true_colour)))
+			{
+				printf("image %u: encode_index_texture differs\n", i);
+				mismatches++;
+			}
+
+			remove("check_output/true_colour.png");
+		}
+
+		PELX_func(free_index_texture)(&texture);
+		random_view_free(&view);
+	}
+
+	printf("index_textures: %u images, %u lookups, %u mismatches\n", CHECK_images, lookups, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
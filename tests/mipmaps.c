@@ -0,0 +1,181 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks build_mipmaps against to_png followed by a plain 2x2 reduction per level (rounded box average,
+// or the most frequent of the four pixels for mip_palette), on random images (some invalid).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_images 3000
+#define CHECK_palette_count 6
+
+// Halves a level (a side of 1 stays 1), returns the new level or NULL when out of memory
+static uint8_t *reduce(const uint8_t *level, uint32_t width, uint32_t height, uint8_t channels, int palette_filter)
+{
+	const uint32_t reduced_width = width > 1 ? width / 2 : 1;
+	const uint32_t reduced_height = height > 1 ? height / 2 : 1;
+
+	uint8_t *reduced = (uint8_t *)malloc((size_t)reduced_width * reduced_height * channels);
+	if (reduced == NULL)
+	{
+		return NULL;
+	}
+
+	for (uint32_t y = 0; y < reduced_height; y++)
+	{
+		for (uint32_t x = 0; x < reduced_width; x++)
+		{
+			const uint32_t x0 = width > 1 ? 2 * x : 0, x1 = width > 1 ? 2 * x + 1 : 0;
+			const uint32_t y0 = height > 1 ? 2 * y : 0, y1 = height > 1 ? 2 * y + 1 : 0;
+
+			const uint8_t *source[4] =
+			{
+				level + ((size_t)y0 * width + x0) * channels, level + ((size_t)y0 * width + x1) * channels,
+				level + ((size_t)y1 * width + x0) * channels, level + ((size_t)y1 * width + x1) * channels
+			};
+
+			uint8_t *out = reduced + ((size_t)y * reduced_width + x) * channels;
+
+			if (!palette_filter)
+			{
+				for (uint8_t c = 0; c < channels; c++)
+				{
+					out[c] = (uint8_t)((source[0][c] + source[1][c] + source[2][c] + source[3][c] + 2) >> 2);
+				}
+				continue;
+			}
+
+			// The first of the most frequent pixels
+			int best = 0, best_count = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				int count = 0;
+				for (int j = 0; j < 4; j++)
+				{
+					count += memcmp(source[i], source[j], channels) == 0;
+				}
+
+				if (count > best_count)
+				{
+					best = i;
+					best_count = count;
+				}
+			}
+
+			memcpy(out, source[best], channels);
+		}
+	}
+
+	return reduced;
+}
+
+int main(void)
+{
+	uint32_t state = 3;
+	uint32_t mismatches = 0;
+
+	PELX_type(palette_entry) palette[CHECK_palette_count];
+	random_palette(&state, palette, CHECK_palette_count);
+
+	for (uint32_t i = 0; i < CHECK_images; i++)
+	{
+		const int large = i % 10 == 0;
+		random_image_t image =
+		{
+			(uint16_t)random_range(&state, 1, large ? 300 : 40), (uint16_t)random_range(&state, 1, large ? 200 : 40),
+			(uint8_t)random_range(&state, 3, 4), 4,
+			CHECK_palette_count, CHECK_palette_count + 3, 3000, 100, 0
+		};
+
+		const uint8_t channels = (uint8_t)random_range(&state, 3, 4);
+		const int palette_filter = (int)(random_next(&state) % 2);
+
+		random_view_t view;
+		if (random_view(&state, &image, &view) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		PELX_type(file) pelx_file = &view.view;
+		uint8_t *expected = NULL;
+		PELX_type(mipmap) mipmap = NULL;
+
+		const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, CHECK_palette_count, palette, channels, &expected);
+		const PELX_type(result) result = PELX_func(build_mipmaps)(&view.view, CHECK_palette_count, palette, channels,
+		                                                          palette_filter ? PELX_enum(mip_palette) : PELX_enum(mip_box), &mipmap);
+
+		if (result != expected_result || (result != PELX_enum(success) && mipmap != NULL))
+		{
+			printf("image %u: %d, to_png gave %d\n", i, result, expected_result);
+			mismatches++;
+		}
+		else if (result == PELX_enum(success))
+		{
+			uint8_t *level = expected;
+			uint32_t width = image.width, height = image.height;
+			size_t offset = 0;
+			uint32_t level_count = 0;
+
+			for (;;)
+			{
+				const PELX_type(mip_level) *built = &mipmap->levels[level_count];
+				if (built->width != width || built->height != height || built->offset != offset ||
+				    memcmp(mipmap->pixels + offset, level, (size_t)width * height * channels) != 0)
+				{
+					printf("image %u: level %u (%ux%u) differs\n", i, level_count, width, height);
+					mismatches++;
+					break;
+				}
+
+				offset += (size_t)width * height * channels;
+				level_count++;
+
+				if (width == 1 && height == 1)
+				{
+					if (level_count != mipmap->level_count || offset != mipmap->size)
+					{
+						printf("image %u: %u levels of %zu bytes, expected %u of %zu\n", i,
+						       mipmap->level_count, mipmap->size, level_count, offset);
+						mismatches++;
+					}
+					break;
+				}
+
+				uint8_t *reduced = reduce(level, width, height, channels, palette_filter);
+				if (level != expected)
+				{
+					free(level);
+				}
+
+				if (reduced == NULL)
+				{
+					fprintf(stderr, "out of memory\n");
+					return 1;
+				}
+
+				level = reduced;
+				width = width > 1 ? width / 2 : 1;
+				height = height > 1 ? height / 2 : 1;
+			}
+
+			if (level != expected)
+			{
+				free(level);
+			}
+		}
+
+		free(expected);
+		PELX_func(free_mipmaps)(&mipmap);
+		random_view_free(&view);
+	}
+
+	printf("mipmaps: %u images, %u mismatches\n", CHECK_images, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
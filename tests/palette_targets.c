@@ -0,0 +1,173 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks palette targets against a full to_png after every update: random images (some invalid) are bound,
+// then take random set_palette_entries and cycle_palette calls; the pixels must equal a fresh render with the
+// updated palette, and every pixel that changed must lie in the dirty rectangle.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_images 1500
+#define CHECK_updates 20
+
+int main(void)
+{
+	uint32_t state = 5;
+	uint32_t updates = 0;
+	uint32_t mismatches = 0;
+
+	for (uint32_t i = 0; i < CHECK_images; i++)
+	{
+		// Every third image has a palette longer than the 256 indices a pixel can address
+		const uint16_t palette_count = (uint16_t)random_range(&state, 1, i % 3 == 0 ? 300 : 16);
+		const uint16_t index_limit = palette_count < 256 ? palette_count : 256;
+
+		random_image_t image =
+		{
+			(uint16_t)random_range(&state, 1, 60), (uint16_t)random_range(&state, 1, 60),
+			(uint8_t)random_range(&state, 3, 4), (uint8_t)random_range(&state, 3, 4),
+			palette_count, index_limit, 2000, 500, 0
+		};
+
+		const uint8_t channels = (uint8_t)random_range(&state, 3, 4);
+
+		PELX_type(palette_entry) palette[300];
+		random_palette(&state, palette, palette_count);
+
+		random_view_t view;
+		if (random_view(&state, &image, &view) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		PELX_type(file) pelx_file = &view.view;
+		const size_t size = (size_t)image.width * image.height * channels;
+
+		uint8_t *expected = NULL;
+		PELX_type(palette_target) target = NULL;
+
+		const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, palette_count, palette, channels, &expected);
+		const PELX_type(result) result = PELX_func(bind_palette_target)(&view.view, palette_count, palette, channels, &target);
+
+		if (result != expected_result)
+		{
+			printf("image %u: %d, to_png gave %d\n", i, result, expected_result);
+			mismatches++;
+		}
+		else if (result == PELX_enum(success) && memcmp(target->pixels, expected, size) != 0)
+		{
+			printf("image %u: bound pixels differ\n", i);
+			mismatches++;
+		}
+
+		free(expected);
+
+		uint8_t *previous = (uint8_t *)malloc(size);
+		if (previous == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		for (uint32_t u = 0; result == PELX_enum(success) && u < CHECK_updates; u++)
+		{
+			memcpy(previous, target->pixels, size);
+
+			const uint16_t first = (uint16_t)(random_next(&state) % index_limit);
+			const uint16_t count = (uint16_t)random_range(&state, 0, index_limit - first);
+			PELX_type(result) update_result;
+
+			if (random_next(&state) % 2 == 0)
+			{
+				// Some entries keep their colour, those pixels must not be rewritten
+				PELX_type(palette_entry) entries[256];
+				for (uint16_t e = 0; e < count; e++)
+				{
+					entries[e] = palette[first + e];
+					if (random_next(&state) % 3 == 0)
+					{
+						random_palette(&state, &entries[e], 1);
+					}
+				}
+
+				update_result = PELX_func(set_palette_entries)(target, first, count, entries);
+				memcpy(palette + first, entries, count * sizeof(PELX_type(palette_entry)));
+			}
+			else
+			{
+				const int32_t steps = (int32_t)random_range(&state, 0, 40) - 20;
+				update_result = PELX_func(cycle_palette)(target, first, count, steps);
+
+				PELX_type(palette_entry) cycled[256];
+				for (int32_t e = 0; e < count; e++)
+				{
+					cycled[((e + steps) % count + count) % count] = palette[first + e];
+				}
+				memcpy(palette + first, cycled, count * sizeof(PELX_type(palette_entry)));
+			}
+
+			updates++;
+
+			if (update_result != PELX_enum(success))
+			{
+				printf("image %u: update %u failed with %d\n", i, u, update_result);
+				mismatches++;
+				break;
+			}
+
+			if (PELX_func(to_png)(&pelx_file, palette_count, palette, channels, &expected) != PELX_enum(success))
+			{
+				printf("image %u: to_png failed after update %u\n", i, u);
+				mismatches++;
+				break;
+			}
+
+			if (memcmp(target->pixels, expected, size) != 0)
+			{
+				printf("image %u: pixels differ after update %u\n", i, u);
+				mismatches++;
+			}
+
+			const uint16_t *dirty = target->dirty;
+			for (uint32_t y = 0; y < image.height; y++)
+			{
+				for (uint32_t x = 0; x < image.width; x++)
+				{
+					const size_t offset = ((size_t)y * image.width + x) * channels;
+					const int inside = x >= dirty[0] && x < (uint32_t)dirty[0] + dirty[2] && y >= dirty[1] && y < (uint32_t)dirty[1] + dirty[3];
+
+					if (!inside && memcmp(previous + offset, expected + offset, channels) != 0)
+					{
+						printf("image %u: pixel %u, %u changed outside the dirty rectangle\n", i, x, y);
+						mismatches++;
+						y = image.height;
+						break;
+					}
+				}
+			}
+
+			free(expected);
+		}
+
+		// Entries past the addressable range are rejected
+		if (result == PELX_enum(success) && PELX_func(set_palette_entries)(target, index_limit, 1, palette) == PELX_enum(success))
+		{
+			printf("image %u: set_palette_entries accepted entry %u\n", i, (unsigned)index_limit);
+			mismatches++;
+		}
+
+		free(previous);
+		PELX_func(free_palette_target)(&target);
+		random_view_free(&view);
+	}
+
+	printf("palette_targets: %u images, %u updates, %u mismatches\n", CHECK_images, updates, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks that a pooled context stops allocating: sets of random images (some invalid) are encoded through one
+// init_pooled_context with encode_png_memory_context, round after round. Only the first round may reach the heap,
+// and every PNG must equal the one stb_image_write makes of a to_png of the image, errors included.
+// malloc and calloc are counted inside pelx.h; realloc is not, as it also names a context member, and a pooled
+// context only grows blocks through the pool.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t heap_allocations = 0;
+
+static void *counted_malloc(size_t size)
+{
+	heap_allocations++;
+	return malloc(size);
+}
+
+static void *counted_calloc(size_t count, size_t size)
+{
+	heap_allocations++;
+	return calloc(count, size);
+}
+
+#define malloc(size) counted_malloc(size)
+#define calloc(count, size) counted_calloc(count, size)
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_sets 200
+#define CHECK_images_max 8
+#define CHECK_rounds 4
+
+int main(void)
+{
+	uint32_t state = 19;
+	uint32_t encodes = 0;
+	uint32_t mismatches = 0;
+
+	for (uint32_t i = 0; i < CHECK_sets; i++)
+	{
+		const uint32_t image_count = random_range(&state, 1, CHECK_images_max);
+
+		random_view_t views[CHECK_images_max];
+		PELX_type(palette_entry) palettes[CHECK_images_max][256];
+		uint16_t palette_counts[CHECK_images_max];
+		uint8_t channels[CHECK_images_max];
+
+		for (uint32_t v = 0; v < image_count; v++)
+		{
+			// Every 20th set has a large image, whose deflate buffers grow several times
+			const int large = i % 20 == 0 && v == 0;
+			palette_counts[v] = (uint16_t)random_range(&state, 1, v % 3 == 0 ? 256 : 16);
+
+			random_image_t image =
+			{
+				(uint16_t)random_range(&state, 1, large ? 300 : 40), (uint16_t)random_range(&state, 1, large ? 200 : 40),
+				(uint8_t)random_range(&state, 3, 4), (uint8_t)random_range(&state, 3, 4),
+				palette_counts[v], palette_counts[v], 20000, 5000, 50
+			};
+
+			channels[v] = (uint8_t)random_range(&state, 3, 4);
+			random_palette(&state, palettes[v], palette_counts[v]);
+
+			if (random_view(&state, &image, &views[v]) != 0)
+			{
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+		}
+
+		PELX_type(context) context;
+		if (PELX_func(init_pooled_context)(&context) != PELX_enum(success))
+		{
+			fprintf(stderr, "init_pooled_context failed\n");
+			return 1;
+		}
+
+		const size_t set_allocations = heap_allocations;
+
+		for (uint32_t round = 0; round < CHECK_rounds; round++)
+		{
+			for (uint32_t v = 0; v < image_count; v++)
+			{
+				const uint8_t *png = NULL;
+				size_t png_size = 0;
+
+				const size_t allocations = heap_allocations;
+				const PELX_type(result) result = PELX_func(encode_png_memory_context)(&context, &views[v].view, palette_counts[v],
+				                                                                      palettes[v], channels[v], &png, &png_size);
+				const size_t new_allocations = heap_allocations - allocations;
+				encodes++;
+
+				if (round > 0 && new_allocations != 0)
+				{
+					printf("set %u: image %u made %zu heap allocations in round %u\n", i, v, new_allocations, round);
+					mismatches++;
+				}
+
+				PELX_type(file) pelx_file = &views[v].view;
+				uint8_t *expected = NULL;
+				const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, palette_counts[v], palettes[v], channels[v], &expected);
+
+				if (result != expected_result)
+				{
+					printf("set %u: image %u gave %d, to_png %d\n", i, v, result, expected_result);
+					mismatches++;
+				}
+				else if (result == PELX_enum(success))
+				{
+					int length = 0;
+					uint8_t *expected_png = PELX_func(png_to_memory)(views[v].view.header.width, views[v].view.header.height,
+					                                                 channels[v], expected, &length);
+
+					if (expected_png == NULL || png_size != (size_t)length || memcmp(png, expected_png, png_size) != 0)
+					{
+						printf("set %u: image %u differs in round %u\n", i, v, round);
+						mismatches++;
+					}
+
+					STBIW_FREE(expected_png);
+				}
+
+				free(expected);
+			}
+		}
+
+		// The first round fills the pool through malloc, a count of nothing means the counting missed pelx.h
+		if (heap_allocations == set_allocations)
+		{
+			printf("set %u: no heap allocations were counted\n", i);
+			mismatches++;
+		}
+
+		PELX_func(free_context)(&context);
+
+		for (uint32_t v = 0; v < image_count; v++)
+		{
+			random_view_free(&views[v]);
+		}
+	}
+
+	printf("pooled_context: %u sets, %u encodes, %u mismatches\n", CHECK_sets, encodes, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
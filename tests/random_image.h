@@ -0,0 +1,163 @@
+// (c) A. C. Gäßler 2025
+//
+// Random PELX images for the differential checks, generated with a fixed seed so that every run checks
+// the same inputs. Images are views over a caller buffer, some with invalid tags, palette indices out of
+// range or pixel data cut short, so that the checks also compare how errors are reported.
+// Everything is static inline, as not every check uses every helper.
+
+#if !defined (__PELX_TESTS_RANDOM_IMAGE_H__)
+#define __PELX_TESTS_RANDOM_IMAGE_H__ 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pelx.h"
+
+typedef struct
+{
+	uint16_t width;
+	uint16_t height;
+	uint8_t true_channels;
+	uint8_t palette_channels;
+	uint16_t palette_count; // entries of the header
+	uint16_t index_limit; // palette indices are drawn below this, indices at or above palette_count are errors
+	uint32_t invalid_tag_rate; // about one pixel in this many gets an invalid tag, 0 for none
+	uint32_t invalid_index_rate; // about one palette pixel in this many gets index_limit, 0 for none
+	uint32_t truncate_rate; // about one image in this many is cut short, 0 for none
+} random_image_t;
+
+typedef struct
+{
+	PELX_type(file_data) view;
+	uint8_t *body;
+} random_view_t;
+
+static inline uint32_t random_next(uint32_t *state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// A value in [low, high]
+static inline uint32_t random_range(uint32_t *state, uint32_t low, uint32_t high)
+{
+	return low + random_next(state) % (high - low + 1);
+}
+
+static inline void random_palette(uint32_t *state, PELX_type(palette_entry) *entries, uint16_t count)
+{
+	for (uint16_t i = 0; i < count; i++)
+	{
+		const uint32_t value = random_next(state);
+		entries[i].r = (uint8_t)value;
+		entries[i].g = (uint8_t)(value >> 8);
+		entries[i].b = (uint8_t)(value >> 16);
+		entries[i].a = (uint8_t)(value >> 24);
+	}
+}
+
+// Fills view with random pixels as described by image, free with random_view_free
+static inline int random_view(uint32_t *state, const random_image_t *image, random_view_t *view)
+{
+	const size_t pixel_count = (size_t)image->width * image->height;
+
+	view->body = (uint8_t *)malloc(pixel_count * 5 + 1);
+	if (view->body == NULL)
+	{
+		return -1;
+	}
+
+	size_t size = 0;
+	for (size_t p = 0; p < pixel_count; p++)
+	{
+		uint8_t tag = (uint8_t)(random_next(state) % 3);
+		if (image->invalid_tag_rate > 0 && random_next(state) % image->invalid_tag_rate == 0)
+		{
+			tag = (uint8_t)random_range(state, 3, 255);
+		}
+
+		view->body[size++] = tag;
+
+		if (tag == PELX_tag_true)
+		{
+			for (uint8_t c = 0; c < image->true_channels; c++)
+			{
+				view->body[size++] = (uint8_t)random_next(state);
+			}
+		}
+		else if (tag == PELX_tag_pale)
+		{
+			uint32_t index = random_next(state) % image->index_limit;
+			if (image->invalid_index_rate > 0 && random_next(state) % image->invalid_index_rate == 0)
+			{
+				index = image->index_limit;
+			}
+
+			view->body[size++] = (uint8_t)(index < 255 ? index : 255);
+		}
+	}
+
+	if (image->truncate_rate > 0 && random_next(state) % image->truncate_rate == 0 && size > 0)
+	{
+		size -= random_next(state) % size;
+	}
+
+	const PELX_type(header) header =
+	{
+		{ 'P', 'E', 'L', 'X', '\0' }, 26, 26, image->width, image->height,
+		image->palette_channels, image->true_channels, image->palette_count, { 0 }
+	};
+
+	if (PELX_func(init_view)(&view->view, &header, view->body, (uint32_t)size) != PELX_enum(success))
+	{
+		free(view->body);
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline void random_view_free(random_view_t *view)
+{
+	PELX_type(file) pelx_file = &view->view;
+	PELX_func(free_file)(&pelx_file); // frees the embedded palettes a check may have added, never the body
+	free(view->body);
+	view->body = NULL;
+}
+
+// Returns non-zero when file holds exactly the PNG stb_image_write produces for pixels
+static inline int png_file_matches(const char *file, int width, int height, int channels, const uint8_t *pixels)
+{
+	int length = 0;
+	uint8_t *png = PELX_func(png_to_memory)(width, height, channels, pixels, &length);
+	if (png == NULL)
+	{
+		return 0;
+	}
+
+	int matches = 0;
+
+	FILE *fp = fopen(file, "rb");
+	if (fp != NULL)
+	{
+		uint8_t *written = (uint8_t *)malloc((size_t)length + 1);
+		if (written != NULL)
+		{
+			matches = fread(written, 1, (size_t)length + 1, fp) == (size_t)length && memcmp(written, png, (size_t)length) == 0;
+			free(written);
+		}
+		fclose(fp);
+	}
+
+	STBIW_FREE(png);
+	return matches;
+}
+
+#endif // __PELX_TESTS_RANDOM_IMAGE_H__
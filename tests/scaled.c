@@ -0,0 +1,101 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks to_png_scaled and encode_png_scaled against to_png followed by a plain nearest-neighbour upscale,
+// on random images (some invalid) at every scale, including the invalid scales 0 and PELX_scale_max + 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_images 20000
+#define CHECK_palette_count 6
+
+int main(void)
+{
+	uint32_t state = 1;
+	uint32_t mismatches = 0;
+
+	PELX_type(palette_entry) palette[CHECK_palette_count];
+	random_palette(&state, palette, CHECK_palette_count);
+
+	for (uint32_t i = 0; i < CHECK_images; i++)
+	{
+		const int large = i % 100 == 0;
+		random_image_t image =
+		{
+			(uint16_t)random_range(&state, 1, large ? 200 : 19), (uint16_t)random_range(&state, 1, large ? 100 : 7),
+			(uint8_t)random_range(&state, 3, 4), (uint8_t)random_range(&state, 3, 4),
+			CHECK_palette_count, CHECK_palette_count + 3, 500, 0, 50
+		};
+
+		const uint8_t channels = (uint8_t)random_range(&state, 3, 4);
+		const uint8_t scale = (uint8_t)random_range(&state, 0, PELX_scale_max + 1);
+
+		random_view_t view;
+		if (random_view(&state, &image, &view) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		PELX_type(file) pelx_file = &view.view;
+		uint8_t *expected = NULL;
+		uint8_t *scaled = NULL;
+
+		const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, CHECK_palette_count, palette, channels, &expected);
+		const PELX_type(result) result = PELX_func(to_png_scaled)(&pelx_file, CHECK_palette_count, palette, channels, scale, &scaled);
+
+		if (scale == 0 || scale > PELX_scale_max)
+		{
+			if (result != PELX_enum(invalid_scale) || scaled != NULL)
+			{
+				printf("image %u: scale %u gave %d, expected invalid_scale\n", i, (unsigned)scale, result);
+				mismatches++;
+			}
+		}
+		else if (result != expected_result)
+		{
+			printf("image %u: %d, to_png gave %d\n", i, result, expected_result);
+			mismatches++;
+		}
+		else if (result == PELX_enum(success))
+		{
+			const size_t width = image.width;
+			const size_t scaled_width = width * scale;
+
+			for (size_t y = 0; y < (size_t)image.height * scale; y++)
+			{
+				for (size_t x = 0; x < scaled_width; x++)
+				{
+					if (memcmp(scaled + (y * scaled_width + x) * channels, expected + ((y / scale) * width + x / scale) * channels, channels) != 0)
+					{
+						printf("image %u: pixel %zu, %zu differs at scale %u\n", i, x, y, (unsigned)scale);
+						mismatches++;
+						y = (size_t)image.height * scale;
+						break;
+					}
+				}
+			}
+
+			if (i % 200 == 0 &&
+			    (PELX_func(encode_png_scaled)("check_output/scaled.png", &view.view, CHECK_palette_count, palette, channels, scale) != PELX_enum(success) ||
+			     !png_file_matches("check_output/scaled.png", (int)scaled_width, image.height * scale, channels, scaled)))
+			{
+				printf("image %u: encode_png_scaled differs\n", i);
+				mismatches++;
+			}
+		}
+
+		free(expected);
+		free(scaled);
+		random_view_free(&view);
+	}
+
+	printf("scaled: %u images, %u mismatches\n", CHECK_images, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+// (c) A. C. Gäßler 2025
+//
+// Checks validate_pixels and to_png_unchecked against to_png: on random images (some invalid), validate_pixels
+// must accept exactly the images to_png renders and report the same error otherwise, and to_png_unchecked must
+// render the same pixels as to_png (with the same palettes, some too short) and reject validations of other data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+#include "random_image.h"
+
+#define CHECK_images 20000
+
+int main(void)
+{
+	uint32_t state = 13;
+	uint32_t accepted = 0;
+	uint32_t mismatches = 0;
+
+	for (uint32_t i = 0; i < CHECK_images; i++)
+	{
+		const uint16_t palette_count = (uint16_t)random_range(&state, 1, i % 3 == 0 ? 256 : 16);
+		const int large = i % 100 == 0;
+
+		random_image_t image =
+		{
+			(uint16_t)random_range(&state, 1, large ? 300 : 40), (uint16_t)random_range(&state, 1, large ? 200 : 40),
+			(uint8_t)random_range(&state, 3, 4), (uint8_t)random_range(&state, 3, 4),
+			palette_count, palette_count, 5000, 1000, 20
+		};
+
+		const uint8_t channels = (uint8_t)random_range(&state, 3, 4);
+
+		PELX_type(palette_entry) palette[256];
+		random_palette(&state, palette, palette_count);
+
+		random_view_t view;
+		if (random_view(&state, &image, &view) != 0)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		PELX_type(file) pelx_file = &view.view;
+		const size_t size = (size_t)image.width * image.height * channels;
+
+		PELX_type(validation) validation;
+		const PELX_type(result) result = PELX_func(validate_pixels)(&view.view, &validation);
+
+		uint8_t *expected = NULL;
+		const PELX_type(result) expected_result = PELX_func(to_png)(&pelx_file, palette_count, palette, channels, &expected);
+
+		if (result != expected_result || validation.result != result ||
+		    (result == PELX_enum(success)) != (validation.error_offset == UINT32_MAX))
+		{
+			printf("image %u: validate_pixels gave %d, to_png %d\n", i, result, expected_result);
+			mismatches++;
+		}
+
+		if (result == PELX_enum(success))
+		{
+			accepted++;
+
+			uint8_t *unchecked = NULL;
+			if (PELX_func(to_png_unchecked)(&pelx_file, &validation, palette_count, palette, channels, &unchecked) != PELX_enum(success) ||
+			    memcmp(unchecked, expected, size) != 0)
+			{
+				printf("image %u: to_png_unchecked differs\n", i);
+				mismatches++;
+			}
+			free(unchecked);
+
+			// With a shorter palette both reject the same images
+			const uint16_t short_count = (uint16_t)random_range(&state, 1, palette_count);
+			uint8_t *short_expected = NULL;
+			unchecked = NULL;
+
+			const PELX_type(result) short_expected_result = PELX_func(to_png)(&pelx_file, short_count, palette, channels, &short_expected);
+			const PELX_type(result) short_result = PELX_func(to_png_unchecked)(&pelx_file, &validation, short_count, palette, channels, &unchecked);
+
+			if (short_result != short_expected_result ||
+			    (short_result == PELX_enum(success) && memcmp(unchecked, short_expected, size) != 0))
+			{
+				printf("image %u: to_png_unchecked with %u entries gave %d, to_png %d\n", i, (unsigned)short_count, short_result, short_expected_result);
+				mismatches++;
+			}
+			free(unchecked);
+			free(short_expected);
+
+			// A validation is only accepted for the pixel data it checked
+			PELX_type(validation) other = validation;
+			other.body_size--;
+			unchecked = NULL;
+
+			if (PELX_func(to_png_unchecked)(&pelx_file, &other, palette_count, palette, channels, &unchecked) != PELX_enum(invalid_data_format) ||
+			    unchecked != NULL)
+			{
+				printf("image %u: to_png_unchecked accepted a validation of other pixel data\n", i);
+				mismatches++;
+			}
+		}
+		else
+		{
+			uint8_t *unchecked = NULL;
+			if (PELX_func(to_png_unchecked)(&pelx_file, &validation, palette_count, palette, channels, &unchecked) != PELX_enum(invalid_data_format) ||
+			    unchecked != NULL)
+			{
+				printf("image %u: to_png_unchecked accepted a failed validation\n", i);
+				mismatches++;
+			}
+		}
+
+		free(expected);
+		random_view_free(&view);
+	}
+
+	printf("validation: %u images, %u accepted, %u mismatches\n", CHECK_images, accepted, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
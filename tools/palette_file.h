@@ -0,0 +1,101 @@
+// (c) A. C. Gäßler 2025
+//
+// Palette files shared by the tools: one RRGGBB or RRGGBBAA hex entry per line, '#' starts a comment
+
+#if !defined (__PELX_TOOLS_PALETTE_FILE_H__)
+#define __PELX_TOOLS_PALETTE_FILE_H__ 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pelx.h"
+
+#define PALETTE_FILE_max_entries 256
+
+static int palette_file_hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Reads a palette file, returns the number of entries or 0 on failure
+static uint16_t read_palette_file(const char *path, PELX_type(palette_entry) entries[PALETTE_FILE_max_entries])
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "cannot open palette %s\n", path);
+		return 0;
+	}
+
+	uint16_t count = 0;
+	unsigned line_number = 0;
+	char line[256];
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		line_number++;
+
+		char *comment = strchr(line, '#');
+		if (comment != NULL)
+		{
+			*comment = '\0';
+		}
+
+		char digits[8];
+		size_t digit_count = 0;
+		int valid = 1;
+
+		for (const char *c = line; *c != '\0' && valid; c++)
+		{
+			if (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+			{
+				continue;
+			}
+
+			valid = palette_file_hex_digit(*c) >= 0 && digit_count < 8;
+			if (valid)
+			{
+				digits[digit_count++] = *c;
+			}
+		}
+
+		if (digit_count == 0 && valid)
+		{
+			continue;
+		}
+
+		if (!valid || (digit_count != 6 && digit_count != 8) || count == PALETTE_FILE_max_entries)
+		{
+			fprintf(stderr, "%s:%u: expected an RRGGBB or RRGGBBAA entry\n", path, line_number);
+			fclose(fp);
+			return 0;
+		}
+
+		uint8_t channel[4] = { 0x00, 0x00, 0x00, 0xFF };
+		for (size_t i = 0; i < digit_count / 2; i++)
+		{
+			channel[i] = (uint8_t)(palette_file_hex_digit(digits[i * 2]) << 4 | palette_file_hex_digit(digits[i * 2 + 1]));
+		}
+
+		entries[count].r = channel[0];
+		entries[count].g = channel[1];
+		entries[count].b = channel[2];
+		entries[count].a = channel[3];
+		count++;
+	}
+
+	fclose(fp);
+
+	if (count == 0)
+	{
+		fprintf(stderr, "%s holds no entries\n", path);
+	}
+
+	return count;
+}
+
+#endif // __PELX_TOOLS_PALETTE_FILE_H__
@@ -0,0 +1,351 @@
+// (c) A. C. Gäßler 2025
+//
+// pelx2c: converts a PELX file into a C header, so the image can be embedded without any parsing at runtime
+//
+// Usage: pelx2c [-n name] [-r] [-p palette]... [-o output.h] <file.pelx>
+//
+// The header holds, prefixed with name (the file name by default):
+//     name_width, name_height, ...    -> the header fields as constants
+//     name_header                     -> the header, as decode_pelx would return it
+//     name_body                       -> the pixel data
+//     name_rows (-r)                  -> offset into name_body of the first pixel of every row
+//     name_palette_<palette>          -> every palette of the file and of the -p files, resolved to RGBA
+//                                        (alpha forced opaque for 3 channel palettes)
+//                                        two palettes mapping to the same symbol ("a-b" and "a_b") are an error
+//
+// init_view(&view, &name_header, name_body, name_body_size) gives a file for to_png and the encoders, without copies.
+// Arrays are declared PELX_constexpr, so pelx::decode_embedded of pelx.hpp can also decode them while compiling.
+// A palette file holds one RRGGBB or RRGGBBAA hex entry per line, '#' starts a comment.
+// Makefiles can include pelx2c.mk for a rule generating name_pelx.h from name.pelx.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+#include "palette_file.h"
+
+#define PELX2C_max_palette_files 64
+#define PELX2C_max_symbol (PELX_palette_name_max + 2)
+
+// Turns length characters of text into a C identifier
+static void identifier(const char *text, size_t length, char *output, size_t size)
+{
+	size_t n = 0;
+	if (length == 0 || (text[0] >= '0' && text[0] <= '9'))
+	{
+		output[n++] = '_';
+	}
+
+	for (size_t i = 0; i < length && n + 1 < size; i++)
+	{
+		const char c = text[i];
+		const int alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+		output[n++] = alnum ? c : '_';
+	}
+
+	output[n] = '\0';
+}
+
+// Turns the file name of path, without directory and extension, into a C identifier
+static void file_identifier(const char *path, char *output, size_t size)
+{
+	const char *slash = strrchr(path, '/');
+	const char *name = slash != NULL ? slash + 1 : path;
+	const char *dot = strrchr(name, '.');
+
+	identifier(name, dot != NULL && dot != name ? (size_t)(dot - name) : strlen(name), output, size);
+}
+
+// Names palette i (the embedded palettes, then the -p files) as name_palette_<symbol> names it
+static void palette_symbol(const PELX_type(file_data) *pelx_data, char *const *palette_files, uint32_t i,
+                           char symbol[PELX2C_max_symbol])
+{
+	if (i < pelx_data->palettes.count)
+	{
+		const char *palette_name = pelx_data->palettes.data[i].name;
+		identifier(palette_name, strlen(palette_name), symbol, PELX2C_max_symbol);
+	}
+	else
+	{
+		file_identifier(palette_files[i - pelx_data->palettes.count], symbol, PELX2C_max_symbol);
+	}
+}
+
+// Returns 0 when every palette gets its own symbol, e.g. "a-b" and "a_b" would both become name_palette_a_b
+static int check_palette_symbols(const char *name, const PELX_type(file_data) *pelx_data,
+                                 uint32_t palette_file_count, char *const *palette_files)
+{
+	const uint32_t count = pelx_data->palettes.count + palette_file_count;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		char symbol[PELX2C_max_symbol];
+		palette_symbol(pelx_data, palette_files, i, symbol);
+
+		for (uint32_t j = 0; j < i; j++)
+		{
+			char other[PELX2C_max_symbol];
+			palette_symbol(pelx_data, palette_files, j, other);
+
+			if (strcmp(symbol, other) == 0)
+			{
+				fprintf(stderr, "palettes %s and %s would both be %s_palette_%s, rename one of them\n",
+				        j < pelx_data->palettes.count ? pelx_data->palettes.data[j].name : palette_files[j - pelx_data->palettes.count],
+				        i < pelx_data->palettes.count ? pelx_data->palettes.data[i].name : palette_files[i - pelx_data->palettes.count],
+				        name, symbol);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void write_palette(FILE *out, const char *name, const char *symbol, const char *palette_name, const char *source,
+                          uint16_t count, const PELX_type(palette_entry) *entries, uint8_t palette_channels)
+{
+	fprintf(out, "\n// Palette %s (%s)\n", palette_name, source);
+	fprintf(out, "static PELX_constexpr PELX_type(palette_entry) %s_palette_%s[%u] =\n{\n", name, symbol, (unsigned)count);
+
+	for (uint16_t i = 0; i < count; i++)
+	{
+		fprintf(out, "\t{ 0x%02X, 0x%02X, 0x%02X, 0x%02X },\n", entries[i].r, entries[i].g, entries[i].b,
+		        palette_channels == 4 ? entries[i].a : 0xFF);
+	}
+
+	fprintf(out, "};\n");
+}
+
+// Writes the offset of the first pixel of every row, the pixel data must be valid
+static void write_rows(FILE *out, const char *name, const PELX_type(file_data) *pelx_data)
+{
+	const uint8_t *body = pelx_data->body.data;
+	const uint16_t width = pelx_data->header.width;
+	uint32_t pos = 0;
+
+	fprintf(out, "\n// Offset into %s_body of the first pixel of every row\n", name);
+	fprintf(out, "static PELX_constexpr uint32_t %s_rows[%u] =\n{", name, (unsigned)pelx_data->header.height);
+
+	for (uint16_t y = 0; y < pelx_data->header.height; y++)
+	{
+		fprintf(out, "%s%u,", y % 8 == 0 ? "\n\t" : " ", pos);
+
+		for (uint16_t x = 0; x < width; x++)
+		{
+			const uint8_t tag = body[pos];
+			pos += tag == PELX_tag_true ? 1u + pelx_data->header.true_channel_count : tag == PELX_tag_pale ? 2u : 1u;
+		}
+	}
+
+	fprintf(out, "\n};\n");
+}
+
+static void write_header(FILE *out, const char *input, const char *name, const PELX_type(file_data) *pelx_data,
+                         int rows, uint32_t palette_file_count, char *const *palette_files,
+                         uint16_t *palette_counts, PELX_type(palette_entry) (*palette_entries)[PALETTE_FILE_max_entries])
+{
+	const PELX_type(header) *header = &pelx_data->header;
+
+	char guard[256]; // name in upper case
+	size_t length = 0;
+	for (const char *c = name; *c != '\0'; c++)
+	{
+		guard[length++] = *c >= 'a' && *c <= 'z' ? (char)(*c - 'a' + 'A') : *c;
+	}
+	guard[length] = '\0';
+
+	fprintf(out, "// Generated by pelx2c from %s, do not edit\n\n", input);
+	fprintf(out, "#if !defined (__PELX2C_%s_H__)\n#define __PELX2C_%s_H__ 1\n\n#include \"pelx.h\"\n\n", guard, guard);
+
+	fprintf(out, "#define %s_width %u\n", name, (unsigned)header->width);
+	fprintf(out, "#define %s_height %u\n", name, (unsigned)header->height);
+	fprintf(out, "#define %s_true_channel_count %u\n", name, (unsigned)header->true_channel_count);
+	fprintf(out, "#define %s_palette_channel_count %u\n", name, (unsigned)header->palette_channel_count);
+	fprintf(out, "#define %s_palette_count %u\n", name, (unsigned)header->palette_count);
+	fprintf(out, "#define %s_body_size %u\n\n", name, (unsigned)pelx_data->body.size);
+
+	fprintf(out, "static PELX_constexpr PELX_type(header) %s_header =\n{\n", name);
+	fprintf(out, "\t{ 'P', 'E', 'L', 'X', '\\0' }, %u, %u, %u, %u, %u, %u, %u,\n",
+	        (unsigned)header->header_size, (unsigned)header->palette_offset, (unsigned)header->width, (unsigned)header->height,
+	        (unsigned)header->palette_channel_count, (unsigned)header->true_channel_count, (unsigned)header->palette_count);
+	fprintf(out, "\t{ 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X }\n};\n\n", header->reserved[0], header->reserved[1],
+	        header->reserved[2], header->reserved[3], header->reserved[4]);
+
+	fprintf(out, "static PELX_constexpr uint8_t %s_body[%u] =\n{", name, (unsigned)pelx_data->body.size);
+	for (uint32_t i = 0; i < pelx_data->body.size; i++)
+	{
+		fprintf(out, "%s0x%02X,", i % 16 == 0 ? "\n\t" : " ", pelx_data->body.data[i]);
+	}
+	fprintf(out, "\n};\n");
+
+	if (rows)
+	{
+		write_rows(out, name, pelx_data);
+	}
+
+	for (uint16_t i = 0; i < pelx_data->palettes.count; i++)
+	{
+		const PELX_type(palette) *palette = &pelx_data->palettes.data[i];
+
+		char symbol[PELX2C_max_symbol];
+		palette_symbol(pelx_data, palette_files, i, symbol);
+		write_palette(out, name, symbol, palette->name, "embedded", header->palette_count, palette->entries,
+		              header->palette_channel_count);
+	}
+
+	for (uint32_t i = 0; i < palette_file_count; i++)
+	{
+		char symbol[PELX2C_max_symbol];
+		palette_symbol(pelx_data, palette_files, pelx_data->palettes.count + i, symbol);
+		write_palette(out, name, symbol, symbol, palette_files[i], palette_counts[i], palette_entries[i], 4);
+	}
+
+	fprintf(out, "\n#endif // __PELX2C_%s_H__\n", guard);
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-n name] [-r] [-p palette]... [-o output.h] <file.pelx>\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	const char *name_option = NULL;
+	const char *output = NULL;
+	int rows = 0;
+
+	char *palette_files[PELX2C_max_palette_files];
+	uint32_t palette_file_count = 0;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (strcmp(argv[arg], "-r") == 0)
+		{
+			rows = 1;
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0)
+		{
+			name_option = argv[++arg];
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-o") == 0)
+		{
+			output = argv[++arg];
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-p") == 0 && palette_file_count < PELX2C_max_palette_files)
+		{
+			palette_files[palette_file_count++] = argv[++arg];
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (arg + 1 != argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *input = argv[arg];
+
+	char name[256];
+	if (name_option != NULL)
+	{
+		identifier(name_option, strlen(name_option), name, sizeof(name));
+	}
+	else
+	{
+		file_identifier(input, name, sizeof(name));
+	}
+
+	PELX_type(palette_entry) (*palette_entries)[PALETTE_FILE_max_entries] =
+		(PELX_type(palette_entry) (*)[PALETTE_FILE_max_entries])malloc((palette_file_count + 1) * sizeof(*palette_entries));
+	uint16_t palette_counts[PELX2C_max_palette_files];
+
+	if (palette_entries == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < palette_file_count; i++)
+	{
+		if ((palette_counts[i] = read_palette_file(palette_files[i], palette_entries[i])) == 0)
+		{
+			free(palette_entries);
+			return 1;
+		}
+	}
+
+	PELX_type(file) pelx_file = NULL;
+	PELX_type(result) result = PELX_func(decode_pelx)(input, &pelx_file);
+	if (result != PELX_enum(success))
+	{
+		fprintf(stderr, "cannot decode %s (error code %d)\n", input, result);
+		free(palette_entries);
+		return 1;
+	}
+
+	const int animated = (pelx_file->header.reserved[0] & PELX_flag_animated) != 0;
+	if (!animated)
+	{
+		PELX_type(validation) validation;
+		result = PELX_func(validate_pixels)(pelx_file, &validation);
+		if (result != PELX_enum(success))
+		{
+			fprintf(stderr, "%s: invalid pixel data at offset %u (error code %d)\n", input, validation.error_offset, result);
+			PELX_func(free_file)(&pelx_file);
+			free(palette_entries);
+			return 1;
+		}
+	}
+	else if (rows)
+	{
+		fprintf(stderr, "%s: animations have no row index, ignoring -r\n", input);
+		rows = 0;
+	}
+
+	if (check_palette_symbols(name, pelx_file, palette_file_count, palette_files) != 0)
+	{
+		PELX_func(free_file)(&pelx_file);
+		free(palette_entries);
+		return 1;
+	}
+
+	FILE *out = output != NULL ? fopen(output, "w") : stdout;
+	if (out == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", output);
+		PELX_func(free_file)(&pelx_file);
+		free(palette_entries);
+		return 1;
+	}
+
+	write_header(out, input, name, pelx_file, rows, palette_file_count, palette_files, palette_counts, palette_entries);
+
+	int status = 0;
+	if (ferror(out))
+	{
+		fprintf(stderr, "cannot write %s\n", output != NULL ? output : "the header");
+		status = 1;
+	}
+
+	if (output != NULL && fclose(out) != 0)
+	{
+		status = 1;
+	}
+
+	if (status != 0 && output != NULL)
+	{
+		remove(output);
+	}
+
+	PELX_func(free_file)(&pelx_file);
+	free(palette_entries);
+	return status;
+}
@@ -0,0 +1,13 @@
+# Rule generating name_pelx.h from name.pelx with pelx2c, to be included by other Makefiles:
+#
+#     PELX2C := path/to/tools/pelx2c
+#     PELX2C_FLAGS := -r -p palettes/overworld.txt
+#     include path/to/tools/pelx2c.mk
+#
+#     game.o: sprites/mushroom_pelx.h
+
+PELX2C       ?= pelx2c
+PELX2C_FLAGS ?=
+
+%_pelx.h: %.pelx $(PELX2C)
+	$(PELX2C) $(PELX2C_FLAGS) -o $@ $<
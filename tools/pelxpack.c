@@ -0,0 +1,104 @@
+// (c) A. C. Gäßler 2025
+//
+// pelxpack: builds a PELX pack from every .pelx file of a directory,
+// entries are named after their file name without the extension
+//
+// Usage: pelxpack <output.pelxpack> <directory>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h> // for opendir
+
+#define PELX_with_implementation 1
+#include "pelx.h"
+
+static int has_pelx_extension(const char *name)
+{
+	size_t length = strlen(name);
+	return length > 5 && strcmp(name + length - 5, ".pelx") == 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <output.pelxpack> <directory>\n", argv[0]);
+		return 1;
+	}
+
+	DIR *dir = opendir(argv[2]);
+	if (dir == NULL)
+	{
+		fprintf(stderr, "cannot open directory %s\n", argv[2]);
+		return 1;
+	}
+
+	char **names = NULL;
+	PELX_type(file) *images = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	int status = 0;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (!has_pelx_extension(entry->d_name))
+		{
+			continue;
+		}
+
+		if (count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			names = (char **)realloc(names, capacity * sizeof(*names));
+			images = (PELX_type(file) *)realloc(images, capacity * sizeof(*images));
+			if (names == NULL || images == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+		}
+
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", argv[2], entry->d_name);
+
+		PELX_type(result) result = PELX_func(decode_pelx)(path, &images[count]);
+		if (result != PELX_enum(success))
+		{
+			fprintf(stderr, "skipping %s: decoding failed with error code %d\n", path, result);
+			continue;
+		}
+
+		size_t name_length = strlen(entry->d_name) - 5;
+		names[count] = (char *)malloc(name_length + 1);
+		memcpy(names[count], entry->d_name, name_length);
+		names[count][name_length] = '\0';
+		count++;
+	}
+
+	closedir(dir);
+
+	PELX_type(result) result = PELX_func(encode_pack)(argv[1], count, (const char *const *)names, images);
+	if (result != PELX_enum(success))
+	{
+		fprintf(stderr, "writing %s failed with error code %d\n", argv[1], result);
+		status = 1;
+	}
+	else
+	{
+		printf("packed %u images into %s\n", count, argv[1]);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		PELX_func(free_file)(&images[i]);
+		free(names[i]);
+	}
+
+	free(names);
+	free(images);
+
+	return status;
+}
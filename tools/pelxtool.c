@@ -0,0 +1,509 @@
+// (c) A. C. Gäßler 2025
+//
+// pelxtool: inspects, validates and converts PELX files, every run ends with a report of
+// the throughput and the per-file latency (p50, p99 and max)
+//
+// Usage: pelxtool info <file.pelx>...
+//        pelxtool validate <file.pelx>...
+//        pelxtool convert [-o directory] [-c channels] <palette> <file.pelx>...
+//        pelxtool batch [-o directory] [-c channels] [-j threads] <palette> <file.pelx>...
+//
+// Files may be given as glob patterns (quoted, so the shell passes them on), e.g. 'sprites/*.pelx'.
+// PNG files are written next to their input, or into the -o directory, with the .pelx extension replaced.
+// A palette file holds one RRGGBB or RRGGBBAA hex entry per line, '#' starts a comment.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glob.h> // for glob
+#include <pthread.h> // for the report mutex
+#include <sys/stat.h> // for stat
+
+#define PELX_with_implementation 1
+#define PELX_with_stats 1
+#define PELX_with_tracing 1
+#include "pelx.h"
+#include "palette_file.h"
+
+typedef struct
+{
+	double *seconds; // latency per file
+	size_t count;
+	size_t capacity;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint32_t failures;
+} report_t;
+
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+static report_t report;
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t file_size(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static void report_latency(double seconds)
+{
+	pthread_mutex_lock(&report_mutex);
+
+	if (report.count == report.capacity)
+	{
+		report.capacity = report.capacity ? report.capacity * 2 : 256;
+		report.seconds = (double *)realloc(report.seconds, report.capacity * sizeof(double));
+		if (report.seconds == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+
+	report.seconds[report.count++] = seconds;
+
+	pthread_mutex_unlock(&report_mutex);
+}
+
+// Batch jobs are timed through the trace spans encode_batch emits around each of them
+static __thread uint64_t batch_job_start;
+
+static void batch_job_span(void *user, const char *span, int begin, uint64_t nanoseconds)
+{
+	(void)user;
+
+	if (strcmp(span, "batch_job") != 0)
+	{
+		return;
+	}
+
+	if (begin)
+	{
+		batch_job_start = nanoseconds;
+	}
+	else
+	{
+		report_latency((double)(nanoseconds - batch_job_start) * 1e-9);
+	}
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *values, size_t count, double p)
+{
+	size_t rank = (size_t)(p * (double)count + 0.999999);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+
+	return values[rank > count ? count - 1 : rank - 1];
+}
+
+static void print_report(const char *command, double seconds)
+{
+	printf("\n%s: %zu files, %u failed, %.3f s\n", command, report.count, report.failures, seconds);
+
+	if (report.count == 0 || seconds <= 0.0)
+	{
+		return;
+	}
+
+	qsort(report.seconds, report.count, sizeof(double), compare_doubles);
+
+	printf("throughput: %.1f files/s, %.2f MB/s in", (double)report.count / seconds, (double)report.bytes_in / seconds / 1e6);
+	if (report.bytes_out > 0)
+	{
+		printf(", %.2f MB/s out", (double)report.bytes_out / seconds / 1e6);
+	}
+	printf("\n");
+
+	printf("latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+	       percentile(report.seconds, report.count, 0.50) * 1e3,
+	       percentile(report.seconds, report.count, 0.99) * 1e3,
+	       report.seconds[report.count - 1] * 1e3);
+
+	static const char *phase_names[PELX_enum(phase_count)] =
+	{
+		"read", "parse", "decode", "filter", "deflate", "write"
+	};
+
+	PELX_type(stats) stats;
+	PELX_func(global_stats)(&stats);
+
+	uint64_t total = 0;
+	for (int i = 0; i < PELX_enum(phase_count); i++)
+	{
+		total += stats.nanoseconds[i];
+	}
+
+	if (total > 0)
+	{
+		printf("phases:");
+		for (int i = 0; i < PELX_enum(phase_count); i++)
+		{
+			printf(" %s %.1f%%", phase_names[i], 100.0 * (double)stats.nanoseconds[i] / (double)total);
+		}
+		printf("\n");
+	}
+}
+
+// Expands every argument as a glob pattern, returns 0 when nothing matched
+static int expand_patterns(int count, char **patterns, glob_t *files)
+{
+	int flags = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int status = glob(patterns[i], flags, NULL, files);
+		if (status == GLOB_NOMATCH)
+		{
+			fprintf(stderr, "no file matches %s\n", patterns[i]);
+		}
+		else if (status != 0)
+		{
+			fprintf(stderr, "cannot expand %s\n", patterns[i]);
+		}
+		else
+		{
+			flags = GLOB_APPEND;
+		}
+	}
+
+	return flags != 0 && files->gl_pathc > 0;
+}
+
+// Output path of an input: its .pelx extension replaced by .png, in directory when given
+static char *output_path(const char *input, const char *directory)
+{
+	const char *name = input;
+	if (directory != NULL)
+	{
+		const char *slash = strrchr(input, '/');
+		name = slash != NULL ? slash + 1 : input;
+	}
+
+	size_t length = strlen(name);
+	if (length > 5 && strcmp(name + length - 5, ".pelx") == 0)
+	{
+		length -= 5;
+	}
+
+	size_t size = (directory != NULL ? strlen(directory) + 1 : 0) + length + 5;
+	char *path = (char *)malloc(size);
+	if (path == NULL)
+	{
+		return NULL;
+	}
+
+	if (directory != NULL)
+	{
+		snprintf(path, size, "%s/%.*s.png", directory, (int)length, name);
+	}
+	else
+	{
+		snprintf(path, size, "%.*s.png", (int)length, name);
+	}
+
+	return path;
+}
+
+static int run_info(glob_t *files)
+{
+	for (size_t i = 0; i < files->gl_pathc; i++)
+	{
+		const char *path = files->gl_pathv[i];
+		const double start = now_seconds();
+
+		PELX_type(file) pelx_file = NULL;
+		PELX_type(result) result = PELX_func(decode_pelx)(path, &pelx_file);
+
+		report_latency(now_seconds() - start);
+
+		if (result != PELX_enum(success))
+		{
+			printf("%s: decoding failed with error code %d\n", path, result);
+			report.failures++;
+			continue;
+		}
+
+		const PELX_type(header) *header = &pelx_file->header;
+		report.bytes_in += file_size(path);
+
+		printf("%s:\n", path);
+		printf("  size: %ux%u\n", header->width, header->height);
+		printf("  header size: %u bytes, pixel data: %u bytes\n", header->header_size, pelx_file->body.size);
+		printf("  palette: %u entries, %u channels\n", header->palette_count, header->palette_channel_count);
+		printf("  true colour channels: %u\n", header->true_channel_count);
+		printf("  animated: %s\n", (header->reserved[0] & PELX_flag_animated) ? "yes" : "no");
+
+		for (uint16_t p = 0; p < pelx_file->palettes.count; p++)
+		{
+			printf("  embedded palette %u: %s\n", p, pelx_file->palettes.data[p].name);
+		}
+
+		PELX_func(free_file)(&pelx_file);
+	}
+
+	return report.failures != 0;
+}
+
+static int run_validate(glob_t *files)
+{
+	for (size_t i = 0; i < files->gl_pathc; i++)
+	{
+		const char *path = files->gl_pathv[i];
+		const double start = now_seconds();
+
+		PELX_type(file) pelx_file = NULL;
+		PELX_type(validation) validation;
+		memset(&validation, 0, sizeof(validation));
+		validation.error_offset = UINT32_MAX;
+
+		PELX_type(result) result = PELX_func(decode_pelx)(path, &pelx_file);
+		if (result == PELX_enum(success))
+		{
+			result = PELX_func(sanitize_header)(&pelx_file->header);
+		}
+
+		if (result == PELX_enum(success))
+		{
+			result = PELX_func(validate_pixels)(pelx_file, &validation);
+		}
+
+		report_latency(now_seconds() - start);
+		report.bytes_in += file_size(path);
+
+		if (result == PELX_enum(success))
+		{
+			printf("%s: ok\n", path);
+		}
+		else if (validation.error_offset != UINT32_MAX)
+		{
+			printf("%s: invalid pixel data at offset %u (error code %d)\n", path, validation.error_offset, result);
+			report.failures++;
+		}
+		else
+		{
+			printf("%s: invalid (error code %d)\n", path, result);
+			report.failures++;
+		}
+
+		PELX_func(free_file)(&pelx_file);
+	}
+
+	return report.failures != 0;
+}
+
+static int run_convert(glob_t *files, uint16_t palette_count, PELX_type(palette_entry) *entries,
+                       uint8_t channels, const char *directory)
+{
+	for (size_t i = 0; i < files->gl_pathc; i++)
+	{
+		const char *path = files->gl_pathv[i];
+		char *output = output_path(path, directory);
+		if (output == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		const double start = now_seconds();
+
+		PELX_type(file) pelx_file = NULL;
+		PELX_type(result) result = PELX_func(decode_pelx)(path, &pelx_file);
+		if (result == PELX_enum(success))
+		{
+			result = PELX_func(encode_png)(output, pelx_file, palette_count, entries, channels);
+		}
+
+		report_latency(now_seconds() - start);
+		PELX_func(free_file)(&pelx_file);
+
+		if (result != PELX_enum(success))
+		{
+			printf("%s: conversion failed with error code %d\n", path, result);
+			report.failures++;
+		}
+		else
+		{
+			report.bytes_in += file_size(path);
+			report.bytes_out += file_size(output);
+		}
+
+		free(output);
+	}
+
+	return report.failures != 0;
+}
+
+static int run_batch(glob_t *files, uint16_t palette_count, PELX_type(palette_entry) *entries,
+                     uint8_t channels, const char *directory, uint32_t thread_count)
+{
+	const uint32_t count = (uint32_t)files->gl_pathc;
+
+	PELX_type(batch_job) *jobs = (PELX_type(batch_job) *)calloc(count, sizeof(PELX_type(batch_job)));
+	if (jobs == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		jobs[i].input = files->gl_pathv[i];
+		jobs[i].output = output_path(files->gl_pathv[i], directory);
+		jobs[i].palette_count = palette_count;
+		jobs[i].palette_entries = entries;
+		jobs[i].png_channels = channels;
+
+		if (jobs[i].output == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+
+	PELX_func(set_trace_callback)(batch_job_span, NULL);
+	PELX_func(encode_batch)(count, jobs, thread_count);
+	PELX_func(set_trace_callback)(NULL, NULL);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (jobs[i].result != PELX_enum(success))
+		{
+			printf("%s: conversion failed with error code %d\n", jobs[i].input, jobs[i].result);
+			report.failures++;
+		}
+		else
+		{
+			report.bytes_in += file_size(jobs[i].input);
+			report.bytes_out += file_size(jobs[i].output);
+		}
+
+		free((char *)jobs[i].output);
+	}
+
+	free(jobs);
+	return report.failures != 0;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s info <file.pelx>...\n", program);
+	fprintf(stderr, "       %s validate <file.pelx>...\n", program);
+	fprintf(stderr, "       %s convert [-o directory] [-c channels] <palette> <file.pelx>...\n", program);
+	fprintf(stderr, "       %s batch [-o directory] [-c channels] [-j threads] <palette> <file.pelx>...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *command = argv[1];
+	const int converts = strcmp(command, "convert") == 0 || strcmp(command, "batch") == 0;
+
+	if (!converts && strcmp(command, "info") != 0 && strcmp(command, "validate") != 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *directory = NULL;
+	uint8_t channels = 4;
+	uint32_t thread_count = 0;
+
+	int arg = 2;
+	for (; converts && arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (strcmp(argv[arg], "-o") == 0)
+		{
+			directory = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "-c") == 0)
+		{
+			channels = (uint8_t)atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "-j") == 0 && strcmp(command, "batch") == 0)
+		{
+			thread_count = (uint32_t)atoi(argv[arg + 1]);
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (channels != 3 && channels != 4)
+	{
+		fprintf(stderr, "channels must be 3 or 4\n");
+		return 1;
+	}
+
+	PELX_type(palette_entry) entries[PALETTE_FILE_max_entries];
+	uint16_t palette_count = 0;
+
+	if (converts)
+	{
+		if (arg >= argc || (palette_count = read_palette_file(argv[arg++], entries)) == 0)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	glob_t files;
+	memset(&files, 0, sizeof(files));
+
+	if (arg >= argc || !expand_patterns(argc - arg, argv + arg, &files))
+	{
+		fprintf(stderr, "no input files\n");
+		return 1;
+	}
+
+	const double start = now_seconds();
+	int status = 0;
+
+	if (strcmp(command, "info") == 0)
+	{
+		status = run_info(&files);
+	}
+	else if (strcmp(command, "validate") == 0)
+	{
+		status = run_validate(&files);
+	}
+	else if (strcmp(command, "convert") == 0)
+	{
+		status = run_convert(&files, palette_count, entries, channels, directory);
+	}
+	else
+	{
+		status = run_batch(&files, palette_count, entries, channels, directory, thread_count);
+	}
+
+	print_report(command, now_seconds() - start);
+
+	globfree(&files);
+	free(report.seconds);
+
+	return status;
+}